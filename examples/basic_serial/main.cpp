@@ -1,5 +1,9 @@
 #include <Arduino.h>
 #include "lepton.h"
+#include "lepton_codec.h"
+#include "lepton_dutycycle.h"
+#include "lepton_log.h"
+#include "lepton_serial_protocol.h"
 
 
 const int kPinLedR = 0;  // overlaps with strapping pin
@@ -15,13 +19,38 @@ const int kPinLepSck = 1;
 const int kPinLepMosi = 5;
 const int kPinLepMiso = 4;
 
+// When true, streams full 16-bit frames using the binary protocol in lepton_serial_protocol.h instead of printing
+// ASCII frames, to be decoded host-side with SerialFrameReceiver. Raw frames are 38 KB (Lepton 3.x), so this needs
+// a fast link (eg, native USB-CDC or a UART at several Mbaud) to keep up with the frame rate.
+const bool kBinaryOutput = false;
+// When true (and kBinaryOutput), frames are LosslessEncoder compressed, typically to under half size
+const bool kCompressOutput = false;
+// When nonzero, the Lepton is powered down between captures and woken every this many ms for one frame, see
+// lepton_dutycycle.h. Requires the PWRDN pin.
+const uint32_t kDutyCyclePeriodMillis = 0;
+
 
 SPIClass spi(HSPI);
 TwoWire i2c(0);
 
 FlirLepton lepton(i2c, spi, kPinLepCs, kPinLepRst, kPinLepPwrdn);
+LeptonDutyCycle dutyCycle(lepton);
 uint8_t vospiBuf[160*120*3] = {0};  // up to RGB888, double-buffered
 
+uint16_t encoderReference[160*120];
+uint8_t encodeBuf[160*120*2];  // frames that don't compress below raw size are sent raw instead
+LosslessEncoder encoder(160, 120, encoderReference);
+
+void writeSerial(const uint8_t* data, size_t len, void* context) {
+  Serial.write(data, len);
+}
+SerialFrameSender serialSender(writeSerial, nullptr);
+
+
+bool dutyCycleWake(FlirLepton& lepton, void* context) {
+  return lepton.enableVsync();
+}
+
 
 void setup() {
   Serial.begin(115200);
@@ -55,13 +84,69 @@ void setup() {
   assert(lepton.enableVsync());
   
   while (!digitalRead(kPinLepVsync));  // seems necessary
+
+  if (kDutyCyclePeriodMillis > 0) {
+    LeptonDutyCycle::Config config = LeptonDutyCycle::kDefaultConfig;
+    config.periodMillis = kDutyCyclePeriodMillis;
+    dutyCycle.setConfig(config);
+    dutyCycle.setWakeHook(dutyCycleWake, nullptr);
+    assert(dutyCycle.start());
+  }
+
+  if (kBinaryOutput) {
+    const uint8_t kDelimiter = 0;  // terminate the text above, so the receiver discards it as one bad message
+    Serial.write(&kDelimiter, 1);
+  }
+}
+
+void printDeferredLog(char level, const char* message, void* context) {
+  Serial.print("LEP ");
+  Serial.print(level);
+  Serial.print(" ");
+  Serial.println(message);
 }
 
 void loop() {
-  bool readResult = lepton.readVoSpi(sizeof(vospiBuf), vospiBuf);
+  bool readResult;
+  if (kDutyCyclePeriodMillis > 0) {
+    readResult = dutyCycle.poll(sizeof(vospiBuf), vospiBuf);
+    if (dutyCycle.getState() == LeptonDutyCycle::kAsleep && !readResult) {
+      delay(dutyCycle.getSleepMillisRemaining());  // could light-sleep the MCU here instead
+    }
+  } else {
+    readResult = lepton.readVoSpi(sizeof(vospiBuf), vospiBuf);
+  }
+  if (kBinaryOutput) {
+    if (readResult) {
+      digitalWrite(kPinLedR, !digitalRead(kPinLedR));
+      uint16_t width = lepton.getFrameWidth(), height = lepton.getFrameHeight();
+      size_t encodedLen = 0;
+      if (kCompressOutput && width == 160 && height == 120) {  // encoder is sized for Lepton 3.x
+        encodedLen = encoder.encode(vospiBuf, encodeBuf, sizeof(encodeBuf));  // 0 if it didn't fit
+      }
+      if (encodedLen > 0) {
+        serialSender.sendLosslessFrame(encodeBuf, encodedLen, width, height);
+      } else {
+        serialSender.sendRawFrame(vospiBuf, width, height);
+      }
+    }
+    return;
+  }
+
+  LeptonLog::deferredLog.drain(printDeferredLog, nullptr);  // outside readout, so printing doesn't cause VoSPI desync
   if (readResult) {
     digitalWrite(kPinLedR, !digitalRead(kPinLedR));
     Serial.println("Got frame");
+    if (kDutyCyclePeriodMillis > 0) {
+      LeptonDutyCycle::Stats stats = dutyCycle.getStats();
+      Serial.print("Awake ");
+      Serial.print(stats.lastAwakeMillis);
+      Serial.print(" ms (boot ");
+      Serial.print(stats.lastBootMillis);
+      Serial.print(" ms), average ");
+      Serial.print(dutyCycle.getAwakeMillisPerFrame());
+      Serial.println(" ms per frame");
+    }
 
     // run basic linear AGC
     size_t width = lepton.getFrameWidth(), height = lepton.getFrameHeight();
@@ -1,5 +1,16 @@
 #include <Arduino.h>
 #include "lepton.h"
+#include "lepton_alloc.h"
+#include "lepton_blobs.h"
+#include "lepton_codec.h"
+#include "lepton_controller.h"
+#include "lepton_history.h"
+#include "lepton_log.h"
+#include "lepton_pipeline.h"
+#include "lepton_ratecontrol.h"
+#include "lepton_scenechange.h"
+#include "lepton_trace.h"
+#include "lepton_upscale.h"
 
 // web server code based on (BSD)
 // https://github.com/arkhipenko/esp32-cam-mjpeg/blob/master/esp32_camera_mjpeg.ino
@@ -32,26 +43,40 @@ const int kPinLepMosi = 5;
 const int kPinLepMiso = 4;
 
 
+const BaseType_t kCaptureCore = ARDUINO_RUNNING_CORE;
+const BaseType_t kProcessingCore = (ARDUINO_RUNNING_CORE + 1) % portNUM_PROCESSORS;  // encoding and networking
+
 SPIClass spi(HSPI);
 TwoWire i2c(0);
 
 FlirLepton lepton(i2c, spi, kPinLepCs, kPinLepRst, kPinLepPwrdn);
+LeptonController leptonController(lepton);  // other tasks change settings and get status through this
+// when true, picks the fastest reliable VoSPI clock at startup (see FlirLepton::calibrateSpi), eg for long cables
+const bool kCalibrateSpi = false;
 uint8_t jpegencPixelType = JPEGE_PIXEL_GRAYSCALE;
 uint8_t jpegencPixelBytes = 2;
-uint8_t vospiBuf[2][160*120*3] = {0};  // up to RGB888, double-buffered
-// controlled by the writing (sensor) task
-uint8_t bufferWriteIndex = 0;  // buffer being written to, the other one is implicitly the read buffer; 0 means buffer not being read
-uint8_t frameCounter = 0;  // incrementing, reflecting the frame count in the read buffer
-std::atomic<uint8_t> bufferReaders{0};  // number of readers of the non-writing buffer, locks bufferWriteIndex if >0
-SemaphoreHandle_t bufferControlSemaphore = nullptr;  // mutex to control access to the write index / readers count
+HeapAllocator bufferAllocator;
+// frames flow through framePipeline (capture -> process -> encode -> fan-out) in slots, each slot being
+// lepton.getFrameBuffer(slot), sized for the current video format. One more buffer takes frames read while every
+// slot is in use, which are dropped.
+const size_t kFrameSlots = 2;
+const size_t kOverrunBuffer = kFrameSlots;
+LatencyTracer latencyTracer;  // capture-to-client latency of MJPEG streamed frames
+// format changes reallocate the frame buffers (see applyConfigHook), so stages hold them through beginFrameRead
+uint32_t bufferGeneration = 0;  // incremented on each format change, guarded by bufferControlSemaphore
+std::atomic<uint8_t> bufferReaders{0};  // number of stages reading a frame buffer, blocks reallocation if >0
+SemaphoreHandle_t bufferControlSemaphore = nullptr;  // mutex to control access to the generation / readers count
 StaticSemaphore_t bufferControlSemaphoreBuf;
 
 
 JPEGENC jpgenc;
-const size_t kJpegBufferSize = 32768;
+// optional on-device JPEG upscaling (1 to disable, 2, or 4), streamed into the encoder a strip of MCUs at a time
+const uint8_t kJpegUpscale = 1;
+const Upscaler::Mode kJpegUpscaleMode = Upscaler::kEdgeAware;
+const size_t kJpegBufferSize = 32768 * kJpegUpscale;  // upscaling also takes its strip buffer from here
 
-// converts frame into a jpeg, stored in jpegBuf, writing the output length to jpegLenOut
-int encodeJpeg(uint8_t* frame, size_t frameWidth, size_t frameHeight, uint8_t ucPixelType, uint8_t* jpegBuf, size_t jpegBufLen, size_t* jpegLenOut) {
+// converts frame into a jpeg at some quality level (see RateControl), stored in jpegBuf, writing the output length to jpegLenOut
+int encodeJpeg(uint8_t* frame, size_t frameWidth, size_t frameHeight, uint8_t ucPixelType, uint8_t level, uint8_t* jpegBuf, size_t jpegBufLen, size_t* jpegLenOut) {
   JPEGENCODE enc;
   int rc;
 
@@ -71,6 +96,21 @@ int encodeJpeg(uint8_t* frame, size_t frameWidth, size_t frameHeight, uint8_t uc
     lineLength = frameWidth * jpegencPixelBytes;
   }
 
+  // if upscaling, the end of the buffer also holds a strip of MCU rows and the upscaler scratch
+  Upscaler upscaler(frameWidth, frameHeight, jpegencPixelBytes == 3 ? 3 : 1, 1, kJpegUpscale, kJpegUpscaleMode);
+  const size_t kMaxMcuHeight = 16;
+  uint8_t* strip = nullptr;
+  uint32_t* upscaleScratch = nullptr;
+  if (kJpegUpscale > 1) {
+    size_t stripLen = kMaxMcuHeight * upscaler.getOutRowLen();
+    size_t scratchLen = upscaler.getScratchLen() * sizeof(uint32_t);
+    assert(jpegBufLen > stripLen + scratchLen);
+    jpegBufLen -= stripLen + scratchLen;
+    jpegBufLen &= ~(sizeof(uint32_t) - 1);  // keep the scratch aligned
+    upscaleScratch = (uint32_t*)(jpegBuf + jpegBufLen);
+    strip = jpegBuf + jpegBufLen + scratchLen;
+  }
+
   rc = jpgenc.open(jpegBuf, jpegBufLen);
   if (rc != JPEGE_SUCCESS) {
     ESP_LOGE("jpg", "Open error %i", rc);
@@ -78,19 +118,38 @@ int encodeJpeg(uint8_t* frame, size_t frameWidth, size_t frameHeight, uint8_t uc
   }
 
   if (rc == JPEGE_SUCCESS) {
-    rc = jpgenc.encodeBegin(&enc, frameWidth, frameHeight, ucPixelType, JPEGE_SUBSAMPLE_444, JPEGE_Q_BEST);
+    const uint8_t kQualities[RateControl::kNumQualities] = {JPEGE_Q_BEST, JPEGE_Q_HIGH, JPEGE_Q_MED, JPEGE_Q_LOW};
+    uint8_t subsample = RateControl::isSubsampled(level) ? JPEGE_SUBSAMPLE_420 : JPEGE_SUBSAMPLE_444;
+    rc = jpgenc.encodeBegin(&enc, upscaler.getOutWidth(), upscaler.getOutHeight(), ucPixelType, subsample,
+        kQualities[RateControl::getQuality(level)]);
     if (rc != JPEGE_SUCCESS) {
       ESP_LOGE("jpg", "encodeBegin error %i", rc);
       return rc;
     }
   }
   
-  if (rc == JPEGE_SUCCESS) {
+  if (rc == JPEGE_SUCCESS && strip == nullptr) {
     rc = jpgenc.addFrame(&enc, frame, lineLength);
     if (rc != JPEGE_SUCCESS) {
       ESP_LOGE("jpg", "addFrame error %i", rc);
       return rc;
     }
+  } else if (rc == JPEGE_SUCCESS) {  // upscale a strip of MCU rows at a time, then encode its MCUs
+    size_t outRowLen = upscaler.getOutRowLen();
+    size_t outPixelLen = jpegencPixelBytes == 3 ? 3 : 1;
+    for (uint16_t stripY=0; stripY<upscaler.getOutHeight() && rc == JPEGE_SUCCESS; stripY += enc.cy) {
+      for (uint16_t row=0; row<enc.cy; row++) {
+        uint16_t y = stripY + row < upscaler.getOutHeight() ? stripY + row : upscaler.getOutHeight() - 1;
+        upscaler.upscaleRow(frame, y, strip + row * outRowLen, upscaleScratch);
+      }
+      for (uint16_t x=0; x<upscaler.getOutWidth() && rc == JPEGE_SUCCESS; x += enc.cx) {
+        rc = jpgenc.addMCU(&enc, strip + x * outPixelLen, outRowLen);
+      }
+    }
+    if (rc != JPEGE_SUCCESS) {
+      ESP_LOGE("jpg", "addMCU error %i", rc);
+      return rc;
+    }
   }
   
   if (rc == JPEGE_SUCCESS) {
@@ -100,18 +159,57 @@ int encodeJpeg(uint8_t* frame, size_t frameWidth, size_t frameHeight, uint8_t uc
 }
 
 
+// encodes a frame starting at a quality level, retrying at lower quality levels if it doesn't fit in jpegBuf,
+// writing the level used to levelOut. rateControl (optional) is informed of fallbacks.
+int encodeJpegAdaptive(uint8_t* frame, size_t frameWidth, size_t frameHeight, uint8_t ucPixelType, uint8_t level,
+    RateControl* rateControl, uint8_t* jpegBuf, size_t jpegBufLen, size_t* jpegLenOut, uint8_t* levelOut) {
+  while (true) {
+    int rc = encodeJpeg(frame, frameWidth, frameHeight, ucPixelType, level, jpegBuf, jpegBufLen, jpegLenOut);
+    *levelOut = level;
+    if (rc == JPEGE_SUCCESS) {
+      return rc;
+    }
+    if (rateControl != nullptr) {
+      level = rateControl->getFallbackLevel(level);
+    } else {
+      level = level + 1 < RateControl::kNumLevels ? level + 1 : RateControl::kNoLevel;
+    }
+    if (level == RateControl::kNoLevel) {
+      return rc;
+    }
+    ESP_LOGW("jpg", "retrying at level %i", level);
+  }
+}
+
+
 WebServer server(80);
 
 const size_t kMaxStreamingClients = 4;
 size_t numStreamingClients = 0;  // synchronized with the streamingClients buffer
 WiFiClient streamingClients[kMaxStreamingClients];  // always continuous from zero when mutex is released
 
-TaskHandle_t streamingTask = nullptr;
+std::atomic<bool> mjpegClientJoined{false};  // set when a new client joins, so it gets a frame of a static scene
 SemaphoreHandle_t streamingClientsSemaphore = nullptr;  // mutex to control access to the streaming clients count / buffer
 StaticSemaphore_t streamingClientsSemaphoreBuf;
 
-uint8_t streamingJpegBuffer[kJpegBufferSize];
-uint8_t webserverJpegBuffer[kJpegBufferSize];
+const uint32_t kStreamingTargetBitrate = 4000000;  // bits/s across all MJPEG clients, also limited by the slowest client
+RateControl streamingRateControl(kStreamingTargetBitrate);
+
+// skips encoding and sending static scenes (16-bit formats only), with a keepalive frame every second
+// note, the default noise floor is tuned for TLinear and should be reduced for 8-bit AGC output
+uint16_t sceneChangeState[SceneChangeDetector::getStateLen(160, 120)];
+SceneChangeDetector sceneChangeDetector(160, 120, sceneChangeState);
+
+// /jpg snapshots, encoded by the encode stage on request
+enum JpgState : uint8_t {
+  kJpgIdle,
+  kJpgRequested,  // by handle_jpg
+  kJpgEncoding,  // taken by the encode stage
+  kJpgDone,  // webserverJpegLen is valid, 0 if encoding failed
+};
+std::atomic<uint8_t> jpgState{kJpgIdle};
+uint8_t* webserverJpegBuffer = nullptr;  // allocated in setup(), in PSRAM if available
+size_t webserverJpegLen = 0;
 
 const char kMjpegHeader[] = "HTTP/1.1 200 OK\r\n" \
                       "Access-Control-Allow-Origin: *\r\n" \
@@ -122,62 +220,27 @@ const int kMjpegHeaderLen = strlen(kMjpegHeader);
 const int kMjpegBoundaryLen = strlen(kMjpegBoundary);
 const int kMjpegContentTypeLen = strlen(kMjpegContentType);
 
-// For each connected streaming client, send new frames as they become available
-void Task_MjpegStream(void *pvParameters) {
-  uint8_t lastFrame = frameCounter - 1;
-  while (true) {
-    if (numStreamingClients <= 0 || frameCounter == lastFrame) {  // quick test
-      xTaskNotifyWait(0, 0, nullptr, portMAX_DELAY);
-      continue;
-    }
-
-    // encode frame
-    size_t jpegSize;
-    while (xSemaphoreTake(bufferControlSemaphore, portMAX_DELAY) != pdTRUE);
-    uint8_t bufferReadIndex = (bufferWriteIndex + 1) % 2;
-    bufferReaders++;
-    assert(xSemaphoreGive(bufferControlSemaphore) == pdTRUE);
-
-    int encodeStatus = encodeJpeg(vospiBuf[bufferReadIndex], lepton.getFrameWidth(), lepton.getFrameHeight(),
-        jpegencPixelType, streamingJpegBuffer, sizeof(streamingJpegBuffer), &jpegSize);
-    lastFrame = frameCounter;
-
-    bufferReaders--;
-
-    // deallocate disconnected clients
-    while (xSemaphoreTake(streamingClientsSemaphore, portMAX_DELAY) != pdTRUE);
-    size_t writeClientIndex = 0;
-    for (size_t readClientIndex=0; readClientIndex<numStreamingClients; readClientIndex++) {
-      // TODO faster to swap with last element
-      if (streamingClients[readClientIndex].connected()) {
-        if (readClientIndex != writeClientIndex) {
-          streamingClients[writeClientIndex] = streamingClients[readClientIndex];
-        }
-        writeClientIndex++;
-      } else {
-        ESP_LOGI("main", "MJPEG disconnected %i", readClientIndex);
-      }
-    }
-    uint8_t currStreamingClients = numStreamingClients = writeClientIndex;
-    assert(xSemaphoreGive(streamingClientsSemaphore) == pdTRUE);
-
-    if (encodeStatus == JPEGE_SUCCESS) {
-      ESP_LOGI("main", "MJPEG stream %i B", jpegSize);
-      char buf[32];
-      sprintf(buf, "%d\r\n\r\n", jpegSize);
-      size_t bufLen = strlen(buf);
-
-      for (size_t i=0; i<currStreamingClients; i++) {
-        streamingClients[i].write(kMjpegContentType, kMjpegContentTypeLen);
-        streamingClients[i].write(buf, bufLen);
-        streamingClients[i].write(streamingJpegBuffer, jpegSize);
-        streamingClients[i].write(kMjpegBoundary, kMjpegBoundaryLen);
+// Removes disconnected clients from a streaming clients buffer, returning the new client count
+size_t pruneStreamingClients(WiFiClient* clients, size_t* numClients, SemaphoreHandle_t semaphore, const char* name) {
+  while (xSemaphoreTake(semaphore, portMAX_DELAY) != pdTRUE);
+  size_t writeClientIndex = 0;
+  for (size_t readClientIndex=0; readClientIndex<*numClients; readClientIndex++) {
+    // TODO faster to swap with last element
+    if (clients[readClientIndex].connected()) {
+      if (readClientIndex != writeClientIndex) {
+        clients[writeClientIndex] = clients[readClientIndex];
       }
+      writeClientIndex++;
+    } else {
+      ESP_LOGI("main", "%s disconnected %i", name, readClientIndex);
     }
   }
+  size_t currClients = *numClients = writeClientIndex;
+  assert(xSemaphoreGive(semaphore) == pdTRUE);
+  return currClients;
 }
 
-// Starts the MJPEG stream, including sending the current frame or a max-clients error
+// Starts the MJPEG stream, or sends a max-clients error. Frames are sent by the pipeline's fan-out stage.
 void handle_mjpeg_stream(void) {
   WiFiClient* client;
   size_t thisStreamingClient;  // valid if client != nullptr
@@ -198,31 +261,338 @@ void handle_mjpeg_stream(void) {
 
   client->write(kMjpegHeader, kMjpegHeaderLen);
   client->write(kMjpegBoundary, kMjpegBoundaryLen);
+  mjpegClientJoined = true;
+  ESP_LOGI("main", "MJPEG started %i", thisStreamingClient);
+}
+
+
+// Lossless raw 16-bit stream, see lepton_codec.h for the frame format. Only valid in kGrey14 format.
+size_t numRawStreamingClients = 0;  // synchronized with the rawStreamingClients buffer
+WiFiClient rawStreamingClients[kMaxStreamingClients];  // always continuous from zero when mutex is released
+
+SemaphoreHandle_t rawStreamingClientsSemaphore = nullptr;  // mutex to control access to the raw streaming clients
+StaticSemaphore_t rawStreamingClientsSemaphoreBuf;
+std::atomic<bool> rawKeyframeRequested{false};  // set when a new client joins, so it can start decoding
+
+const size_t kRawBufferSize = 32768;  // per slot, allocated in setup()
+uint16_t rawReference[160*120];
+LosslessEncoder rawEncoder(160, 120, rawReference);
+
+const char kRawHeader[] = "HTTP/1.1 200 OK\r\n" \
+                          "Access-Control-Allow-Origin: *\r\n" \
+                          "Content-Type: multipart/x-mixed-replace; boundary=FRAME\r\n";
+const char kRawContentType[] = "Content-Type: application/octet-stream\r\nContent-Length: ";  // written per frame
+const int kRawHeaderLen = strlen(kRawHeader);
+const int kRawContentTypeLen = strlen(kRawContentType);
+
+// Starts the raw stream, frames are sent starting with a keyframe
+void handle_raw_stream(void) {
+  WiFiClient* client;
+  while (xSemaphoreTake(rawStreamingClientsSemaphore, portMAX_DELAY) != pdTRUE);
+  if (numRawStreamingClients >= kMaxStreamingClients) {
+    client = nullptr;
+  } else {
+    rawStreamingClients[numRawStreamingClients] = server.client();
+    client = &(rawStreamingClients[numRawStreamingClients]);
+    numRawStreamingClients++;
+  }
+  assert(xSemaphoreGive(rawStreamingClientsSemaphore) == pdTRUE);
+
+  if (client == nullptr) {
+    server.send(200, "text / plain", "Max streaming clients");
+    return;
+  }
+
+  client->write(kRawHeader, kRawHeaderLen);
+  client->write(kMjpegBoundary, kMjpegBoundaryLen);
+  rawKeyframeRequested = true;
+  ESP_LOGI("main", "Raw stream started");
+}
+
+
+// Pre-trigger history of recent frames (16-bit formats only), allocated in PSRAM if available.
+// Frames are compressed into the history by the pipeline's process stage, off the capture path. It runs above the
+// server task priority on the same core, so a freeze() from a request handler never spins on a write it preempted.
+// /trigger freezes the history, /history exports it (freezing it if needed) as a raw stream and resumes recording.
+const size_t kHistoryBudget = 2 * 1024 * 1024;
+const size_t kHistoryMaxRecordLen = 48 * 1024;
+FrameHistory* history = nullptr;
+
+void handle_trigger(void) {
+  if (history == nullptr) {
+    server.send(200, "text / plain", "History unavailable");
+    return;
+  }
+  history->freeze();
+  ESP_LOGI("main", "History frozen, %i frames over %i ms", history->getNumFrames(), history->getSpanMillis());
+  server.send(200, "text / plain", "History frozen");
+}
+
+bool writeHistoryRecord(const uint8_t* encoded, size_t len, uint32_t timestampMillis, void* context) {
+  WiFiClient* client = (WiFiClient*)context;
+  char buf[64];
+  client->write(kRawContentType, kRawContentTypeLen);
+  sprintf(buf, "%d\r\nX-Timestamp-Millis: %u\r\n\r\n", len, timestampMillis);
+  client->write(buf, strlen(buf));
+  client->write(encoded, len);
+  client->write(kMjpegBoundary, kMjpegBoundaryLen);
+  return client->connected();
+}
+
+void handle_history(void) {
+  if (history == nullptr) {
+    server.send(200, "text / plain", "History unavailable");
+    return;
+  }
+  WiFiClient client = server.client();
+  history->freeze();
+  client.write(kRawHeader, kRawHeaderLen);
+  client.write(kMjpegBoundary, kMjpegBoundaryLen);
+  size_t exported = history->exportRecords(0, writeHistoryRecord, &client);
+  ESP_LOGI("main", "History exported %i frames, %i B", exported, history->getBytesUsed());
+  client.stop();
+  history->unfreeze();
+}
+
+
+// Hot-spot analytics (16-bit formats only), run by the pipeline's process stage on every frame (whether or not clients
+// are connected, so tracks persist), results streamed as newline-delimited JSON
+const uint16_t kBlobThreshold = 30315;  // 30 C in TLinear units (0.01 K)
+BlobTracker blobTracker(160, 120);  // owned by the process stage
+
+size_t numBlobStreamingClients = 0;  // synchronized with the blobStreamingClients buffer
+WiFiClient blobStreamingClients[kMaxStreamingClients];
+SemaphoreHandle_t blobStreamingClientsSemaphore = nullptr;
+StaticSemaphore_t blobStreamingClientsSemaphoreBuf;
+
+const char kBlobHeader[] = "HTTP/1.1 200 OK\r\n" \
+                           "Access-Control-Allow-Origin: *\r\n" \
+                           "Content-Type: application/x-ndjson\r\n\r\n";
+const int kBlobHeaderLen = strlen(kBlobHeader);
+
+// Formats the current blobTracker results as a JSON line into json, returning its length
+size_t formatBlobs(uint32_t timestampMillis, char* json, size_t jsonLen) {
+  size_t len = snprintf(json, jsonLen, "{\"t\":%u,\"blobs\":[", timestampMillis);
+  for (size_t i=0; i<blobTracker.getNumBlobs() && len < jsonLen; i++) {
+    const BlobTracker::Blob& blob = blobTracker.getBlob(i);
+    uint32_t cx10 = blob.centroidX * 10 / 16, cy10 = blob.centroidY * 10 / 16;  // avoid float printf
+    len += snprintf(json + len, jsonLen - len,
+        "%s{\"id\":%u,\"area\":%u,\"cx\":%u.%u,\"cy\":%u.%u,\"max\":%u,\"maxAt\":[%u,%u],\"bbox\":[%u,%u,%u,%u],\"age\":%u}",
+        i > 0 ? "," : "", blob.id, blob.area, cx10 / 10, cx10 % 10, cy10 / 10, cy10 % 10, blob.maxValue,
+        blob.maxX, blob.maxY, blob.minX, blob.minY, blob.maxXBound, blob.maxYBound, blob.age);
+  }
+  if (len < jsonLen) {
+    len += snprintf(json + len, jsonLen - len, "]}\n");
+  }
+  return len < jsonLen ? len : jsonLen - 1;
+}
+
+void handle_blobs_stream(void) {
+  WiFiClient* client;
+  while (xSemaphoreTake(blobStreamingClientsSemaphore, portMAX_DELAY) != pdTRUE);
+  if (numBlobStreamingClients >= kMaxStreamingClients) {
+    client = nullptr;
+  } else {
+    blobStreamingClients[numBlobStreamingClients] = server.client();
+    client = &(blobStreamingClients[numBlobStreamingClients]);
+    numBlobStreamingClients++;
+  }
+  assert(xSemaphoreGive(blobStreamingClientsSemaphore) == pdTRUE);
+
+  if (client == nullptr) {
+    server.send(200, "text / plain", "Max streaming clients");
+    return;
+  }
+  client->write(kBlobHeader, kBlobHeaderLen);
+  ESP_LOGI("main", "Blob stream started");
+}
 
-  // encode and send the first frame, if valid
-  size_t jpegSize;
 
+// Per-slot pipeline state, owned by whichever stage holds the slot
+struct FrameSlot {
+  uint32_t generation;  // bufferGeneration when the frame was captured
+  FrameTimestamps timestamps;
+  char blobJson[2048];  // blobTracker results, if blob streaming clients are connected
+  size_t blobJsonLen;
+  uint8_t* jpeg;  // kJpegBufferSize, allocated in setup()
+  size_t jpegLen;  // 0 if not encoded, eg a static scene
+  uint8_t jpegLevel;
+  uint8_t* raw;  // kRawBufferSize, allocated in setup()
+  size_t rawLen;
+};
+FrameSlot frameSlots[kFrameSlots];
+
+// Returns the frame buffer of slot and holds off reallocation until endFrameRead(), or returns nullptr if the frame
+// was captured before a format change (or the buffers could not be reallocated), in which case it is dropped
+uint8_t* beginFrameRead(int slot) {
   while (xSemaphoreTake(bufferControlSemaphore, portMAX_DELAY) != pdTRUE);
-  uint8_t bufferReadIndex = (bufferWriteIndex + 1) % 2;
-  bufferReaders++;
+  uint8_t* frame = frameSlots[slot].generation == bufferGeneration ? lepton.getFrameBuffer(slot) : nullptr;
+  if (frame != nullptr) {
+    bufferReaders++;
+  }
   assert(xSemaphoreGive(bufferControlSemaphore) == pdTRUE);
+  return frame;
+}
 
-  int encodeStatus = encodeJpeg(vospiBuf[bufferReadIndex], lepton.getFrameWidth(), lepton.getFrameHeight(),
-      jpegencPixelType, webserverJpegBuffer, sizeof(webserverJpegBuffer), &jpegSize);
-
+void endFrameRead() {
   bufferReaders--;
+}
+
+// Capture stage, on its own core: reads a frame into slot, or into the overrun buffer if every slot is in use
+bool captureFrame(int slot, void* context) {
+  uint8_t* buffer = lepton.getFrameBuffer(slot >= 0 ? slot : kOverrunBuffer);
+  if (buffer == nullptr) {  // frame buffer reallocation failed on a format change, retried on the next one
+    leptonController.service();
+    vTaskDelay(100);
+    return false;
+  }
+  if (!leptonController.readVoSpi(lepton.getFrameBufferLen(), buffer)) {
+    return false;
+  }
 
-  if (encodeStatus == JPEGE_SUCCESS) {
-    ESP_LOGI("main", "MJPEG started %i %i B", thisStreamingClient, jpegSize);
+  digitalWrite(kPinLedR, !digitalRead(kPinLedR));
+  if (slot >= 0) {
+    const FlirLepton::FrameInfo& frameInfo = lepton.getFrameInfo();
+    frameSlots[slot].generation = bufferGeneration;  // only changed by the config hook, on this task
+    frameSlots[slot].timestamps = {frameInfo.sequence, frameInfo.firstPacketMicros, frameInfo.lastPacketMicros,
+        (uint32_t)micros(), 0, 0};
+  }
+  return true;
+}
+
+// Process stage: history and blob tracking on 16-bit frames
+bool processFrame(int slot, void* context) {
+  FrameSlot& frameSlot = frameSlots[slot];
+  uint8_t* frame = beginFrameRead(slot);
+  if (frame == nullptr) {
+    return false;
+  }
+  frameSlot.blobJsonLen = 0;
+  if (lepton.getBytesPerPixel() == 2) {  // codec and tracking only support 16-bit pixels
+    if (history != nullptr) {
+      history->write(frame, millis());
+    }
+    blobTracker.process(frame);
+    if (numBlobStreamingClients > 0) {
+      frameSlot.blobJsonLen = formatBlobs(millis(), frameSlot.blobJson, sizeof(frameSlot.blobJson));
+    }
+  }
+  endFrameRead();
+  return true;
+}
+
+// Encode stage: the MJPEG stream frame (at a RateControl level, skipping static scenes), the raw stream frame,
+// and a /jpg snapshot if requested. Skips the fan-out if there is nothing to send.
+bool encodeFrame(int slot, void* context) {
+  FrameSlot& frameSlot = frameSlots[slot];
+  frameSlot.jpegLen = 0;
+  frameSlot.rawLen = 0;
+  if (numStreamingClients <= 0 && numRawStreamingClients <= 0 && frameSlot.blobJsonLen == 0 &&
+      jpgState != kJpgRequested) {  // quick test
+    return false;
+  }
+  uint8_t* frame = beginFrameRead(slot);
+  if (frame == nullptr) {
+    return false;
+  }
+  size_t frameWidth = lepton.getFrameWidth(), frameHeight = lepton.getFrameHeight();
+  bool is16Bit = lepton.getBytesPerPixel() == 2;
+
+  uint8_t jpgRequested = kJpgRequested;
+  if (jpgState.compare_exchange_strong(jpgRequested, kJpgEncoding)) {
+    uint8_t level;
+    if (encodeJpegAdaptive(frame, frameWidth, frameHeight, jpegencPixelType, 0, nullptr, webserverJpegBuffer,
+        kJpegBufferSize, &webserverJpegLen, &level) != JPEGE_SUCCESS) {
+      webserverJpegLen = 0;
+    }
+    jpgState = kJpgDone;
+  }
+
+  if (numStreamingClients > 0) {
+    bool send = !is16Bit || sceneChangeDetector.shouldSend(frame, millis());
+    if (mjpegClientJoined.exchange(false) || send) {
+      if (encodeJpegAdaptive(frame, frameWidth, frameHeight, jpegencPixelType, streamingRateControl.selectLevel(),
+          &streamingRateControl, frameSlot.jpeg, kJpegBufferSize, &frameSlot.jpegLen, &frameSlot.jpegLevel)
+          != JPEGE_SUCCESS) {
+        frameSlot.jpegLen = 0;
+      }
+      frameSlot.timestamps.encodeDoneMicros = micros();
+    }
+  }
+
+  if (numRawStreamingClients > 0 && is16Bit) {
+    if (rawKeyframeRequested.exchange(false)) {
+      rawEncoder.requestKeyframe();
+    }
+    frameSlot.rawLen = rawEncoder.encode(frame, frameSlot.raw, kRawBufferSize);
+    if (frameSlot.rawLen == 0) {
+      ESP_LOGW("main", "Raw stream encode overflow");
+    }
+  }
+
+  endFrameRead();
+  return true;
+}
+
+// Fan-out stage: sends the encoded frames and blob results to each connected streaming client
+bool fanOutFrame(int slot, void* context) {
+  FrameSlot& frameSlot = frameSlots[slot];
+  size_t currStreamingClients = numStreamingClients <= 0 ? 0 : pruneStreamingClients(streamingClients,
+      &numStreamingClients, streamingClientsSemaphore, "MJPEG");
+  if (frameSlot.jpegLen > 0) {
+    streamingRateControl.reportEncoded(frameSlot.jpegLevel, frameSlot.jpegLen, micros());
+    ESP_LOGI("main", "MJPEG stream %i B (level %i), %i bps", frameSlot.jpegLen, frameSlot.jpegLevel,
+        streamingRateControl.getAchievedBitrate());
+    char buf[96];  // rest of the part header, with the capture (first packet) timestamp on the device clock
+    sprintf(buf, "%d\r\nX-Frame-Sequence: %u\r\nX-Timestamp-Micros: %u\r\n\r\n", frameSlot.jpegLen,
+        frameSlot.timestamps.sequence, frameSlot.timestamps.firstPacketMicros);
+    size_t bufLen = strlen(buf);
+
+    for (size_t i=0; i<currStreamingClients; i++) {
+      uint32_t writeStartMicros = micros();
+      streamingClients[i].write(kMjpegContentType, kMjpegContentTypeLen);
+      streamingClients[i].write(buf, bufLen);
+      streamingClients[i].write(frameSlot.jpeg, frameSlot.jpegLen);
+      streamingClients[i].write(kMjpegBoundary, kMjpegBoundaryLen);
+      streamingRateControl.reportClientDrain(frameSlot.jpegLen, micros() - writeStartMicros);
+    }
+    if (currStreamingClients > 0) {
+      frameSlot.timestamps.sendDoneMicros = micros();
+      latencyTracer.record(frameSlot.timestamps);
+    }
+  }
+
+  if (frameSlot.rawLen > 0) {
+    size_t currRawClients = pruneStreamingClients(rawStreamingClients, &numRawStreamingClients,
+        rawStreamingClientsSemaphore, "Raw");
+    ESP_LOGD("main", "Raw stream %i B", frameSlot.rawLen);
     char buf[32];
-    client->write(kMjpegContentType, kMjpegContentTypeLen);
-    sprintf(buf, "%d\r\n\r\n", jpegSize);
-    client->write(buf, strlen(buf));
-    client->write(webserverJpegBuffer, jpegSize);
-    client->write(kMjpegBoundary, kMjpegBoundaryLen);
+    sprintf(buf, "%d\r\n\r\n", frameSlot.rawLen);
+    size_t bufLen = strlen(buf);
+    for (size_t i=0; i<currRawClients; i++) {
+      rawStreamingClients[i].write(kRawContentType, kRawContentTypeLen);
+      rawStreamingClients[i].write(buf, bufLen);
+      rawStreamingClients[i].write(frameSlot.raw, frameSlot.rawLen);
+      rawStreamingClients[i].write(kMjpegBoundary, kMjpegBoundaryLen);
+    }
+  }
+
+  if (frameSlot.blobJsonLen > 0) {
+    size_t currBlobClients = pruneStreamingClients(blobStreamingClients, &numBlobStreamingClients,
+        blobStreamingClientsSemaphore, "Blobs");
+    for (size_t i=0; i<currBlobClients; i++) {
+      blobStreamingClients[i].write(frameSlot.blobJson, frameSlot.blobJsonLen);
+    }
   }
+  return true;
 }
 
+// Lepton interface is timing-sensitive and needs to be high priority, and on dual-core devices gets its own core
+// so encoding and network writes don't delay VoSPI readout
+const FramePipeline<kFrameSlots>::Config kFramePipelineConfig = {captureFrame, processFrame, encodeFrame, fanOutFrame,
+    nullptr, kCaptureCore, kProcessingCore};
+FramePipeline<kFrameSlots> framePipeline(kFramePipelineConfig);
+
 
 const char kJpgHeader[] = "HTTP/1.1 200 OK\r\n" \
                           "Content-disposition: inline; filename=capture.jpg\r\n" \
@@ -233,28 +603,117 @@ void handle_jpg(void) {
   WiFiClient client = server.client();
   if (!client.connected()) return;
 
-  size_t jpegSize;
-
-  while (xSemaphoreTake(bufferControlSemaphore, portMAX_DELAY) != pdTRUE);
-  uint8_t bufferReadIndex = (bufferWriteIndex + 1) % 2;
-  bufferReaders++;
-  assert(xSemaphoreGive(bufferControlSemaphore) == pdTRUE);
-
-  int encodeStatus = encodeJpeg(vospiBuf[bufferReadIndex], lepton.getFrameWidth(), lepton.getFrameHeight(),
-      jpegencPixelType, webserverJpegBuffer, sizeof(webserverJpegBuffer), &jpegSize);
-
-  bufferReaders--;
+  // the encode stage encodes the next frame at the best quality level
+  jpgState = kJpgRequested;
+  uint32_t startMillis = millis();
+  while (jpgState != kJpgDone) {
+    uint8_t requested = kJpgRequested;
+    if (millis() - startMillis > 1000 && jpgState.compare_exchange_strong(requested, kJpgIdle)) {
+      break;  // not taken by the encode stage, eg the camera is not streaming
+    }
+    delay(1);
+  }
 
-  if (encodeStatus == JPEGE_SUCCESS) {
-    ESP_LOGI("main", "JPG created %i B", jpegSize);
+  if (jpgState == kJpgDone && webserverJpegLen > 0) {
+    ESP_LOGI("main", "JPG created %i B", webserverJpegLen);
     client.write(kJpgHeader, kJpgHeaderLen);
-    client.write(webserverJpegBuffer, jpegSize);
+    client.write(webserverJpegBuffer, webserverJpegLen);
   } else {
     server.send(200, "text / plain", "Error");
   }
+  jpgState = kJpgIdle;
 }
 
 
+void handle_format(void) {
+  String format = server.arg("f");
+  bool queued;
+  if (format == "grey") {
+    queued = leptonController.requestVideoFormat(FlirLepton::kGrey14);
+  } else if (format == "rgb") {
+    queued = leptonController.requestVideoFormat(FlirLepton::kRgb888);
+  } else {
+    server.send(200, "text / plain", "Unknown format, use f=grey or f=rgb");
+    return;
+  }
+  server.send(200, "text / plain", queued ? "Format change queued" : "Too many pending changes");
+}
+
+void handle_status(void) {
+  LeptonController::Status status = leptonController.getStatus();
+  char json[384];
+  snprintf(json, sizeof(json), "{\"bootPhase\":%i,\"partNum\":\"%s\",\"videoMode\":%i,\"videoFormat\":%i,"
+      "\"width\":%i,\"height\":%i,\"framesRead\":%u,\"configGeneration\":%u,\"requestsPending\":%i,"
+      "\"spiClock\":%u,\"voSpi\":{\"packets\":%u,\"discardPackets\":%u,\"crcErrors\":%u,\"syncErrors\":%u,\"resyncs\":%u}}",
+      status.bootPhase, status.flirPartNum, status.videoMode, status.videoFormat, status.frameWidth, status.frameHeight,
+      status.framesRead, status.configGeneration, status.requestsPending, lepton.getSpiClock(),
+      status.voSpiStats.packets, status.voSpiStats.discardPackets, status.voSpiStats.crcErrors,
+      status.voSpiStats.syncErrors, status.voSpiStats.resyncs);
+  server.send(200, "application/json", json);
+}
+
+// Optionally sets the spotmeter ROI (x0, y0, x1, y1, inclusive), then reads spotmeter and AGC statistics from the
+// camera, which are computed on-camera so need no frame processing here
+void handle_spotmeter(void) {
+  if (server.hasArg("x0") && server.hasArg("y0") && server.hasArg("x1") && server.hasArg("y1")) {
+    FlirLepton::CciRoi roi = {(uint16_t)server.arg("x0").toInt(), (uint16_t)server.arg("y0").toInt(),
+        (uint16_t)server.arg("x1").toInt(), (uint16_t)server.arg("y1").toInt()};
+    if (!leptonController.requestSpotmeterRoi(roi)) {
+      server.send(200, "text / plain", "Too many pending changes");
+      return;
+    }
+  }
+  // statistics queued after the ROI change are read from a frame computed with the new ROI
+  uint32_t startGeneration = leptonController.getStatus().statisticsGeneration;
+  if (!leptonController.requestStatistics(LeptonController::kStatisticsSpotmeter | LeptonController::kStatisticsAgc)) {
+    server.send(200, "text / plain", "Too many pending changes");
+    return;
+  }
+  LeptonController::Status status = leptonController.getStatus();
+  uint32_t startMillis = millis();
+  while (status.statisticsGeneration == startGeneration && millis() - startMillis < 500) {  // applied between frames
+    delay(10);
+    status = leptonController.getStatus();
+  }
+  if (status.statisticsGeneration == startGeneration) {  // not applied, eg the camera is not streaming
+    server.send(200, "text / plain", "Statistics timed out");
+    return;
+  }
+
+  char json[256];
+  snprintf(json, sizeof(json), "{\"spotmeter\":{\"value\":%u,\"max\":%u,\"min\":%u,\"population\":%u},"
+      "\"agc\":{\"min\":%u,\"max\":%u,\"mean\":%u,\"numPixels\":%u},\"statisticsGeneration\":%u}",
+      status.spotmeter.value, status.spotmeter.max, status.spotmeter.min, status.spotmeter.population,
+      status.agcStatistics.min, status.agcStatistics.max, status.agcStatistics.mean, status.agcStatistics.numPixels,
+      status.statisticsGeneration);
+  server.send(200, "application/json", json);
+}
+
+void handle_latency(void) {
+  char json[512];
+  latencyTracer.exportJson(json, sizeof(json));
+  server.send(200, "application/json", json);
+}
+
+// Per-stage latency (us per frame), queue high-water marks, and frames dropped because every slot was in use
+void handle_pipeline(void) {
+  Pipeline& pipeline = framePipeline.getPipeline();
+  char json[512];
+  size_t len = snprintf(json, sizeof(json), "{\"overruns\":%u,\"stages\":{", framePipeline.getOverruns());
+  for (size_t i=0; i<pipeline.getNumStages() && len < sizeof(json); i++) {
+    const PipelineStageStats& stats = pipeline.getStageStats(i);
+    len += snprintf(json + len, sizeof(json) - len, "%s\"%s\":{\"count\":%u,\"mean\":%u,\"max\":%u}",
+        i > 0 ? "," : "", pipeline.getStageName(i), stats.count, stats.getMeanMicros(), stats.maxMicros);
+  }
+  if (len < sizeof(json)) {
+    snprintf(json + len, sizeof(json) - len, "},\"highWater\":{\"process\":%u,\"encode\":%u,\"fanOut\":%u}}",
+        framePipeline.getQueue(FramePipeline<kFrameSlots>::kToProcess).getHighWater(),
+        framePipeline.getQueue(FramePipeline<kFrameSlots>::kToEncode).getHighWater(),
+        framePipeline.getQueue(FramePipeline<kFrameSlots>::kToFanOut).getHighWater());
+  }
+  server.send(200, "application/json", json);
+}
+
 void handleNotFound() {
   server.send(200, "text / plain", "Unknown request");
 }
@@ -271,6 +730,15 @@ void Task_Server(void *pvParameters) {
 
   server.on("/mjpeg", HTTP_GET, handle_mjpeg_stream);
   server.on("/jpg", HTTP_GET, handle_jpg);
+  server.on("/raw", HTTP_GET, handle_raw_stream);
+  server.on("/blobs", HTTP_GET, handle_blobs_stream);
+  server.on("/trigger", HTTP_GET, handle_trigger);
+  server.on("/history", HTTP_GET, handle_history);
+  server.on("/format", HTTP_GET, handle_format);
+  server.on("/status", HTTP_GET, handle_status);
+  server.on("/latency", HTTP_GET, handle_latency);
+  server.on("/pipeline", HTTP_GET, handle_pipeline);
+  server.on("/spotmeter", HTTP_GET, handle_spotmeter);
   server.onNotFound(handleNotFound);
   server.begin();
   ESP_LOGI("main", "WiFi server started");
@@ -282,12 +750,37 @@ void Task_Server(void *pvParameters) {
 }
 
 
+// runs on the capture task around applying queued camera changes, which can reallocate the frame buffers,
+// so holds off frame buffer readers for the duration, and drops frames captured before the change
+void applyConfigHook(bool before, void* context) {
+  if (before) {
+    while (true) {
+      while (xSemaphoreTake(bufferControlSemaphore, portMAX_DELAY) != pdTRUE);
+      if (bufferReaders == 0) {
+        break;
+      }
+      assert(xSemaphoreGive(bufferControlSemaphore) == pdTRUE);
+      vTaskDelay(1);
+    }
+  } else {
+    if (lepton.getBytesPerPixel() == 3) {
+      jpegencPixelType = JPEGE_PIXEL_RGB888;
+      jpegencPixelBytes = 3;
+    } else {
+      jpegencPixelType = JPEGE_PIXEL_GRAYSCALE;
+      jpegencPixelBytes = 2;
+    }
+    bufferGeneration++;
+    assert(xSemaphoreGive(bufferControlSemaphore) == pdTRUE);
+  }
+}
+
 void Task_Lepton(void *pvParameters) {
   ESP_LOGI("main", "Lepton init");
   pinMode(kPinLepVsync, INPUT);
   assert(lepton.begin());
 
-  while (!lepton.isReady()) {
+  while (!leptonController.service()) {
     vTaskDelay(1);
   }
   ESP_LOGI("main", "Lepton ready");
@@ -298,51 +791,29 @@ void Task_Lepton(void *pvParameters) {
       lepton.getFlirSoftwareVerison()[0], lepton.getFlirSoftwareVerison()[1], lepton.getFlirSoftwareVerison()[2],
       lepton.getFlirSoftwareVerison()[3], lepton.getFlirSoftwareVerison()[4], lepton.getFlirSoftwareVerison()[5]);
 
-  assert(lepton.enableVsync());
+  assert(leptonController.requestVsync());
 
-  // optionally comment this and/or the next block out to not use AGC or colorization
+  // optionally comment this and/or the next line out to not use AGC or colorization
   // note, the JPEG encoding only uses the lowest 8 bits (assumes AGC on)
-  assert(lepton.setVideoMode(FlirLepton::kAgcHeq));
-
-  assert(lepton.setVideoFormat(FlirLepton::kRgb888));
-  jpegencPixelType = JPEGE_PIXEL_RGB888;
-  jpegencPixelBytes = 3;
-
-  bool bufferFlipRequested = false;  // allow queueing a buffer flip until data is overwritten
-  while (true) {
-    bool bufferOverwritten = false;
-    bool readResult = lepton.readVoSpi(sizeof(vospiBuf[0]), vospiBuf[bufferWriteIndex], &bufferOverwritten);
-
-    if (bufferOverwritten) {
-      bufferFlipRequested = false;
-    }
-
-    if (readResult) {
-      digitalWrite(kPinLedR, !digitalRead(kPinLedR));
-
-      bufferFlipRequested = true;
-    }
-
-    if (bufferFlipRequested) {
-      bool bufferFlipSuccess = false;
-      while (xSemaphoreTake(bufferControlSemaphore, portMAX_DELAY) != pdTRUE);
-      if (bufferReaders == 0) {
-        bufferWriteIndex = (bufferWriteIndex + 1) % 2;
-        frameCounter++;
-        bufferFlipSuccess = true;
-      }
-      assert(xSemaphoreGive(bufferControlSemaphore) == pdTRUE);
-
-      if (bufferFlipSuccess) {
-        if (streamingTask != nullptr) {
-          xTaskNotify(streamingTask, 0, eNoAction);
-        }
-        bufferFlipRequested = false;
-      }
+  assert(leptonController.requestVideoMode(FlirLepton::kAgcHeq));
+  assert(leptonController.requestVideoFormat(FlirLepton::kRgb888));
+  leptonController.service();
+  LeptonController::Status status = leptonController.getStatus();
+  assert(status.requestsFailed == 0);
+
+  if (kCalibrateSpi) {  // before the pipeline starts, so nothing else touches the buffer
+    FlirLepton::SpiCalibrationResult results[FlirLepton::kNumDefaultSpiCalibrationClocks];
+    uint32_t clock = lepton.calibrateSpi(lepton.getFrameBufferLen(), lepton.getFrameBuffer(kOverrunBuffer), 20, 5000,
+        FlirLepton::kDefaultSpiCalibrationClocks, FlirLepton::kNumDefaultSpiCalibrationClocks, results);
+    for (size_t i=0; i<FlirLepton::kNumDefaultSpiCalibrationClocks; i++) {
+      ESP_LOGI("main", "SPI %u Hz: %u frames, %u packets, %u CRC errors, %u sync errors", results[i].clock,
+          results[i].frames, results[i].packets, results[i].crcErrors, results[i].syncErrors);
     }
-
-    vTaskDelay(1);
+    ESP_LOGI("main", "SPI clock %u Hz%s", lepton.getSpiClock(), clock == 0 ? " (no reliable clock found)" : "");
   }
+
+  framePipeline.start();  // capture continues on the pipeline's capture stage
+  vTaskDelete(NULL);
 }
 
 
@@ -359,17 +830,47 @@ void setup() {
   i2c.begin(kPinI2cSda, kPinI2cScl, 400000);
 
   // initialize shared data structures
+  // frame buffers are touched by readout, filtering and every encoder so are kept in internal RAM,
+  // while the JPEG buffers are less bandwidth-critical and can go in PSRAM
+  assert(lepton.setFrameBuffers(&bufferAllocator, kFrameSlots + 1, LeptonAlloc::kInternal));
+  for (FrameSlot& frameSlot : frameSlots) {
+    frameSlot.jpeg = (uint8_t*)bufferAllocator.allocate(kJpegBufferSize, LeptonAlloc::kPsram);
+    frameSlot.raw = (uint8_t*)bufferAllocator.allocate(kRawBufferSize, LeptonAlloc::kPsram);
+    assert(frameSlot.jpeg != nullptr && frameSlot.raw != nullptr);
+  }
+  webserverJpegBuffer = (uint8_t*)bufferAllocator.allocate(kJpegBufferSize, LeptonAlloc::kPsram);
+  assert(webserverJpegBuffer != nullptr);
+  if (psramFound()) {
+    uint8_t* historyStorage = (uint8_t*)ps_malloc(kHistoryBudget);
+    uint16_t* historyReference = (uint16_t*)ps_malloc(160 * 120 * sizeof(uint16_t));
+    if (historyStorage != nullptr && historyReference != nullptr) {
+      history = new FrameHistory(160, 120, historyStorage, kHistoryBudget, historyReference, kHistoryMaxRecordLen);
+    }
+  }
+  if (history == nullptr) {
+    ESP_LOGW("main", "History unavailable, requires PSRAM");
+  }
   bufferControlSemaphore = xSemaphoreCreateMutexStatic(&bufferControlSemaphoreBuf);
   assert(bufferControlSemaphore != nullptr);
   streamingClientsSemaphore = xSemaphoreCreateMutexStatic(&streamingClientsSemaphoreBuf);
   assert(streamingClientsSemaphore != nullptr);
+  rawStreamingClientsSemaphore = xSemaphoreCreateMutexStatic(&rawStreamingClientsSemaphoreBuf);
+  assert(rawStreamingClientsSemaphore != nullptr);
+  blobStreamingClientsSemaphore = xSemaphoreCreateMutexStatic(&blobStreamingClientsSemaphoreBuf);
+  assert(blobStreamingClientsSemaphore != nullptr);
+  blobTracker.setThreshold(kBlobThreshold);
+  leptonController.setConfigHook(applyConfigHook, nullptr);
+
+  // boots the camera, then hands capture over to framePipeline
+  xTaskCreatePinnedToCore(Task_Lepton, "Task_Lepton", 4096, NULL, 16, NULL, kCaptureCore);
+  xTaskCreatePinnedToCore(Task_Server, "Task_Server", 4096, NULL, 1, NULL, kProcessingCore);
+}
 
-  // Lepton interface is timing-sensitive and needs to be high priority
-  xTaskCreatePinnedToCore(Task_Lepton, "Task_Lepton", 4096, NULL, 16, NULL, ARDUINO_RUNNING_CORE);
-  xTaskCreatePinnedToCore(Task_MjpegStream, "Task_MjpegStream", 4096, NULL, 1, &streamingTask, ARDUINO_RUNNING_CORE);
-  xTaskCreatePinnedToCore(Task_Server, "Task_Server", 4096, NULL, 1, NULL, ARDUINO_RUNNING_CORE);
+void printDeferredLog(char level, const char* message, void* context) {
+  Serial.printf("LEP %c %s\n", level, message);
 }
 
-void loop() {
-  vTaskDelay(1000);
+void loop() {  // lowest priority, formats deferred log messages from the capture path
+  LeptonLog::deferredLog.drain(printDeferredLog, nullptr);
+  vTaskDelay(100);
 }
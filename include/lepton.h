@@ -4,6 +4,7 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include <SPI.h>
+#include "lepton_alloc.h"
 
 
 class FlirLepton {
@@ -50,9 +51,56 @@ public:
   // Does not touch Wire and Spi.
   void end();
 
-  // Returns true if the device has booted and is ready for operation.
+  // Powers down the camera by asserting PWRDN (and holding RESET), returning false if PWRDN is NC.
+  // begin() powers it back up with a reset and boot, after which settings (video mode, format, Vsync, ROIs) are at
+  // their defaults and must be re-applied. See LeptonDutyCycle in lepton_dutycycle.h for duty-cycled capture.
+  bool powerDown();
+  bool isPoweredDown() {
+    return poweredDown_;
+  }
+
+  // Returns true if the device has booted and is ready for operation, false while powered down.
+  // Non-blocking (other than individual I2C transactions), steps through the boot phases as they complete.
   bool isReady();
 
+  // Startup policy for isReady(), takes effect on the next isReady() call
+  struct BootPolicy {
+    uint16_t minI2cMillis;  // minimum time after reset before polling I2C, the Lepton Software IDD specifies 950
+    uint16_t pollIntervalMillis;  // minimum time between status polls while booting
+    bool readMetadata;  // read the serial, part number, and software version
+    bool cacheMetadata;  // keep metadata across begin() resets instead of re-reading it
+    bool waitForFfc;  // wait for the initial flat-field correction to complete before reporting ready
+  };
+  static const BootPolicy kDefaultBootPolicy;
+  void setBootPolicy(const BootPolicy& policy) {
+    bootPolicy_ = policy;
+  }
+  const BootPolicy& getBootPolicy() {
+    return bootPolicy_;
+  }
+
+  enum BootPhase {
+    kBootWaitI2c,  // waiting for the I2C interface to come up
+    kBootWaitBooted,  // waiting for the status register to report booted
+    kBootMetadata,  // reading metadata
+    kBootWaitFfc,  // waiting for the initial FFC
+    kBootReady,
+  };
+  BootPhase getBootPhase() {
+    return bootPhase_;
+  }
+
+  // Time since reset (from begin()) at which each boot phase completed, in ms, valid once that phase completes
+  struct BootTimings {
+    uint32_t i2cMillis;
+    uint32_t bootedMillis;
+    uint32_t metadataMillis;
+    uint32_t readyMillis;
+  };
+  const BootTimings& getBootTimings() {
+    return bootTimings_;
+  }
+
   /** Utility functions
   */
   // Enable the VSYNC output on GPIO
@@ -66,6 +114,10 @@ public:
   };
   // Sets the video mode, managing both the AGC and TLinear registers
   bool setVideoMode(VideoMode mode);
+  // Returns the last set video mode
+  VideoMode getVideoMode() {
+    return videoMode_;
+  }
 
   enum VideoFormat {
     kGrey14,
@@ -82,9 +134,37 @@ public:
     kLutRain,
     kLutUser,
   };
-  // Sets the video format, with an optional colorization LUT (ignored for non-RGB cases)
+  // Sets the video format, with an optional colorization LUT (ignored for non-RGB cases).
+  // Also returns false if managed frame buffers (see setFrameBuffers) could not be reallocated for the new format.
   bool setVideoFormat(VideoFormat format, PColorLut lut = kLutFusion);
 
+  /** Measurement operations
+   * On-camera statistics over CCI, to monitor a region without transferring or scanning frames.
+   * These block on I2C, so when streaming they should be run between frames (see LeptonController).
+   */
+  // Region in pixel coordinates, inclusive of the end row and column
+  struct CciRoi {
+    uint16_t startCol, startRow;
+    uint16_t endCol, endRow;
+  };
+  // Spotmeter statistics over its ROI, in kelvin * 100 (requires a radiometric Lepton, with T-linear enabled)
+  struct SpotmeterValue {
+    uint16_t value;  // mean
+    uint16_t max, min;
+    uint16_t population;  // pixels in the ROI
+  };
+  // AGC histogram statistics over the AGC ROI, in pre-AGC 14-bit counts (requires AGC enabled)
+  struct AgcStatistics {
+    uint16_t min, max, mean;
+    uint16_t numPixels;
+  };
+  bool setSpotmeterRoi(const CciRoi& roi);
+  bool getSpotmeterRoi(CciRoi* roiOut);
+  bool getSpotmeter(SpotmeterValue* valueOut);
+  bool setAgcRoi(const CciRoi& roi);
+  bool getAgcRoi(CciRoi* roiOut);
+  bool getAgcStatistics(AgcStatistics* statisticsOut);
+
   /** SPI Operations
    * TODO: move into a separate class to allow more optimization
    */
@@ -94,6 +174,94 @@ public:
   // bufferWrittenOut is set to true if the buffer has been overwritten, even partially.
   bool readVoSpi(size_t bufferLen, uint8_t* buffer, bool* bufferWrittenOut = nullptr);
 
+  static const uint32_t kDefaultSpiClock = 20000000;  // 20MHz max for VoSPI
+  // Sets the VoSPI clock and mode (the Lepton uses mode 3, CPOL=1, CPHA=1), taking effect on the next readout.
+  // Lower clocks can help with marginal links (eg, long cables), see calibrateSpi.
+  void setSpiSettings(uint32_t clock, uint8_t dataMode = SPI_MODE3);
+  uint32_t getSpiClock() {
+    return spiClock_;
+  }
+
+  // VoSPI link statistics, accumulated across all readVoSpi variants
+  struct VoSpiStats {
+    uint32_t frames;  // frames read
+    uint32_t packets;  // in-sequence video packets
+    uint32_t discardPackets;
+    uint32_t crcErrors;  // video packets failing CRC, only checked if enabled with setVoSpiCrcCheck
+    uint32_t syncErrors;  // unexpected packet or segment numbers, each of which starts a resync
+    uint32_t resyncs;  // including those requested by configuration changes
+  };
+  const VoSpiStats& getVoSpiStats() {
+    return voSpiStats_;
+  }
+  void resetVoSpiStats() {
+    voSpiStats_ = {0, 0, 0, 0, 0, 0};
+  }
+  // Enables checking the CRC of each video packet. This adds some CPU time to the readout loop, and frames with CRC
+  // errors are still returned, so this is mainly for link diagnostics.
+  void setVoSpiCrcCheck(bool enable) {
+    voSpiCrcCheck_ = enable;
+  }
+
+  // Result of a calibrateSpi trial at one clock
+  struct SpiCalibrationResult {
+    uint32_t clock;
+    uint32_t frames, packets;
+    uint32_t crcErrors, syncErrors;
+    uint32_t elapsedMillis;
+    bool reliable;  // read the requested frames without CRC or sync errors
+  };
+  // Clocks tried by calibrateSpi when none are given, fastest first, exactly reachable from an 80MHz APB clock
+  static const uint32_t kDefaultSpiCalibrationClocks[];
+  static const size_t kNumDefaultSpiCalibrationClocks;
+  // Tries each clock, reading (into buffer) until sampleFrames frames are read or timeoutMillis passes, with CRC
+  // checking enabled, then selects the fastest reliable clock. Results for each clock are written to resultsOut
+  // (numClocks entries) if not null. Returns the selected clock, or 0 (restoring the previous clock) if none were
+  // reliable. Blocks for up to numClocks * timeoutMillis, and must be called once isReady().
+  uint32_t calibrateSpi(size_t bufferLen, uint8_t* buffer, size_t sampleFrames = 20, uint32_t timeoutMillis = 5000,
+      const uint32_t* clocks = kDefaultSpiCalibrationClocks, size_t numClocks = kNumDefaultSpiCalibrationClocks,
+      SpiCalibrationResult* resultsOut = nullptr);
+
+  // Metadata of the last frame read by any of the readVoSpi variants
+  struct FrameInfo {
+    uint32_t sequence;  // increments with each frame read, starting from 1, 0 if no frame has been read
+    uint32_t firstPacketMicros;  // micros() at the start of readout
+    uint32_t lastPacketMicros;  // micros() at the end of readout
+  };
+  const FrameInfo& getFrameInfo() {
+    return frameInfo_;
+  }
+
+  // Region-of-interest window for readVoSpiRoi, in full-frame pixel coordinates.
+  // decimation keeps every Nth row and column of the window, and must be 1, 2, or 4.
+  struct VoSpiRoi {
+    uint8_t x, y;
+    uint8_t width, height;
+    uint8_t decimation;
+  };
+  // Returns the output buffer size in bytes needed for readVoSpiRoi with the current video parameters
+  size_t getRoiBufferLen(const VoSpiRoi& roi) {
+    return (size_t)((roi.width + roi.decimation - 1) / roi.decimation) *
+        ((roi.height + roi.decimation - 1) / roi.decimation) * bytesPerPixel_;
+  }
+  // Like readVoSpi, but only stores pixels inside the ROI, cropped (and optionally decimated) and written
+  // contiguously row-major into buffer. Every packet is still clocked out to maintain sync.
+  // Assumes packets do not straddle rows, as is the case for Lepton 2.x and 3.x devices.
+  bool readVoSpiRoi(const VoSpiRoi& roi, size_t bufferLen, uint8_t* buffer, bool* bufferWrittenOut = nullptr);
+
+  // Receives VoSPI video data packet-by-packet as it is read out, to allow processing rows without a frame buffer
+  class VoSpiLineSink {
+  public:
+    // Called for each video packet, with pixels (in the camera's byte order) starting at pixel (x, row).
+    // May be called again for the same rows if the camera repeats a segment.
+    virtual void onPacket(size_t row, size_t x, const uint8_t* data, size_t pixels, size_t bytesPerPixel) = 0;
+    // Called after the last packet of a frame, or with valid = false if a frame in progress was abandoned
+    virtual void onFrameEnd(bool valid) = 0;
+  };
+  // Like readVoSpi, but passes each packet to sink as it is read instead of storing a frame.
+  // The sink is called with SPI active, so it must keep up with VoSPI timing.
+  bool readVoSpiLines(VoSpiLineSink& sink);
+
   /** Metadata operations
   */
  // returns the FLIR serial number from the device, valid only after isReady()
@@ -127,16 +295,52 @@ public:
   }
 
   // sets the video parameters, can be useful if using a different device or configuration this library doesn't support
-  void setVideoParameters(uint8_t bytesPerPixel, uint8_t frameWidth, uint8_t frameHeight,
-      size_t videoPacketDataLen, size_t packetsPerSegment, size_t segmentsPerFrame) {
-    bytesPerPixel_ = bytesPerPixel;
-    frameWidth_ = frameWidth;
-    frameHeight_ = frameHeight;
-    videoPacketDataLen_ = videoPacketDataLen;
-    packetsPerSegment_ = packetsPerSegment;
-    segmentsPerFrame_ = segmentsPerFrame;
+  // returns false (leaving parameters unchanged) if videoPacketDataLen exceeds kMaxVideoPacketDataLen
+  bool setVideoParameters(uint8_t bytesPerPixel, uint8_t frameWidth, uint8_t frameHeight,
+      size_t videoPacketDataLen, size_t packetsPerSegment, size_t segmentsPerFrame);
+
+  static const size_t kMaxVideoPacketDataLen = 240;  // RGB888 packets, bounds the packet scratch buffer
+
+  // returns the size in bytes of a full frame with the current video parameters
+  size_t getFrameBufferLen() {
+    return (size_t)frameWidth_ * frameHeight_ * bytesPerPixel_;
+  }
+
+  /** Managed frame buffers
+   * Optionally, count frame buffers can be allocated from an allocator, sized for the current video parameters
+   * and reallocated when they change (setVideoFormat, setVideoParameters). Buffers must not be in use across
+   * those calls. Pass a null allocator to release the buffers.
+   */
+  static const size_t kMaxFrameBuffers = 4;
+  // returns false if count exceeds kMaxFrameBuffers or allocation failed, in which case no buffers are held
+  // (getFrameBuffer returns nullptr) until allocation is retried by the next video parameter change
+  bool setFrameBuffers(FrameAllocator* allocator, size_t count, LeptonAlloc::Placement placement = LeptonAlloc::kAny);
+  // returns the frame buffer at index, of getFrameBufferLen() bytes, or nullptr if not allocated
+  uint8_t* getFrameBuffer(size_t index) {
+    return index < numFrameBuffers_ ? frameBuffers_[index] : nullptr;
   }
 
+  // Result of a VoSPI frame readout
+  enum VoSpiStatus {
+    kVoSpiFrame,  // frame read
+    kVoSpiNoFrame,  // no frame in progress (discard packet), or in resync
+    kVoSpiBadPacketNum,  // lost sync, unexpected packet number
+    kVoSpiBadSegment,  // lost sync, unexpected segment number
+  };
+
+  // Runtime video geometry for readVoSpiPackets, backed by the video parameters of a FlirLepton instance.
+  // Compile-time versions are in lepton_fixed.h.
+  struct RuntimeVoSpiGeometry {
+    static const size_t kScratchLen = kMaxVideoPacketDataLen;
+    const FlirLepton& lepton;
+
+    size_t bytesPerPixel() const { return lepton.bytesPerPixel_; }
+    size_t frameWidth() const { return lepton.frameWidth_; }
+    size_t packetDataLen() const { return lepton.videoPacketDataLen_; }
+    size_t packetsPerSegment() const { return lepton.packetsPerSegment_; }
+    size_t segmentsPerFrame() const { return lepton.segmentsPerFrame_; }
+  };
+
 protected:
   /** I2C Operations 
    */
@@ -159,16 +363,51 @@ protected:
   bool readReg16(uint16_t addr, uint16_t* dataOut);
   // Reads len sequential bytes from a register, placing the results in dataOut, returning success
   bool readReg(uint16_t addr, size_t len, uint8_t* dataOut);
+  // Returns whether the device acknowledges its I2C address, without logging failures
+  bool probeI2c();
+
+  // Reads the serial, part number, and software version, returning success
+  bool readMetadata();
+  // Returns true if a boot status poll is due per the poll interval, updating the last poll time
+  bool bootPollDue();
+
+  /** VoSPI Operations
+   */
+  // Handles resync timing, returning true if VoSPI can be read out
+  bool startVoSpi();
+
+  // Reads out a VoSPI frame, either into a full frame buffer (roi and sink null), cropped to a ROI, or to a sink.
+  // Geometry provides the video parameters, and may be a compile-time constant to allow the packet loop to be
+  // specialized. Defined at the end of this file, since it is also instantiated by FlirLeptonFixed.
+  template <typename Geometry>
+  VoSpiStatus readVoSpiPackets(const Geometry& geometry, uint8_t* buffer, const VoSpiRoi* roi, VoSpiLineSink* sink,
+      bool* bufferWrittenOut);
+
+  // Logs the result of readVoSpiPackets and requests resync on errors, returning whether a frame was read
+  bool finishVoSpi(VoSpiStatus status);
+
+  // CRC-16 used by VoSPI packets (polynomial 0x1021), continuing from crc
+  static uint16_t voSpiCrc16(const uint8_t* data, size_t len, uint16_t crc);
+
+  // (re)allocates managed frame buffers if their size changed, returning false on allocation failure
+  bool allocateFrameBuffers();
+  void releaseFrameBuffers();
 
   /** State and configuration variables
    */
   TwoWire* wire_;
   SPIClass* spi_;
-  // SPISettings spiSettings_;  // TODO kDefaultSpiSettings seems to be unavailable until after construction so this can't be init'd
+  uint32_t spiClock_ = kDefaultSpiClock;
+  uint8_t spiDataMode_ = SPI_MODE3;
+  SPISettings spiSettings_ = SPISettings(kDefaultSpiClock, MSBFIRST, SPI_MODE3);  // built from the above
   int csPin_, resetPin_, pwrdnPin_;
 
-  int resetMillis_;  // millis() at which the device exited reset
-  bool i2cReady_ = false;  // if sufficient millis() has elapsed since reset for I2C to be up
+  uint32_t resetMillis_ = 0;  // millis() at which the device exited reset
+  bool poweredDown_ = false;
+  uint32_t lastBootPollMillis_ = 0;  // millis() of the last status poll while booting
+  BootPolicy bootPolicy_ = kDefaultBootPolicy;
+  BootPhase bootPhase_ = kBootWaitI2c;
+  BootTimings bootTimings_ = {0, 0, 0, 0};
 
   uint64_t flirSerial_ = 0;
   char flirPartNum_[33] = {0};
@@ -187,12 +426,155 @@ protected:
   size_t packetsPerSegment_ = 60;  // Lepton 3.5, telemetry disabled
   size_t segmentsPerFrame_ = 4;
 
+  // managed frame buffers, see setFrameBuffers
+  FrameAllocator* frameAllocator_ = nullptr;
+  LeptonAlloc::Placement frameBufferPlacement_ = LeptonAlloc::kAny;
+  size_t numFrameBuffers_ = 0;
+  size_t frameBufferLen_ = 0;  // size the buffers were allocated at
+  uint8_t* frameBuffers_[kMaxFrameBuffers] = {nullptr};
+
+  FrameInfo frameInfo_ = {0, 0, 0};
+  uint32_t voSpiStartMicros_ = 0, voSpiEndMicros_ = 0;  // of the last readVoSpiPackets, committed to frameInfo_ on success
+
+  // details of the last VoSPI error, for logging
+  uint16_t voSpiErrorGot_ = 0, voSpiErrorExpected_ = 0;
+  uint8_t voSpiErrorSegment_ = 0;
+
+  VoSpiStats voSpiStats_ = {0, 0, 0, 0, 0, 0};
+  bool voSpiCrcCheck_ = false;
+
   bool resyncRequested_ = false;
   int resyncStartMillis_ = 0;  // millis() at which resync ends
   bool inResync_ = false;
 
   const uint16_t kResyncMillis = 185;
-  static const SPISettings kDefaultSpiSettings;
 };
 
+template <typename Geometry>
+FlirLepton::VoSpiStatus FlirLepton::readVoSpiPackets(const Geometry& geometry, uint8_t* buffer, const VoSpiRoi* roi,
+    VoSpiLineSink* sink, bool* bufferWrittenOut) {
+  uint8_t scratchBuf[Geometry::kScratchLen];  // discarded packets, also used as the staging buffer for ROI and sink packets
+
+  // ROI geometry, only used if roi is not null
+  const size_t rowBytes = geometry.frameWidth() * geometry.bytesPerPixel();
+  const size_t packetPixels = geometry.packetDataLen() / geometry.bytesPerPixel();
+  size_t roiOutWidth = 0;
+  if (roi != nullptr) {
+    roiOutWidth = (roi->width + roi->decimation - 1) / roi->decimation;
+  }
+
+  // counted locally and accumulated into voSpiStats_ at the end, to keep the packet loop lean
+  uint32_t packets = 0, discardPackets = 0, crcErrors = 0;
+  const bool crcCheck = voSpiCrcCheck_;
+
+  voSpiStartMicros_ = micros();  // a frame (if any) starts with the first packet, so this is its timestamp
+  spi_->beginTransaction(spiSettings_);
+  digitalWrite(csPin_, LOW);
+
+  VoSpiStatus status = kVoSpiFrame;
+  for (uint8_t segment=1; segment <= geometry.segmentsPerFrame() && status == kVoSpiFrame; segment++) {
+    bool discardSegment = false;
+    for (size_t packet=0; packet < geometry.packetsPerSegment(); packet++) {
+      size_t packetOffset = ((segment - 1) * geometry.packetDataLen() * geometry.packetsPerSegment()) +
+          (packet * geometry.packetDataLen());
+
+      uint8_t header[4];
+      spi_->transfer(header, 4);
+      uint16_t id = ((uint16_t)header[0] << 8) | header[1];
+
+      const uint8_t* packetData = scratchBuf;  // where the packet data was read into, for the CRC check
+      if (((id >> 8) & 0x0f) == 0x0f) {  // discard packet
+        spi_->transfer(scratchBuf, geometry.packetDataLen());  // send the clocks, ignore the data, don't overwrite the buffer
+        discardPackets++;
+        if (packet == 0 && segment == 1) {  // if no frame in progress, return
+          status = kVoSpiNoFrame;
+          break;
+        } else {  // otherwise just ignore it - may show up in the middle of a transmission
+          packet--;
+        }
+        continue;
+      } else if (sink != nullptr) {
+        spi_->transfer(scratchBuf, geometry.packetDataLen());
+        if ((id & 0xfff) == packet) {  // only pass on in-sequence packets, errors are handled below
+          sink->onPacket(packetOffset / rowBytes, (packetOffset % rowBytes) / geometry.bytesPerPixel(),
+              scratchBuf, packetPixels, geometry.bytesPerPixel());
+        }
+      } else if (roi == nullptr) {
+        spi_->transfer(buffer + packetOffset, geometry.packetDataLen());  // read into the buffer
+        packetData = buffer + packetOffset;
+        if (bufferWrittenOut != nullptr) {
+          *bufferWrittenOut = true;
+        }
+      } else {  // read into staging, then copy the in-ROI pixels out
+        spi_->transfer(scratchBuf, geometry.packetDataLen());
+        size_t row = packetOffset / rowBytes;
+        size_t packetX = (packetOffset % rowBytes) / geometry.bytesPerPixel();
+        if (row >= roi->y && row < (size_t)roi->y + roi->height && (row - roi->y) % roi->decimation == 0) {
+          size_t startX = packetX > roi->x ? packetX : roi->x;
+          startX += (roi->decimation - (startX - roi->x) % roi->decimation) % roi->decimation;  // align to decimation
+          size_t endX = packetX + packetPixels;
+          if (endX > (size_t)roi->x + roi->width) {
+            endX = roi->x + roi->width;
+          }
+          uint8_t* outRowPtr = buffer + ((row - roi->y) / roi->decimation) * roiOutWidth * geometry.bytesPerPixel();
+          for (size_t x=startX; x < endX; x += roi->decimation) {
+            memcpy(outRowPtr + ((x - roi->x) / roi->decimation) * geometry.bytesPerPixel(),
+                scratchBuf + (x - packetX) * geometry.bytesPerPixel(), geometry.bytesPerPixel());
+          }
+          if (startX < endX && bufferWrittenOut != nullptr) {
+            *bufferWrittenOut = true;
+          }
+        }  // otherwise the packet is dropped, but still checked below to maintain sync
+      }
+
+      if (crcCheck) {  // over the whole packet, with the ID's top nibble and the CRC field zeroed
+        uint8_t crcHeader[4] = {(uint8_t)(header[0] & 0x0f), header[1], 0, 0};
+        uint16_t crc = voSpiCrc16(crcHeader, 4, 0);
+        crc = voSpiCrc16(packetData, geometry.packetDataLen(), crc);
+        if (crc != (((uint16_t)header[2] << 8) | header[3])) {
+          crcErrors++;
+        }
+      }
+
+      uint16_t packetNum = id & 0xfff;
+      uint8_t ttt = (id >> 12) & 0x7;
+
+      if (packetNum != packet) {
+        voSpiErrorGot_ = packetNum;
+        voSpiErrorExpected_ = packet;
+        voSpiErrorSegment_ = segment;
+        status = kVoSpiBadPacketNum;
+        break;
+      }
+      packets++;
+      if (geometry.segmentsPerFrame() > 1 && packetNum == 20) {  // segment number only valid for Lepton 3
+        if (ttt == 0) {
+          discardSegment = true;
+        } else if (ttt != segment) {
+          voSpiErrorGot_ = ttt;
+          voSpiErrorExpected_ = segment;
+          voSpiErrorSegment_ = segment;
+          status = kVoSpiBadSegment;
+          break;
+        }
+      }
+    }
+    if (discardSegment) {
+      segment--;
+    }
+  }
+
+  digitalWrite(csPin_, HIGH);
+  spi_->endTransaction();
+  voSpiEndMicros_ = micros();
+  voSpiStats_.packets += packets;
+  voSpiStats_.discardPackets += discardPackets;
+  voSpiStats_.crcErrors += crcErrors;
+
+  if (sink != nullptr && status != kVoSpiNoFrame) {
+    sink->onFrameEnd(status == kVoSpiFrame);
+  }
+  return status;
+}
+
 #endif
@@ -0,0 +1,104 @@
+#ifndef __LEPTON_ALLOC_H__
+#define __LEPTON_ALLOC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+namespace LeptonAlloc {
+  // Memory placement hints, only meaningful on platforms with multiple memory types (eg, ESP32)
+  enum Placement {
+    kAny,  // default heap
+    kInternal,  // internal SRAM only, fastest for buffers touched per-pixel
+    kDma,  // DMA-capable internal SRAM only, eg for SPI transfer buffers
+    kPsram,  // external PSRAM if available, otherwise falls back to internal SRAM, for large buffers
+  };
+
+  const size_t kAlignment = 4;
+
+  inline size_t alignUp(size_t len) {
+    return (len + kAlignment - 1) & ~(kAlignment - 1);
+  }
+}
+
+// Allocator interface for frame, staging, and encode buffers.
+// Buffers are allocated at setup or on format changes, not per-frame, so implementations need not be thread-safe.
+class FrameAllocator {
+public:
+  // Returns a kAlignment-aligned buffer of at least len bytes, or nullptr if unavailable
+  virtual void* allocate(size_t len, LeptonAlloc::Placement placement = LeptonAlloc::kAny) = 0;
+  // Releases a buffer from allocate, nullptr is ignored
+  virtual void release(void* ptr) = 0;
+
+  // Bytes currently allocated, and the high-water mark, including any per-allocation overhead
+  size_t getUsed() { return used_; }
+  size_t getPeak() { return peak_; }
+
+protected:
+  void noteAllocated(size_t len) {
+    used_ += len;
+    if (used_ > peak_) {
+      peak_ = used_;
+    }
+  }
+  void noteReleased(size_t len) {
+    used_ -= len;
+  }
+
+  size_t used_ = 0, peak_ = 0;
+};
+
+// Allocates from the system heap, using heap_caps_malloc to honor placement on ESP32
+class HeapAllocator : public FrameAllocator {
+public:
+  void* allocate(size_t len, LeptonAlloc::Placement placement = LeptonAlloc::kAny) override;
+  void release(void* ptr) override;
+};
+
+// Bump allocator over a caller-provided region (which determines placement, so hints are ignored).
+// Released space is reclaimed once everything allocated after it has also been released (eg, releasing and
+// reallocating all frame buffers on a format change), or on reset(). Each allocation has an 8 byte header.
+class ArenaAllocator : public FrameAllocator {
+public:
+  ArenaAllocator(uint8_t* region, size_t regionLen);
+
+  void* allocate(size_t len, LeptonAlloc::Placement placement = LeptonAlloc::kAny) override;
+  void release(void* ptr) override;
+  // Releases all allocations
+  void reset();
+
+  size_t getFree() { return regionLen_ - top_; }
+
+protected:
+  struct BlockHeader;
+  static const uint32_t kNoBlock = 0xffffffff;
+
+  uint8_t* region_;
+  size_t regionLen_;
+  size_t top_ = 0;  // offset of the first free byte
+  uint32_t topBlock_ = kNoBlock;  // offset of the header of the last allocation
+};
+
+// Fixed-size block allocator over a caller-provided region (which determines placement, so hints are ignored),
+// with O(1) allocate and release in any order. Allocations larger than the block size fail.
+class PoolAllocator : public FrameAllocator {
+public:
+  // region should be aligned to LeptonAlloc::kAlignment, blockLen is rounded up to the alignment
+  PoolAllocator(uint8_t* region, size_t regionLen, size_t blockLen);
+
+  void* allocate(size_t len, LeptonAlloc::Placement placement = LeptonAlloc::kAny) override;
+  void release(void* ptr) override;
+
+  size_t getBlockLen() { return blockLen_; }
+  size_t getNumBlocks() { return numBlocks_; }
+  size_t getFreeBlocks() { return freeBlocks_; }
+
+protected:
+  uint8_t* region_;
+  size_t blockLen_;
+  size_t numBlocks_;
+  size_t freeBlocks_;
+  void* freeList_ = nullptr;  // each free block stores the pointer to the next free block
+};
+
+#endif
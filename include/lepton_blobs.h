@@ -0,0 +1,96 @@
+#ifndef __LEPTON_BLOBS_H__
+#define __LEPTON_BLOBS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+// Hot-spot analytics for 16-bit frames as produced by FlirLepton::readVoSpi: thresholding, single-pass
+// run-based connected-component labelling (8-connected), per-blob statistics, and tracking IDs across frames.
+// All memory is fixed-size within the object, and time is linear in the number of pixels, so this can run in the
+// capture loop. Frames are up to kMaxWidth pixels wide.
+class BlobTracker {
+public:
+  static const size_t kMaxWidth = 160;
+  static const size_t kMaxBlobs = 16;  // largest blobs reported per frame
+  static const size_t kMaxLabels = 255;  // provisional labels per frame, runs beyond this are ignored
+
+  struct Blob {
+    uint16_t id;  // tracking ID, stable across frames while the blob is matched, never 0
+    uint32_t area;  // pixels
+    uint16_t centroidX, centroidY;  // in 1/16 pixel
+    uint16_t maxValue;  // eg, hottest pixel in TLinear units (0.01 K)
+    uint8_t maxX, maxY;  // location of the hottest pixel
+    uint8_t minX, minY, maxXBound, maxYBound;  // bounding box, inclusive
+    uint16_t age;  // frames this blob has been tracked for
+  };
+
+  BlobTracker(size_t width, size_t height);
+
+  // Sets the pixel threshold (pixels >= threshold are hot), and minimum blob area reported
+  void setThreshold(uint16_t threshold) {
+    threshold_ = threshold;
+  }
+  void setMinArea(uint16_t minArea) {
+    minArea_ = minArea;
+  }
+
+  // Sets the maximum centroid distance (in pixels) for a blob to keep its tracking ID between frames
+  void setMaxTrackDistance(uint16_t maxDistance) {
+    maxTrackDistance16_ = maxDistance * 16;
+  }
+
+  // Labels blobs in a frame and updates tracking. Returns the number of blobs found (up to kMaxBlobs).
+  size_t process(const uint8_t* frame);
+
+  // Returns the blobs from the last frame, largest first
+  size_t getNumBlobs() {
+    return numBlobs_;
+  }
+  const Blob& getBlob(size_t index) {
+    return blobs_[index];
+  }
+
+  // Returns whether labels overflowed in the last frame, in which case some pixels were not labelled
+  bool getTruncated() {
+    return truncated_;
+  }
+
+protected:
+  struct Run {
+    uint16_t start, end;  // [start, end) columns
+    uint8_t label;
+  };
+
+  struct LabelStats {
+    uint32_t area;
+    uint32_t sumX, sumY;
+    uint16_t maxValue;
+    uint8_t maxX, maxY;
+    uint8_t minX, minY, maxXBound, maxYBound;
+  };
+
+  uint8_t findRoot(uint8_t label);
+  // Merges the sets of two labels, returning the root
+  uint8_t unite(uint8_t a, uint8_t b);
+  // Collects the largest root labels into blobs_ and assigns tracking IDs
+  void collectBlobs();
+
+  size_t width_, height_;
+  uint16_t threshold_ = 30315;  // 30 C in TLinear
+  uint16_t minArea_ = 4;
+  uint32_t maxTrackDistance16_ = 16 * 16;
+
+  uint8_t parent_[kMaxLabels + 1];  // label 0 is unused
+  LabelStats stats_[kMaxLabels + 1];
+  size_t numLabels_ = 0;
+  bool truncated_ = false;
+
+  Run runs_[2][kMaxWidth / 2 + 1];  // previous and current row
+
+  Blob blobs_[kMaxBlobs];
+  size_t numBlobs_ = 0;
+  uint16_t nextId_ = 1;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef __LEPTON_CODEC_H__
+#define __LEPTON_CODEC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+// Lossless codec for 16-bit frames as produced by FlirLepton::readVoSpi (each pixel a big-endian 16-bit word).
+// Keyframes are predicted spatially (LOCO-I median edge detector), other frames temporally from the previous
+// frame, with residuals adaptive-Rice coded. Encoded frames are self-delimiting with a small header:
+//   'L' 'R' flags seq widthHi widthLo heightHi heightLo, followed by the bitstream
+// This has no Arduino dependencies, so the decoder can also be built into host-side tools.
+namespace LeptonCodec {
+  const uint8_t kMagic0 = 'L', kMagic1 = 'R';
+  const size_t kHeaderLen = 8;
+  const uint8_t kFlagKeyframe = 0x01;
+
+  // Worst-case encoded size of a frame, for sizing output buffers
+  inline size_t maxEncodedLen(size_t width, size_t height) {
+    return kHeaderLen + (width * height * (16 + 24) + 7) / 8;
+  }
+}
+
+class LosslessEncoder {
+public:
+  // reference must hold width * height uint16_t, and is used to hold the previous frame.
+  // A keyframe is emitted every keyframeInterval frames (0 for only the first frame and on request).
+  LosslessEncoder(size_t width, size_t height, uint16_t* reference, uint16_t keyframeInterval = 30);
+
+  // Forces the next encoded frame to be a keyframe, eg when a new client joins a stream
+  void requestKeyframe() {
+    keyframeRequested_ = true;
+  }
+
+  // Encodes a frame into out, returning the encoded length, or 0 if outLen was insufficient
+  // (in which case the next frame will be a keyframe).
+  size_t encode(const uint8_t* frame, uint8_t* out, size_t outLen);
+
+protected:
+  size_t width_, height_;
+  uint16_t* reference_;
+  uint16_t keyframeInterval_;
+  uint16_t framesSinceKeyframe_ = 0;
+  uint8_t seq_ = 0;
+  bool keyframeRequested_ = true;
+};
+
+class LosslessDecoder {
+public:
+  // reference must hold width * height uint16_t, and is used to hold the previous decoded frame
+  LosslessDecoder(size_t width, size_t height, uint16_t* reference);
+
+  // Decodes an encoded frame into frameOut (width * height big-endian 16-bit pixels), returning success.
+  // Non-keyframes fail if the previous frame in sequence was not decoded, until the next keyframe.
+  bool decode(const uint8_t* in, size_t inLen, uint8_t* frameOut);
+
+  // Returns whether the last successfully decoded frame was a keyframe
+  bool lastWasKeyframe() {
+    return lastKeyframe_;
+  }
+
+protected:
+  size_t width_, height_;
+  uint16_t* reference_;
+  uint8_t lastSeq_ = 0;
+  bool synced_ = false;
+  bool lastKeyframe_ = false;
+};
+
+#endif
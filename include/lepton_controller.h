@@ -0,0 +1,118 @@
+#ifndef __LEPTON_CONTROLLER_H__
+#define __LEPTON_CONTROLLER_H__
+
+#include "lepton.h"
+#include "lepton_pipeline.h"
+
+
+// Concurrency-safe facade over a FlirLepton, which itself is not thread-safe.
+// A single capture task owns the camera and calls readVoSpi (or service when not streaming), while any task may
+// queue configuration changes, which the capture task applies between frames so CCI traffic never lands
+// mid-frame, and read status from a snapshot without touching the bus.
+class LeptonController {
+public:
+  // Arbitrary camera operation run by the capture task, returns success
+  typedef bool (*CommandFn)(FlirLepton& lepton, void* context);
+  // Called by the capture task with before=true just before applying a batch of queued changes that may change
+  // the video geometry and reallocate managed frame buffers (format changes and commands), and with before=false
+  // just after. Not called for batches of only mode, vsync, ROI or statistics requests.
+  // Eg, the before call can wait out frame buffer readers, and block new ones until the after call.
+  typedef void (*ConfigHookFn)(bool before, void* context);
+
+  static const size_t kMaxPendingRequests = 8;
+  static const uint32_t kRoiSettleMillis = 75;  // two camera frame periods
+
+  // Which on-camera statistics to read, for requestStatistics
+  enum StatisticsFlags {
+    kStatisticsSpotmeter = 0x01,
+    kStatisticsAgc = 0x02,
+  };
+
+  struct Status {
+    FlirLepton::BootPhase bootPhase;
+    uint64_t flirSerial;  // valid when booted
+    char flirPartNum[33];
+    FlirLepton::VideoMode videoMode;
+    FlirLepton::VideoFormat videoFormat;
+    uint8_t bytesPerPixel;
+    uint16_t frameWidth, frameHeight;
+    uint32_t configGeneration;  // incremented each time queued changes are applied
+    FlirLepton::SpotmeterValue spotmeter;  // from the last successful statistics read
+    FlirLepton::AgcStatistics agcStatistics;
+    uint32_t statisticsGeneration;  // incremented each time statistics are read
+    uint32_t framesRead;
+    FlirLepton::VoSpiStats voSpiStats;  // as of the last frame read or batch of changes applied
+    uint32_t requestsApplied, requestsFailed, requestsDropped;  // dropped if the queue was full
+    uint8_t requestsPending;
+  };
+
+  LeptonController(FlirLepton& lepton);
+
+  // Any task: queue configuration changes, returning false if the queue is full
+  bool requestVideoMode(FlirLepton::VideoMode mode);
+  bool requestVideoFormat(FlirLepton::VideoFormat format, FlirLepton::PColorLut lut = FlirLepton::kLutFusion);
+  bool requestVsync();
+  bool requestCommand(CommandFn fn, void* context);
+  bool requestSpotmeterRoi(const FlirLepton::CciRoi& roi);
+  bool requestAgcRoi(const FlirLepton::CciRoi& roi);
+  // Queues a read of on-camera statistics (StatisticsFlags) into the status snapshot. Merges with an already
+  // pending statistics read with no ROI change queued after it, so many pollers cost one batch of CCI reads per
+  // frame gap. A read queued after an ROI change waits for a frame computed with the new ROI (at least one frame
+  // read, or kRoiSettleMillis when not streaming), holding back requests queued after it.
+  bool requestStatistics(uint8_t flags);
+
+  // Any task: returns a consistent snapshot of the camera state
+  Status getStatus();
+
+  // Capture task only: runs the boot sequence, then reads a frame (see FlirLepton::readVoSpi).
+  // Queued changes are applied after calls that return no frame (ie, between frames), since they may reallocate
+  // managed frame buffers, so buffer must be re-fetched for each call. Returns true if a frame was read.
+  bool readVoSpi(size_t bufferLen, uint8_t* buffer, bool* bufferWrittenOut = nullptr);
+  // Capture task only: runs the boot sequence and applies queued changes without reading VoSPI, returning isReady()
+  bool service();
+
+  // Sets the hook around applying changes, must be set before the capture task starts
+  void setConfigHook(ConfigHookFn fn, void* context) {
+    configHook_ = fn;
+    configHookContext_ = context;
+  }
+
+protected:
+  enum RequestType {
+    kRequestVideoMode,
+    kRequestVideoFormat,
+    kRequestVsync,
+    kRequestCommand,
+    kRequestSpotmeterRoi,
+    kRequestAgcRoi,
+    kRequestStatistics,
+  };
+  struct Request {
+    RequestType type;
+    uint8_t arg0, arg1;
+    CommandFn fn;
+    void* context;
+    FlirLepton::CciRoi roi;
+  };
+
+  bool queue(const Request& request);
+  bool queueLocked(const Request& request);  // with mutex_ held
+  void applyRequests();
+  bool applyRequest(const Request& request);
+  bool readStatistics(uint8_t flags);
+  void updateSnapshot();  // from the capture task, with mutex_ held
+
+  FlirLepton& lepton_;
+  ConfigHookFn configHook_ = nullptr;
+  void* configHookContext_ = nullptr;
+
+  LeptonPipeline::Mutex mutex_;  // guards everything below
+  Request pending_[kMaxPendingRequests];
+  size_t numPending_ = 0;
+  Status status_;
+  bool metadataSnapshotted_ = false;
+  bool roiChanged_ = false;  // an ROI was set, as of roiChangedFrame_ (framesRead) and roiChangedMillis_
+  uint32_t roiChangedFrame_ = 0, roiChangedMillis_ = 0;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef __LEPTON_DISPLAY_H__
+#define __LEPTON_DISPLAY_H__
+
+#include "lepton.h"
+
+
+// Converts VoSPI packets straight into RGB565 display lines as they are read out (via FlirLepton::readVoSpiLines),
+// with optional integer upscaling, without a frame buffer.
+// 16-bit frames (Raw14 / TLinear / AGC) are mapped through a 256-entry palette, using the min / max of the previous
+// frame (or a fixed range) for linear AGC. RGB888 frames are converted directly.
+// Each source row is converted once into a slot of a small caller-provided ring of line buffers, then handed to the
+// display driver scale times (once per output line), so the driver can DMA it while readout continues.
+class Rgb565LineWriter : public FlirLepton::VoSpiLineSink {
+public:
+  // Called for each output line y, in order, with lineWidth RGB565 pixels (in native byte order, see
+  // setSwapBytes). The same line buffer is passed for the scale output lines of a source row.
+  // The line must be consumed (eg, its DMA started) before lineDone() is called for it, and the ring slot is not
+  // reused until lineDone() was called for each time the line was passed.
+  typedef void (*LineReadyFn)(const uint16_t* line, uint16_t y, uint16_t lineWidth, void* context);
+
+  // lines must hold numLines * (frameWidth * scale) uint16_t, with numLines >= 2 to allow overlapping readout and DMA.
+  // scale is the integer upscale factor, eg 1, 2, or 3.
+  Rgb565LineWriter(uint16_t frameWidth, uint8_t scale, uint16_t* lines, uint8_t numLines,
+      LineReadyFn lineReady, void* context);
+
+  // Sets the palette, 256 RGB565 entries from cold to hot, which must remain valid. nullptr restores greyscale.
+  void setPalette(const uint16_t* palette);
+
+  // Sets a fixed AGC input range for 16-bit frames, or automatic (from the previous frame) if min >= max
+  void setRange(uint16_t min, uint16_t max);
+
+  // Byte-swaps output pixels, for displays that take big-endian RGB565 over SPI
+  void setSwapBytes(bool swap) {
+    swapBytes_ = swap;
+  }
+
+  // To be called by the display driver (eg, from its DMA completion callback) when a line passed to lineReady
+  // is no longer needed. May be called from an interrupt.
+  void lineDone() {
+    linesReleased_++;
+  }
+
+  // Returns the number of source rows dropped because no line buffer was free
+  uint32_t getDroppedRows() {
+    return droppedRows_;
+  }
+
+  // Returns the line buffer memory needed for a configuration, in bytes
+  static size_t getLinesLen(uint16_t frameWidth, uint8_t scale, uint8_t numLines) {
+    return (size_t)frameWidth * scale * numLines * sizeof(uint16_t);
+  }
+
+  void onPacket(size_t row, size_t x, const uint8_t* data, size_t pixels, size_t bytesPerPixel) override;
+  void onFrameEnd(bool valid) override;
+
+protected:
+  // Returns the ring slot for row, claiming a new slot if row is not the row in progress, or nullptr if none is free
+  uint16_t* lineForRow(size_t row);
+  // Emits the row in progress, if any
+  void emitRow();
+  // Recomputes the AGC scale from the range
+  void updateScale();
+
+  uint16_t frameWidth_, lineWidth_;
+  uint8_t scale_;
+  uint16_t* lines_;
+  uint8_t numLines_;
+  LineReadyFn lineReady_;
+  void* context_;
+
+  const uint16_t* palette_;
+  uint16_t greyPalette_[256];
+  bool swapBytes_ = false;
+
+  bool autoRange_ = true;
+  uint16_t rangeMin_ = 0, rangeMax_ = 16383;  // AGC range for the current frame
+  uint32_t rangeScale_ = 0;  // 16.16 fixed-point, (value - rangeMin_) * rangeScale_ >> 16 maps to 0-255
+  uint16_t frameMin_ = 0xffff, frameMax_ = 0;  // observed in the current frame, for the next frame's range
+
+  int32_t currentRow_ = -1;  // source row being written, -1 if none
+  uint16_t* currentLine_ = nullptr;  // nullptr if the current row is being dropped
+  uint8_t nextSlot_ = 0;
+  uint32_t linesEmitted_ = 0;  // output lines passed to lineReady, written only by readout
+  volatile uint32_t linesReleased_ = 0;  // output lines released via lineDone, written only by the display driver
+  uint32_t droppedRows_ = 0;
+};
+
+#endif
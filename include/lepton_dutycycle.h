@@ -0,0 +1,99 @@
+#ifndef __LEPTON_DUTYCYCLE_H__
+#define __LEPTON_DUTYCYCLE_H__
+
+#include "lepton.h"
+
+
+// Duty-cycled capture, for low-power applications that need a frame every few seconds rather than a stream.
+// Keeps the camera powered down (PWRDN) between wakes, and each period powers it up with a short boot (early I2C
+// polling, cached metadata), re-applies configuration through a wake hook, captures a number of valid frames, and
+// powers it down again.
+// Non-blocking: the task that owns the camera calls poll() in place of readVoSpi, at least as often.
+class LeptonDutyCycle {
+public:
+  // Called once booted on each wake to re-apply configuration lost while powered down (eg, video mode and format,
+  // Vsync), returns success. FlirLepton keeps the last set video parameters, so a non-default format must be set here.
+  typedef bool (*WakeHookFn)(FlirLepton& lepton, void* context);
+
+  // Wakes boot with the camera's boot policy as of start(), overridden by waitForFfc and minI2cMillis (and with
+  // metadata cached across wakes)
+  struct Config {
+    uint32_t periodMillis;  // time between the start of wakes, the next wake is immediate if a wake overruns it
+    uint8_t framesPerWake;  // valid frames to capture per wake
+    uint8_t skipFrames;  // frames read and dropped after each boot before capturing, eg to let AGC settle
+    bool waitForFfc;  // wait for the boot FFC to complete, so captured frames are freshly corrected
+    uint16_t minI2cMillis;  // boot policy minimum before polling I2C, polling early shortens the boot
+    uint32_t wakeTimeoutMillis;  // a wake that has not captured all its frames by then is abandoned
+  };
+  static const Config kDefaultConfig;
+
+  enum State {
+    kStopped,  // not started, camera state untouched
+    kAsleep,  // powered down until the next wake
+    kBooting,  // powered up, waiting for boot and the wake hook
+    kCapturing,  // reading frames
+  };
+
+  // Energy-relevant counters, times in ms
+  struct Stats {
+    uint32_t wakes;
+    uint32_t failedWakes;  // boot or wake hook failed, or the wake timed out
+    uint32_t framesCaptured;
+    uint32_t framesSkipped;
+    uint32_t lastBootMillis;  // power-up to ready, including the wake hook, for the last completed boot
+    uint32_t lastAwakeMillis;  // power-up to power-down, for the last wake
+    uint32_t totalAwakeMillis;
+    uint32_t totalMillis;  // since start()
+  };
+
+  LeptonDutyCycle(FlirLepton& lepton) : lepton_(lepton) {}
+
+  // Takes effect on the next wake
+  void setConfig(const Config& config) {
+    config_ = config;
+  }
+  void setWakeHook(WakeHookFn fn, void* context) {
+    wakeHook_ = fn;
+    wakeHookContext_ = context;
+  }
+
+  // Powers down the camera with the first wake due immediately, returns false if the camera has no PWRDN pin.
+  // Saves the camera's boot policy, which wakes adjust per the Config.
+  bool start();
+  // Powers down the camera and stops waking it, restoring the boot policy saved by start()
+  void stop();
+
+  // Steps the state machine, powering up and down as needed. Returns true if a frame was captured into buffer
+  // (which can happen on the call that powers the camera down after the last frame of a wake).
+  // bufferWrittenOut is as in FlirLepton::readVoSpi, and is also set for skipped frames.
+  bool poll(size_t bufferLen, uint8_t* buffer, bool* bufferWrittenOut = nullptr);
+
+  State getState() {
+    return state_;
+  }
+  // Returns the time until the next wake while asleep (eg, to sleep the MCU), 0 otherwise
+  uint32_t getSleepMillisRemaining();
+
+  Stats getStats();
+  // Returns the average time powered up per captured frame, 0 if no frames were captured
+  uint32_t getAwakeMillisPerFrame();
+
+protected:
+  void wake(uint32_t now);
+  void sleep(uint32_t now, bool failed);
+
+  FlirLepton& lepton_;
+  Config config_ = kDefaultConfig;
+  WakeHookFn wakeHook_ = nullptr;
+  void* wakeHookContext_ = nullptr;
+  FlirLepton::BootPolicy savedBootPolicy_ = FlirLepton::kDefaultBootPolicy;  // the camera's, from start()
+
+  State state_ = kStopped;
+  Stats stats_ = {0, 0, 0, 0, 0, 0, 0, 0};
+  uint32_t startMillis_ = 0;
+  uint32_t wakeMillis_ = 0;  // millis() at power-up of the current or last wake
+  uint32_t nextWakeMillis_ = 0;
+  uint8_t wakeFramesCaptured_ = 0, wakeFramesSkipped_ = 0;
+};
+
+#endif
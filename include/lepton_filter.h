@@ -0,0 +1,63 @@
+#ifndef __LEPTON_FILTER_H__
+#define __LEPTON_FILTER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+// Per-pixel recursive (IIR) temporal noise filter for 16-bit frames as produced by FlirLepton::readVoSpi
+// (Raw14 / TLinear / 8-bit AGC, each pixel as a big-endian 16-bit word).
+// Static pixels are blended into the running average with a small weight, while pixels that changed by
+// more than the noise level take progressively more of the new sample, to avoid ghosting on motion.
+// All arithmetic is fixed-point, with state kept as one uint16_t per pixel in a caller-provided buffer.
+class TemporalFilter {
+public:
+  static const uint8_t kMaxMotionShift = 8;
+
+  // state must hold width * height uint16_t and remain valid for the lifetime of this object.
+  // fractionBits is the number of fractional bits kept in state, which reduces the IIR dead zone;
+  // pixel values shifted left by fractionBits must still fit in 16 bits (eg, 2 for Raw14, 0 for TLinear).
+  TemporalFilter(size_t width, size_t height, uint16_t* state, uint8_t fractionBits = 2);
+
+  // Sets the weight (out of 256) of a new sample for a pixel that has not changed.
+  // Lower is smoother, 256 disables filtering.
+  void setStrength(uint16_t staticWeight) {
+    staticWeight_ = staticWeight > 256 ? 256 : staticWeight;
+  }
+
+  // Sets how quickly the new-sample weight grows with the difference from the running average:
+  // weight = staticWeight + (|difference| << motionShift), saturating at 256 (no filtering).
+  // Clamped to kMaxMotionShift, at which a difference of one count or more disables filtering.
+  void setMotionShift(uint8_t motionShift) {
+    if (motionShift > kMaxMotionShift) {
+      motionShift = kMaxMotionShift;
+    }
+    motionShift_ = motionShift;
+  }
+
+  // Discards the filter state, the next frame will be passed through and used as the initial state
+  void reset() {
+    primed_ = false;
+  }
+
+  // Filters frame in-place and updates the state.
+  // The inner loop is branch-free for auto-vectorization.
+  void apply(uint8_t* frame);
+
+  // Straightforward implementation of apply(), bit-exact with it, for validation
+  void applyReference(uint8_t* frame);
+
+protected:
+  // Initializes state from the frame
+  void prime(const uint8_t* frame);
+
+  size_t numPixels_;
+  uint16_t* state_;
+  uint8_t fractionBits_;
+
+  uint16_t staticWeight_ = 32;
+  uint8_t motionShift_ = 4;
+  bool primed_ = false;
+};
+
+#endif
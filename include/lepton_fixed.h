@@ -0,0 +1,93 @@
+#ifndef __LEPTON_FIXED_H__
+#define __LEPTON_FIXED_H__
+
+#include "lepton.h"
+
+
+// Compile-time Lepton model and video format traits, for FlirLeptonFixed
+namespace LeptonModel {
+  struct Lepton2 {  // also Lepton 2.5
+    static const size_t kFrameWidth = 80, kFrameHeight = 60;
+    static const size_t kSegmentsPerFrame = 1;
+    static const size_t kTelemetryPackets = 3;  // per frame
+  };
+  typedef Lepton2 Lepton25;
+
+  struct Lepton3 {  // also Lepton 3.5
+    static const size_t kFrameWidth = 160, kFrameHeight = 120;
+    static const size_t kSegmentsPerFrame = 4;
+    static const size_t kTelemetryPackets = 4;  // per frame, one per segment
+  };
+  typedef Lepton3 Lepton35;
+}
+
+namespace LeptonFormat {
+  struct Raw14 {
+    static const size_t kBytesPerPixel = 2;
+    static const FlirLepton::VideoFormat kFormat = FlirLepton::kGrey14;
+  };
+  struct Rgb888 {
+    static const size_t kBytesPerPixel = 3;
+    static const FlirLepton::VideoFormat kFormat = FlirLepton::kRgb888;
+  };
+}
+
+// Compile-time video geometry for FlirLepton::readVoSpiPackets, so loop bounds and buffer sizes are constants.
+// With telemetry enabled, telemetry packets are read into the frame buffer as additional rows.
+template <typename Model, typename Format, bool kTelemetry = false>
+struct StaticVoSpiGeometry {
+  static const size_t kPixelsPerPacket = 80;  // for all Lepton 2.x and 3.x devices
+  static const size_t kPacketDataLen = kPixelsPerPacket * Format::kBytesPerPixel;
+  static const size_t kPacketsPerSegment = (Model::kFrameWidth * Model::kFrameHeight / kPixelsPerPacket +
+      (kTelemetry ? Model::kTelemetryPackets : 0)) / Model::kSegmentsPerFrame;
+  static const size_t kFrameBufferLen = kPacketDataLen * kPacketsPerSegment * Model::kSegmentsPerFrame;
+  static const size_t kScratchLen = kPacketDataLen;
+
+  static constexpr size_t bytesPerPixel() { return Format::kBytesPerPixel; }
+  static constexpr size_t frameWidth() { return Model::kFrameWidth; }
+  static constexpr size_t packetDataLen() { return kPacketDataLen; }
+  static constexpr size_t packetsPerSegment() { return kPacketsPerSegment; }
+  static constexpr size_t segmentsPerFrame() { return Model::kSegmentsPerFrame; }
+};
+
+// FlirLepton specialized at compile time for a model and video format, so the VoSPI packet loop compiles to
+// fixed-trip code and frame buffers can be sized statically, eg:
+//   FlirLeptonFixed<LeptonModel::Lepton35, LeptonFormat::Raw14> lepton(i2c, spi, kPinLepCs, kPinLepRst);
+//   uint8_t frameBuffer[decltype(lepton)::kFrameBufferLen];
+// The runtime FlirLepton API (including the runtime readVoSpi and setVideoFormat overloads) remains available,
+// but the video parameters must not be changed (eg, setVideoFormat must only be called with Format::kFormat, and
+// telemetry must match kTelemetry).
+template <typename Model, typename Format, bool kTelemetry = false>
+class FlirLeptonFixed : public FlirLepton {
+public:
+  typedef StaticVoSpiGeometry<Model, Format, kTelemetry> Geometry;
+  static const size_t kFrameBufferLen = Geometry::kFrameBufferLen;
+
+  using FlirLepton::readVoSpi;
+  using FlirLepton::setVideoFormat;
+
+  FlirLeptonFixed(TwoWire& wire, SPIClass& spi, int cs, int reset, int pwrdn = -1) :
+      FlirLepton(wire, spi, cs, reset, pwrdn) {
+    bytesPerPixel_ = Geometry::bytesPerPixel();
+    frameWidth_ = Model::kFrameWidth;
+    frameHeight_ = Model::kFrameHeight;
+    videoPacketDataLen_ = Geometry::packetDataLen();
+    packetsPerSegment_ = Geometry::packetsPerSegment();
+    segmentsPerFrame_ = Geometry::segmentsPerFrame();
+  }
+
+  // Sets the video format, which must be the compile-time format
+  bool setVideoFormat(PColorLut lut = kLutFusion) {
+    return FlirLepton::setVideoFormat(Format::kFormat, lut);
+  }
+
+  // Reads a VoSpi frame into a statically-sized buffer, see FlirLepton::readVoSpi
+  bool readVoSpi(uint8_t (&buffer)[kFrameBufferLen], bool* bufferWrittenOut = nullptr) {
+    if (!startVoSpi()) {
+      return false;
+    }
+    return finishVoSpi(readVoSpiPackets(Geometry(), buffer, nullptr, nullptr, bufferWrittenOut));
+  }
+};
+
+#endif
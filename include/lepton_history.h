@@ -0,0 +1,92 @@
+#ifndef __LEPTON_HISTORY_H__
+#define __LEPTON_HISTORY_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "lepton_codec.h"
+
+
+// Pre-trigger history of recent 16-bit frames within a fixed memory budget, stored losslessly compressed
+// (LosslessEncoder deltas against periodic keyframes) in a ring of variable-size records, oldest evicted first.
+// Frames are written from a single writer task, which never waits: while the history is frozen (eg, after an alarm
+// trigger, while it is being exported), writes are dropped instead.
+class FrameHistory {
+public:
+  // storage is the history memory budget. reference must hold width * height uint16_t, for the encoder.
+  // maxRecordLen is the space reserved for each incoming frame before it is encoded (keyframes being the largest),
+  // frames that do not compress to this are dropped.
+  FrameHistory(size_t width, size_t height, uint8_t* storage, size_t storageLen, uint16_t* reference,
+      size_t maxRecordLen, uint16_t keyframeInterval = 30);
+
+  // Compresses and stores a frame, evicting the oldest frames as needed. Returns false if the frame was dropped.
+  bool write(const uint8_t* frame, uint32_t timestampMillis);
+
+  // Stops / resumes recording, the contents are stable once freeze() returns.
+  // freeze() waits for a write in progress to finish, so must not be called from a context that preempts the writer
+  // and keeps it from running (eg, an interrupt, or a higher-priority task on the writer's core).
+  void freeze();
+  void unfreeze() {
+    __atomic_store_n(&frozen_, 0, __ATOMIC_RELEASE);
+  }
+  bool isFrozen() {
+    return __atomic_load_n(&frozen_, __ATOMIC_ACQUIRE);
+  }
+
+  // Calls recordFn for each stored encoded frame (see lepton_codec.h) with timestamp >= fromMillis, oldest first,
+  // starting from the first keyframe so the sequence can be decoded with a LosslessDecoder.
+  // Stops if recordFn returns false. Returns the number of records passed. Must only be called while frozen.
+  typedef bool (*RecordFn)(const uint8_t* encoded, size_t len, uint32_t timestampMillis, void* context);
+  size_t exportRecords(uint32_t fromMillis, RecordFn recordFn, void* context);
+
+  // Returns the number of stored frames, bytes used, and time span (newest - oldest timestamp)
+  size_t getNumFrames() {
+    return count_;
+  }
+  size_t getBytesUsed() {
+    return bytesUsed_;
+  }
+  uint32_t getSpanMillis() {
+    return count_ > 0 ? newestMillis_ - oldestMillis() : 0;
+  }
+
+  // Returns the number of frames dropped (while frozen, or encoding overflow)
+  uint32_t getDroppedFrames() {
+    return droppedFrames_;
+  }
+
+protected:
+  struct RecordHeader {
+    uint32_t len;  // of the encoded frame following the header
+    uint32_t timestampMillis;
+  };
+
+  // Encodes and appends a record at tail_, which must have space for maxRecordLen_
+  bool writeRecord(const uint8_t* frame, uint32_t timestampMillis);
+  // Evicts records until len contiguous bytes are free at tail_, returning false if impossible
+  bool ensureSpace(size_t len);
+  // Removes the oldest record
+  void evictOldest();
+  // Returns the free contiguous bytes at tail_
+  size_t contiguousFree();
+  uint32_t oldestMillis();
+
+  LosslessEncoder encoder_;
+  uint8_t* storage_;
+  size_t storageLen_;
+  size_t maxRecordLen_;
+
+  size_t head_ = 0;  // offset of the oldest record
+  size_t tail_ = 0;  // offset to write the next record
+  size_t dataEnd_ = 0;  // end of the records before the wrap, valid when wrapped (tail_ <= head_ with records)
+  size_t count_ = 0;
+  size_t bytesUsed_ = 0;
+  uint32_t newestMillis_ = 0;
+
+  // freeze handshake with the writer, accessed through atomic builtins (which unlike <atomic> are available on
+  // all cores): write() sets writing_ then checks frozen_, freeze() sets frozen_ then waits for writing_ to clear
+  uint8_t frozen_ = 0;
+  uint8_t writing_ = 0;
+  uint32_t droppedFrames_ = 0;
+};
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef __LEPTON_LOG_H__
+#define __LEPTON_LOG_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The deferred log ring needs <atomic>, which some Arduino cores (eg, AVR) lack. Without it, LEP_DLOGx log
+// immediately, and the deferredLog object is an always-empty stub so code draining it still builds.
+#ifndef LEP_DEFERRED_LOG
+  #if defined(__has_include)
+    #if __has_include(<atomic>)
+      #define LEP_DEFERRED_LOG 1
+    #endif
+  #endif
+  #ifndef LEP_DEFERRED_LOG
+    #define LEP_DEFERRED_LOG 0
+  #endif
+#endif
+#if LEP_DEFERRED_LOG
+  #include <atomic>
+#endif
+
+
+// Compile-time log level, messages above this level compile to nothing (including argument evaluation)
+#define LEP_LOG_LEVEL_NONE 0
+#define LEP_LOG_LEVEL_ERROR 1
+#define LEP_LOG_LEVEL_WARN 2
+#define LEP_LOG_LEVEL_INFO 3
+#define LEP_LOG_LEVEL_DEBUG 4
+#define LEP_LOG_LEVEL_VERBOSE 5
+
+#ifndef LEP_LOG_LEVEL
+  #ifdef ESP32
+    #define LEP_LOG_LEVEL LEP_LOG_LEVEL_VERBOSE  // ESP-IDF logging applies its own level filtering
+  #else
+    #define LEP_LOG_LEVEL LEP_LOG_LEVEL_INFO
+  #endif
+#endif
+
+
+namespace LeptonLog {
+  // Immediately formats and prints a message, for platforms without a native logging framework
+  void print(char level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+  // Lock-free ring of unformatted log records, for logging from timing-critical paths (eg, VoSPI readout)
+  // where formatting and blocking on a serial port could cause the very errors being logged.
+  // Recording stores only the format string pointer (which doubles as a message ID) and up to kMaxArgs
+  // integer arguments, and never blocks: records are dropped (and counted) if the ring is full.
+  // Any number of producers may record concurrently, while a single consumer (eg, a low-priority task)
+  // drains and formats records later. Arguments must be integers of at most 32 bits, so formats should
+  // use %i / %u / %x style specifiers only.
+  class DeferredLog {
+  public:
+#if LEP_DEFERRED_LOG
+    static const size_t kMaxArgs = 4;
+    static const size_t kCapacity = 64;  // must be a power of 2
+
+    struct Record {
+      const char* format;
+      uint32_t args[kMaxArgs];
+      char level;
+    };
+
+    // Called with each formatted message on draining
+    typedef void (*LineFn)(char level, const char* message, void* context);
+
+    DeferredLog();
+
+    template<typename... Args>
+    void record(char level, const char* format, Args... args) {
+      static_assert(sizeof...(Args) <= kMaxArgs, "too many deferred log arguments");
+      const uint32_t values[kMaxArgs + 1] = {0, ((uint32_t)args)...};  // leading 0 allows zero args
+
+      uint32_t pos = head_.load(std::memory_order_relaxed);
+      Slot* slot;
+      while (true) {
+        slot = &slots_[pos % kCapacity];
+        int32_t diff = (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+        if (diff == 0) {  // slot free for this position, try to claim it
+          if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            break;
+          }  // else pos was reloaded by the failed exchange
+        } else if (diff < 0) {  // ring full
+          drops_.fetch_add(1, std::memory_order_relaxed);
+          return;
+        } else {  // another producer claimed this position
+          pos = head_.load(std::memory_order_relaxed);
+        }
+      }
+
+      slot->record.format = format;
+      slot->record.level = level;
+      for (size_t i=0; i<kMaxArgs; i++) {
+        slot->record.args[i] = values[i + 1];
+      }
+      slot->seq.store(pos + 1, std::memory_order_release);
+    }
+
+    // Removes the oldest record into recordOut, returning false if empty. Single consumer only.
+    bool pop(Record& recordOut);
+
+    // Pops and formats up to maxRecords records, returning the number drained. Single consumer only.
+    size_t drain(LineFn lineFn, void* context, size_t maxRecords = kCapacity);
+
+    uint32_t getDrops() { return drops_.load(std::memory_order_relaxed); }
+
+  protected:
+    struct Slot {
+      std::atomic<uint32_t> seq;  // position + 1 once written, position (mod capacity) when free to write
+      Record record;
+    };
+
+    Slot slots_[kCapacity];
+    std::atomic<uint32_t> head_;
+    uint32_t tail_ = 0;
+    std::atomic<uint32_t> drops_;
+#else  // stub, LEP_DLOGx log immediately instead
+    typedef void (*LineFn)(char level, const char* message, void* context);
+    size_t drain(LineFn lineFn, void* context, size_t maxRecords = 0) {
+      return 0;
+    }
+    uint32_t getDrops() { return 0; }
+#endif
+  };
+
+  extern DeferredLog deferredLog;
+}
+
+
+// Override these to use some other logging framework
+#ifdef ESP32
+  #include <esp_log.h>
+  #define LEP_LOG_TAG "lepton"
+  #define LEP_LOG_PRINT_E(...) ESP_LOGE(LEP_LOG_TAG, __VA_ARGS__)
+  #define LEP_LOG_PRINT_W(...) ESP_LOGW(LEP_LOG_TAG, __VA_ARGS__)
+  #define LEP_LOG_PRINT_I(...) ESP_LOGI(LEP_LOG_TAG, __VA_ARGS__)
+  #define LEP_LOG_PRINT_D(...) ESP_LOGD(LEP_LOG_TAG, __VA_ARGS__)
+  #define LEP_LOG_PRINT_V(...) ESP_LOGV(LEP_LOG_TAG, __VA_ARGS__)
+#else  // generic vsnprintf + Arduino Serial fallback for other platforms
+  #define LEP_LOG_PRINT_E(...) LeptonLog::print('E', __VA_ARGS__)
+  #define LEP_LOG_PRINT_W(...) LeptonLog::print('W', __VA_ARGS__)
+  #define LEP_LOG_PRINT_I(...) LeptonLog::print('I', __VA_ARGS__)
+  #define LEP_LOG_PRINT_D(...) LeptonLog::print('D', __VA_ARGS__)
+  #define LEP_LOG_PRINT_V(...) LeptonLog::print('V', __VA_ARGS__)
+#endif
+
+// Immediate logging (LEP_LOGx) and deferred logging for timing-critical paths (LEP_DLOGx)
+#if LEP_LOG_LEVEL >= LEP_LOG_LEVEL_ERROR
+  #define LEP_LOGE(...) LEP_LOG_PRINT_E(__VA_ARGS__)
+  #if LEP_DEFERRED_LOG
+    #define LEP_DLOGE(...) LeptonLog::deferredLog.record('E', __VA_ARGS__)
+  #else
+    #define LEP_DLOGE(...) LEP_LOG_PRINT_E(__VA_ARGS__)
+  #endif
+#else
+  #define LEP_LOGE(...) do {} while (0)
+  #define LEP_DLOGE(...) do {} while (0)
+#endif
+#if LEP_LOG_LEVEL >= LEP_LOG_LEVEL_WARN
+  #define LEP_LOGW(...) LEP_LOG_PRINT_W(__VA_ARGS__)
+  #if LEP_DEFERRED_LOG
+    #define LEP_DLOGW(...) LeptonLog::deferredLog.record('W', __VA_ARGS__)
+  #else
+    #define LEP_DLOGW(...) LEP_LOG_PRINT_W(__VA_ARGS__)
+  #endif
+#else
+  #define LEP_LOGW(...) do {} while (0)
+  #define LEP_DLOGW(...) do {} while (0)
+#endif
+#if LEP_LOG_LEVEL >= LEP_LOG_LEVEL_INFO
+  #define LEP_LOGI(...) LEP_LOG_PRINT_I(__VA_ARGS__)
+  #if LEP_DEFERRED_LOG
+    #define LEP_DLOGI(...) LeptonLog::deferredLog.record('I', __VA_ARGS__)
+  #else
+    #define LEP_DLOGI(...) LEP_LOG_PRINT_I(__VA_ARGS__)
+  #endif
+#else
+  #define LEP_LOGI(...) do {} while (0)
+  #define LEP_DLOGI(...) do {} while (0)
+#endif
+#if LEP_LOG_LEVEL >= LEP_LOG_LEVEL_DEBUG
+  #define LEP_LOGD(...) LEP_LOG_PRINT_D(__VA_ARGS__)
+  #if LEP_DEFERRED_LOG
+    #define LEP_DLOGD(...) LeptonLog::deferredLog.record('D', __VA_ARGS__)
+  #else
+    #define LEP_DLOGD(...) LEP_LOG_PRINT_D(__VA_ARGS__)
+  #endif
+#else
+  #define LEP_LOGD(...) do {} while (0)
+  #define LEP_DLOGD(...) do {} while (0)
+#endif
+#if LEP_LOG_LEVEL >= LEP_LOG_LEVEL_VERBOSE
+  #define LEP_LOGV(...) LEP_LOG_PRINT_V(__VA_ARGS__)
+  #if LEP_DEFERRED_LOG
+    #define LEP_DLOGV(...) LeptonLog::deferredLog.record('V', __VA_ARGS__)
+  #else
+    #define LEP_DLOGV(...) LEP_LOG_PRINT_V(__VA_ARGS__)
+  #endif
+#else
+  #define LEP_LOGV(...) do {} while (0)
+  #define LEP_DLOGV(...) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,438 @@
+#ifndef __LEPTON_PIPELINE_H__
+#define __LEPTON_PIPELINE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Threading backend: FreeRTOS on ESP32, or std::thread on a host build (define LEPTON_HOST_BUILD).
+// Other (single-threaded) Arduino targets get only micros() and a no-op Mutex, so the Mutex users
+// (eg, LeptonController) still build, while the pipeline itself and its queues are unavailable.
+#if defined(ESP32)
+  #include <atomic>
+  #include <freertos/FreeRTOS.h>
+  #include <freertos/task.h>
+  #include <freertos/semphr.h>
+  #include <esp_timer.h>
+  #define LEPTON_PIPELINE_THREADS 1
+#elif defined(LEPTON_HOST_BUILD)  // stages run on std::thread
+  #include <atomic>
+  #include <chrono>
+  #include <mutex>
+  #include <thread>
+  #ifdef __linux__
+    #include <pthread.h>
+  #endif
+  #define LEPTON_PIPELINE_THREADS 1
+#else
+  #include <Arduino.h>
+  #define LEPTON_PIPELINE_THREADS 0
+#endif
+
+
+// Small multi-core pipeline framework: named stages pinned to cores (FreeRTOS tasks on ESP32, std::threads
+// on a host build so pipelines can be profiled there), connected by bounded lock-free queues,
+// with per-stage latency accounting.
+
+namespace LeptonPipeline {
+  // Returns a monotonic timestamp in microseconds
+  inline uint32_t micros() {
+#if defined(ESP32)
+    return esp_timer_get_time();
+#elif defined(LEPTON_HOST_BUILD)
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+    return ::micros();
+#endif
+  }
+
+#if LEPTON_PIPELINE_THREADS
+  // Yields the current stage when it has no work
+  inline void idle() {
+#ifdef ESP32
+    vTaskDelay(1);
+#else
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+#endif
+  }
+#endif
+
+  // Mutex for short critical sections shared between stages or tasks.
+  // A no-op on single-threaded targets, where it must not be used to guard against interrupt handlers.
+  class Mutex {
+  public:
+#if defined(ESP32)
+    Mutex() {
+      handle_ = xSemaphoreCreateMutexStatic(&handleBuf_);
+    }
+    void lock() {
+      while (xSemaphoreTake(handle_, portMAX_DELAY) != pdTRUE);
+    }
+    void unlock() {
+      xSemaphoreGive(handle_);
+    }
+
+  protected:
+    StaticSemaphore_t handleBuf_;
+    SemaphoreHandle_t handle_;
+#elif defined(LEPTON_HOST_BUILD)
+    void lock() {
+      mutex_.lock();
+    }
+    void unlock() {
+      mutex_.unlock();
+    }
+
+  protected:
+    std::mutex mutex_;
+#else
+    void lock() {}
+    void unlock() {}
+#endif
+  };
+
+  // Holds a Mutex for the lifetime of this object
+  class LockGuard {
+  public:
+    LockGuard(Mutex& mutex) : mutex_(mutex) {
+      mutex_.lock();
+    }
+    ~LockGuard() {
+      mutex_.unlock();
+    }
+
+  protected:
+    Mutex& mutex_;
+  };
+}
+
+#if LEPTON_PIPELINE_THREADS
+// Bounded lock-free single-producer single-consumer queue of up to kCapacity elements
+template <typename T, size_t kCapacity>
+class SpscQueue {
+public:
+  // Enqueues an element, returning false (and counting a drop) if the queue is full. Producer only.
+  bool push(const T& value) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t next = (tail + 1) % kSlots;
+    if (next == head_.load(std::memory_order_acquire)) {
+      drops_++;
+      return false;
+    }
+    buffer_[tail] = value;
+    tail_.store(next, std::memory_order_release);
+
+    size_t occupancy = size();
+    if (occupancy > highWater_) {
+      highWater_ = occupancy;
+    }
+    return true;
+  }
+
+  // Dequeues an element into valueOut, returning false if the queue is empty. Consumer only.
+  bool pop(T* valueOut) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    *valueOut = buffer_[head];
+    head_.store((head + 1) % kSlots, std::memory_order_release);
+    return true;
+  }
+
+  // Returns the number of queued elements, approximate if called concurrently
+  size_t size() const {
+    return (tail_.load(std::memory_order_acquire) + kSlots - head_.load(std::memory_order_acquire)) % kSlots;
+  }
+
+  // Returns the maximum observed occupancy, as seen by the producer
+  size_t getHighWater() const {
+    return highWater_;
+  }
+
+  // Returns the number of elements dropped from a full queue
+  uint32_t getDrops() const {
+    return drops_;
+  }
+
+protected:
+  static const size_t kSlots = kCapacity + 1;  // one slot is always empty to distinguish full from empty
+  T buffer_[kSlots];
+  std::atomic<size_t> head_{0};  // next element to pop, written by consumer
+  std::atomic<size_t> tail_{0};  // next slot to push, written by producer
+  size_t highWater_ = 0;  // producer only
+  uint32_t drops_ = 0;  // producer only
+};
+
+// Per-stage latency statistics, in microseconds per processed item
+struct PipelineStageStats {
+  uint32_t count = 0;
+  uint64_t totalMicros = 0;
+  uint32_t maxMicros = 0;
+  uint32_t lastMicros = 0;
+
+  uint32_t getMeanMicros() const {
+    return count > 0 ? totalMicros / count : 0;
+  }
+};
+
+// A set of named stages, each running a step function repeatedly on its own task / thread.
+// Step functions return true if they processed an item (which is counted in the latency statistics),
+// or false if there was no work, in which case the stage idles briefly.
+class Pipeline {
+public:
+  typedef bool (*StepFn)(void* context);
+  static const size_t kMaxStages = 8;
+  static const int kAnyCore = -1;
+
+  // Adds a stage, which runs once start() is called. Returns the stage index, or -1 if full.
+  // core is a core affinity hint (kAnyCore for none), priority and stackSize are only used with FreeRTOS.
+  int addStage(const char* name, StepFn step, void* context, int core = kAnyCore, int priority = 1,
+      uint32_t stackSize = 4096) {
+    if (numStages_ >= kMaxStages || running_) {
+      return -1;
+    }
+    Stage& stage = stages_[numStages_];
+    stage.pipeline = this;
+    stage.name = name;
+    stage.step = step;
+    stage.context = context;
+    stage.core = core;
+    stage.priority = priority;
+    stage.stackSize = stackSize;
+    return numStages_++;
+  }
+
+  // Starts all stages
+  void start() {
+    running_ = true;
+    for (size_t i=0; i<numStages_; i++) {
+      Stage& stage = stages_[i];
+      stage.stopped = false;
+#ifdef ESP32
+      xTaskCreatePinnedToCore(runStage, stage.name, stage.stackSize, &stage, stage.priority, &stage.task,
+          stage.core == kAnyCore ? tskNO_AFFINITY : stage.core);
+#else
+      stage.thread = std::thread(runStage, &stage);
+  #ifdef __linux__
+      if (stage.core != kAnyCore) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(stage.core, &cpuset);
+        pthread_setaffinity_np(stage.thread.native_handle(), sizeof(cpuset), &cpuset);
+      }
+  #endif
+#endif
+    }
+  }
+
+  // Stops all stages after their current step, blocking until they have exited
+  void stop() {
+    running_ = false;
+    for (size_t i=0; i<numStages_; i++) {
+#ifdef ESP32
+      while (!stages_[i].stopped) {
+        vTaskDelay(1);
+      }
+#else
+      if (stages_[i].thread.joinable()) {
+        stages_[i].thread.join();
+      }
+#endif
+    }
+  }
+
+  size_t getNumStages() const {
+    return numStages_;
+  }
+
+  const char* getStageName(size_t index) const {
+    return stages_[index].name;
+  }
+
+  // Returns the latency statistics of a stage. May be slightly inconsistent if read while running.
+  const PipelineStageStats& getStageStats(size_t index) const {
+    return stages_[index].stats;
+  }
+
+protected:
+  struct Stage {
+    Pipeline* pipeline;
+    const char* name;
+    StepFn step;
+    void* context;
+    int core, priority;
+    uint32_t stackSize;
+    PipelineStageStats stats;
+    std::atomic<bool> stopped{true};
+#ifdef ESP32
+    TaskHandle_t task = nullptr;
+#else
+    std::thread thread;
+#endif
+  };
+
+  static void runStage(void* stagePtr) {
+    Stage* stage = (Stage*)stagePtr;
+    while (stage->pipeline->running_) {
+      uint32_t startMicros = LeptonPipeline::micros();
+      if (stage->step(stage->context)) {
+        uint32_t elapsed = LeptonPipeline::micros() - startMicros;
+        stage->stats.count++;
+        stage->stats.totalMicros += elapsed;
+        stage->stats.lastMicros = elapsed;
+        if (elapsed > stage->stats.maxMicros) {
+          stage->stats.maxMicros = elapsed;
+        }
+      } else {
+        LeptonPipeline::idle();
+      }
+    }
+    stage->stopped = true;
+#ifdef ESP32
+    vTaskDelete(NULL);
+#endif
+  }
+
+  Stage stages_[kMaxStages];
+  size_t numStages_ = 0;
+  std::atomic<bool> running_{false};
+};
+
+// Default frame pipeline graph, capture -> process -> encode -> fan-out, passing frame buffer slot indices
+// (into caller-owned frame buffers) between stages, with used slots returned to capture after fan-out.
+// Capture is called with slot -1 if all slots are in use, in which case it must still read out (and discard)
+// the frame to maintain VoSPI sync.
+// Each callback returns whether it produced an item (for capture, whether a frame was read into the slot).
+template <size_t kSlots>
+class FramePipeline {
+public:
+  typedef bool (*StageFn)(int slot, void* context);
+  typedef SpscQueue<uint8_t, kSlots> SlotQueue;
+
+  struct Config {
+    StageFn capture, process, encode, fanOut;  // process may be nullptr to skip it
+    void* context;
+    int captureCore, processingCore;  // capture is isolated from the other stages
+  };
+
+  explicit FramePipeline(const Config& config) : config_(config) {
+    for (size_t i=0; i<kSlots; i++) {
+      freeSlots_.push(i);
+    }
+    pipeline_.addStage("capture", stepCapture, this, config.captureCore, 16);
+    if (config.process != nullptr) {
+      pipeline_.addStage("process", stepProcess, this, config.processingCore, 2);
+    }
+    pipeline_.addStage("encode", stepEncode, this, config.processingCore, 1);
+    pipeline_.addStage("fanOut", stepFanOut, this, config.processingCore, 1);
+  }
+
+  void start() {
+    pipeline_.start();
+  }
+
+  void stop() {
+    pipeline_.stop();
+  }
+
+  Pipeline& getPipeline() {
+    return pipeline_;
+  }
+
+  // Returns the number of frames captured while all slots were in use
+  uint32_t getOverruns() const {
+    return overruns_;
+  }
+
+  // Queues carrying slots into a stage, for getQueue
+  enum QueueId {
+    kToProcess,
+    kToEncode,
+    kToFanOut,
+  };
+  // Returns the queue into a stage, eg for its high-water mark. Every slot fits in every queue, so drops are a bug.
+  const SlotQueue& getQueue(QueueId id) const {
+    return id == kToProcess ? toProcess_ : id == kToEncode ? toEncode_ : toFanOut_;
+  }
+
+protected:
+
+  // Runs stage fn on the next slot from input, passing it to output if successful, otherwise to released
+  bool stepSlot(StageFn fn, SlotQueue& input, SlotQueue& output, SlotQueue& released) {
+    uint8_t slot;
+    if (!input.pop(&slot)) {
+      return false;
+    }
+    if (fn(slot, config_.context)) {
+      output.push(slot);
+    } else {
+      released.push(slot);
+    }
+    return true;
+  }
+
+  static bool stepCapture(void* context) {
+    FramePipeline* self = (FramePipeline*)context;
+    self->reclaimSlots();
+    if (self->pendingSlot_ < 0) {
+      uint8_t slot;
+      if (self->freeSlots_.pop(&slot)) {
+        self->pendingSlot_ = slot;
+      }
+    }
+    if (!self->config_.capture(self->pendingSlot_, self->config_.context)) {
+      return false;
+    }
+    if (self->pendingSlot_ < 0) {
+      self->overruns_++;
+      return true;
+    }
+    SlotQueue& output = self->config_.process != nullptr ? self->toProcess_ : self->toEncode_;
+    output.push(self->pendingSlot_);
+    self->pendingSlot_ = -1;
+    return true;
+  }
+
+  static bool stepProcess(void* context) {
+    FramePipeline* self = (FramePipeline*)context;
+    return self->stepSlot(self->config_.process, self->toProcess_, self->toEncode_, self->releasedSlots_[0]);
+  }
+
+  static bool stepEncode(void* context) {
+    FramePipeline* self = (FramePipeline*)context;
+    return self->stepSlot(self->config_.encode, self->toEncode_, self->toFanOut_, self->releasedSlots_[1]);
+  }
+
+  static bool stepFanOut(void* context) {
+    FramePipeline* self = (FramePipeline*)context;
+    uint8_t slot;
+    if (!self->toFanOut_.pop(&slot)) {
+      return false;
+    }
+    self->config_.fanOut(slot, self->config_.context);
+    self->releasedSlots_[2].push(slot);
+    return true;
+  }
+
+  // Returns slots released by the downstream stages to the free list, capture stage only
+  void reclaimSlots() {
+    uint8_t slot;
+    for (size_t i=0; i<3; i++) {
+      while (releasedSlots_[i].pop(&slot)) {
+        freeSlots_.push(slot);
+      }
+    }
+  }
+
+  Config config_;
+  Pipeline pipeline_;
+  SlotQueue freeSlots_;  // capture stage only
+  SlotQueue toProcess_, toEncode_, toFanOut_;
+  SlotQueue releasedSlots_[3];  // from process, encode, fan-out (one queue each to keep them single-producer)
+  int pendingSlot_ = -1;  // slot being captured into, capture stage only
+  uint32_t overruns_ = 0;
+};
+#endif  // LEPTON_PIPELINE_THREADS
+
+#endif
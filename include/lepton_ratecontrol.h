@@ -0,0 +1,88 @@
+#ifndef __LEPTON_RATECONTROL_H__
+#define __LEPTON_RATECONTROL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+// Bandwidth-adaptive rate control for streaming encoders (eg, MJPEG), independent of the encoder library.
+// Encoder settings are abstracted as a ladder of levels from 0 (best quality, largest) to kNumLevels-1
+// (lowest quality, smallest); for JPEG these are quality x chroma subsampling, see getQuality / isSubsampled.
+// Each frame, the controller picks the best level whose predicted size fits the per-frame budget, which is
+// derived from the target bitrate, the slowest client's drain rate, and the measured frame rate.
+class RateControl {
+public:
+  static const uint8_t kNumQualities = 4;  // eg, JPEGE_Q_BEST, JPEGE_Q_HIGH, JPEGE_Q_MED, JPEGE_Q_LOW
+  static const uint8_t kNumLevels = kNumQualities * 2;  // each quality with 4:4:4 then 4:2:0 subsampling
+  static const uint8_t kNoLevel = 0xff;
+
+  explicit RateControl(uint32_t targetBitsPerSecond);
+
+  void setTargetBitrate(uint32_t targetBitsPerSecond) {
+    targetBitsPerSecond_ = targetBitsPerSecond;
+  }
+
+  // Returns the quality index (0 = best) and subsampling of a level
+  static uint8_t getQuality(uint8_t level) {
+    return level / 2;
+  }
+  static bool isSubsampled(uint8_t level) {
+    return level % 2;
+  }
+
+  // Returns the level to use for the next frame
+  uint8_t selectLevel();
+
+  // Returns the next smaller level to retry with if encoding at level overflowed, or kNoLevel if none remain
+  uint8_t getFallbackLevel(uint8_t level) {
+    if (level + 1 >= kNumLevels) {
+      return kNoLevel;
+    }
+    overflowed_ = true;
+    return level + 1;
+  }
+
+  // Records a frame encoded at level, of bytes size, at a monotonic timestamp nowMicros
+  void reportEncoded(uint8_t level, size_t bytes, uint32_t nowMicros);
+
+  // Records that a client took elapsedMicros to accept bytes of the current frame.
+  // The slowest client over each frame bounds the bitrate budget.
+  void reportClientDrain(size_t bytes, uint32_t elapsedMicros);
+
+  // Returns the measured output bitrate, in bits per second
+  uint32_t getAchievedBitrate() {
+    return achievedBitsPerSecond_;
+  }
+
+  // Returns the effective bitrate budget, the lower of the target and slowest client drain rate
+  uint32_t getBudgetBitrate();
+
+  // Returns the measured frame interval, in microseconds
+  uint32_t getFrameMicros() {
+    return frameMicros_;
+  }
+
+protected:
+  // Returns the predicted encoded size of a level, extrapolating from measured levels where needed
+  uint32_t predictBytes(uint8_t level);
+
+  static const uint8_t kEmaShift = 3;  // exponential moving averages weight new samples by 1/8
+  static const uint8_t kUpgradeFrames = 8;  // frames that must fit before moving to a better level
+  static const uint8_t kHeadroomPct = 85;  // fraction of the budget targeted, for frame-to-frame variation
+
+  uint32_t targetBitsPerSecond_;
+  uint32_t levelBytes_[kNumLevels] = {0};  // EMA of encoded size per level, 0 if not measured
+  uint8_t level_ = 0;
+  uint8_t upgradeCount_ = 0;
+  bool overflowed_ = false;  // set when the current frame needed a fallback level
+
+  uint32_t lastFrameMicros_ = 0;
+  bool haveLastFrame_ = false;
+  uint32_t frameMicros_ = 0;  // EMA of frame interval
+  uint32_t achievedBitsPerSecond_ = 0;
+
+  uint32_t drainBitsPerSecond_ = 0;  // EMA of the slowest client drain rate, 0 if not measured
+  uint32_t frameMinDrain_ = 0;  // slowest client drain rate of the current frame, 0 if none reported
+};
+
+#endif
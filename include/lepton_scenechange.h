@@ -0,0 +1,88 @@
+#ifndef __LEPTON_SCENECHANGE_H__
+#define __LEPTON_SCENECHANGE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+// Cheap scene-change detector for 16-bit frames as produced by FlirLepton::readVoSpi, for gating encoding and
+// streaming of static scenes. Frames are reduced to a grid of block means (sampling every other pixel and row),
+// which are compared against the block means of the last frame that was let through. A block has changed if its
+// absolute difference exceeds a noise floor that rises with signal level; the frame has changed if enough blocks did.
+// This differences block means rather than summing per-pixel absolute differences (SAD) against a full reference
+// frame, so the reference is just the previous sent frame's block means (a few hundred bytes rather than a frame) and
+// each frame is read once, at half resolution. It misses changes that preserve a block's mean (eg, a small object
+// moving within a block).
+// A keepalive forces a frame through periodically, eg so clients can tell the stream is alive.
+class SceneChangeDetector {
+public:
+  static const size_t kMaxGridWidth = 64;
+  static const uint8_t kMinBlockShift = 1, kMaxBlockShift = 8;
+
+  // state must hold getStateLen() uint16_t (two grids of block means, the reference and the current frame),
+  // eg 2 * 20 * 15 for 160x120 frames with the default 8x8 blocks. Partial blocks at the edges are ignored.
+  // blockShift is log2 of the block size, clamped to kMinBlockShift (2x2, since every other pixel is sampled) to
+  // kMaxBlockShift (256x256).
+  SceneChangeDetector(size_t width, size_t height, uint16_t* state, uint8_t blockShift = 3);
+
+  static constexpr size_t getStateLen(size_t width, size_t height, uint8_t blockShift = 3) {
+    return 2 * (width >> clampBlockShift(blockShift)) * (height >> clampBlockShift(blockShift));
+  }
+
+  static constexpr uint8_t clampBlockShift(uint8_t blockShift) {
+    return blockShift < kMinBlockShift ? kMinBlockShift : blockShift > kMaxBlockShift ? kMaxBlockShift : blockShift;
+  }
+
+  // Sets the per-block noise floor as baseNoise + (block mean >> levelShift), in pixel units.
+  // For TLinear (0.01 K / count) the default 24 + mean >> 10 is ~0.25 K near room temperature.
+  void setNoiseFloor(uint16_t baseNoise, uint8_t levelShift) {
+    baseNoise_ = baseNoise;
+    levelShift_ = levelShift;
+  }
+
+  // Sets the number of changed blocks needed for a frame to count as changed
+  void setMinChangedBlocks(uint16_t minChangedBlocks) {
+    minChangedBlocks_ = minChangedBlocks;
+  }
+
+  // Sets the maximum time between frames let through, 0 to disable
+  void setKeepaliveMillis(uint32_t keepaliveMillis) {
+    keepaliveMillis_ = keepaliveMillis;
+  }
+
+  // Returns whether frame should be encoded / sent, because it changed or the keepalive elapsed.
+  // If so, the frame becomes the new reference.
+  bool shouldSend(const uint8_t* frame, uint32_t nowMillis);
+
+  // Returns the number of blocks that changed in the last frame passed to shouldSend
+  uint16_t getChangedBlocks() {
+    return changedBlocks_;
+  }
+
+  // Returns the number of frames seen and let through, eg to compute the fraction of bandwidth saved
+  uint32_t getFramesSeen() {
+    return framesSeen_;
+  }
+  uint32_t getFramesSent() {
+    return framesSent_;
+  }
+
+protected:
+  size_t width_;
+  size_t gridWidth_, gridHeight_;
+  uint16_t* reference_;  // block means of the last frame let through
+  uint16_t* current_;  // block means of the last frame passed to shouldSend
+  uint8_t blockShift_;
+
+  uint16_t baseNoise_ = 24;
+  uint8_t levelShift_ = 10;
+  uint16_t minChangedBlocks_ = 1;
+  uint32_t keepaliveMillis_ = 1000;
+
+  bool primed_ = false;
+  uint32_t lastSentMillis_ = 0;
+  uint16_t changedBlocks_ = 0;
+  uint32_t framesSeen_ = 0, framesSent_ = 0;
+};
+
+#endif
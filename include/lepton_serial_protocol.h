@@ -0,0 +1,97 @@
+#ifndef __LEPTON_SERIAL_PROTOCOL_H__
+#define __LEPTON_SERIAL_PROTOCOL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "lepton_codec.h"
+
+
+// Binary framed protocol for streaming full 16-bit frames over a byte stream (eg, USB-CDC / UART).
+// Each message is COBS-encoded and terminated by a 0x00 delimiter, so receivers can resynchronize at any point.
+// Decoded message layout (multi-byte fields big-endian):
+//   version(1) type(1) seq(2) width(2) height(2) payload(...) crc16(2)
+// where the payload is the frame as from FlirLepton::readVoSpi (kTypeRawFrame), or a LosslessEncoder
+// encoded frame (kTypeLosslessFrame), and crc16 is CRC-16/CCITT-FALSE over all preceding bytes.
+// This has no Arduino dependencies, so the receiver can also be built into host-side tools.
+namespace LeptonSerialProtocol {
+  const uint8_t kVersion = 1;
+  const size_t kHeaderLen = 8;
+  const size_t kCrcLen = 2;
+
+  enum MessageType {
+    kTypeRawFrame = 0,
+    kTypeLosslessFrame = 1,
+  };
+
+  uint16_t crc16(const uint8_t* data, size_t len, uint16_t crc = 0xffff);
+}
+
+class SerialFrameSender {
+public:
+  // Called to write encoded bytes to the link, eg wrapping Serial.write
+  typedef void (*WriteFn)(const uint8_t* data, size_t len, void* context);
+
+  SerialFrameSender(WriteFn write, void* context);
+
+  // Sends an uncompressed frame of width * height big-endian 16-bit pixels
+  void sendRawFrame(const uint8_t* frame, uint16_t width, uint16_t height);
+
+  // Sends a frame encoded with a LosslessEncoder
+  void sendLosslessFrame(const uint8_t* encoded, size_t len, uint16_t width, uint16_t height);
+
+protected:
+  void sendMessage(uint8_t type, const uint8_t* payload, size_t len, uint16_t width, uint16_t height);
+  // Streaming COBS encoder
+  void cobsByte(uint8_t data);
+  void cobsFlushBlock(uint8_t code);
+  void cobsFinish();
+
+  WriteFn write_;
+  void* context_;
+  uint16_t seq_ = 0;
+  uint8_t block_[255];  // block_[0] is the code byte
+  uint8_t blockLen_ = 0;  // data bytes in block_
+};
+
+class SerialFrameReceiver {
+public:
+  // Called for each received frame, with width * height big-endian 16-bit pixels
+  typedef void (*FrameFn)(const uint8_t* frame, uint16_t width, uint16_t height, uint16_t seq, void* context);
+
+  // messageBuf holds a decoded message, and must fit the largest expected message
+  // (kHeaderLen + width * height * 2 + kCrcLen for raw frames).
+  // decoder (optional) is used for kTypeLosslessFrame messages, in which case frameBuf (width * height * 2 bytes)
+  // receives the decoded frame.
+  SerialFrameReceiver(uint8_t* messageBuf, size_t messageBufLen, FrameFn frameFn, void* context,
+      LosslessDecoder* decoder = nullptr, uint8_t* frameBuf = nullptr);
+
+  // Consumes received bytes, calling frameFn for each complete valid frame
+  void push(const uint8_t* data, size_t len);
+
+  // Statistics
+  uint32_t getFramesReceived() { return framesReceived_; }
+  uint32_t getFramesDropped() { return framesDropped_; }  // from gaps in sequence numbers
+  uint32_t getCrcErrors() { return crcErrors_; }
+  uint32_t getFormatErrors() { return formatErrors_; }  // oversize, malformed, or undecodable messages
+
+protected:
+  void handleMessage();
+
+  uint8_t* messageBuf_;
+  size_t messageBufLen_;
+  FrameFn frameFn_;
+  void* context_;
+  LosslessDecoder* decoder_;
+  uint8_t* frameBuf_;
+
+  size_t len_ = 0;
+  uint8_t blockRemaining_ = 0;  // data bytes remaining in the current COBS block
+  uint8_t lastCode_ = 0xff;  // code of the previous block, 0xff (no implied zero) at the start of a message
+  bool overflow_ = false;
+
+  bool haveSeq_ = false;
+  uint16_t lastSeq_ = 0;
+  uint32_t framesReceived_ = 0, framesDropped_ = 0, crcErrors_ = 0, formatErrors_ = 0;
+};
+
+#endif
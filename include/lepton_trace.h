@@ -0,0 +1,66 @@
+#ifndef __LEPTON_TRACE_H__
+#define __LEPTON_TRACE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "lepton_pipeline.h"
+
+
+// Timestamps of a frame through the capture-to-client path, all in microseconds from the same monotonic clock.
+// The readout fields come from FlirLepton::getFrameInfo(), the rest are filled in by the application.
+struct FrameTimestamps {
+  uint32_t sequence;
+  uint32_t firstPacketMicros;
+  uint32_t lastPacketMicros;
+  uint32_t publishMicros;  // handed off to consumers (eg, frame buffer flip)
+  uint32_t encodeDoneMicros;
+  uint32_t sendDoneMicros;
+};
+
+// Accumulates per-stage latency distributions of traced frames, in fixed memory (log-scale histograms with
+// 8 buckets per power of two, so percentiles are within 12.5%), for reporting percentiles.
+// Thread-safe, so frames can be recorded from one task while another exports.
+class LatencyTracer {
+public:
+  enum Stage {
+    kReadout,  // first to last packet
+    kPublish,  // last packet to publish
+    kEncode,  // publish to encode done
+    kSend,  // encode done to send done
+    kTotal,  // first packet to send done
+    kNumStages
+  };
+
+  static const char* getStageName(Stage stage);
+
+  // Records a completely traced frame
+  void record(const FrameTimestamps& timestamps);
+
+  // Returns the latency at the percentile (0-100) for a stage in microseconds, or 0 if nothing was recorded
+  uint32_t getPercentile(Stage stage, uint8_t percentile);
+  uint32_t getMax(Stage stage);
+  uint32_t getCount();
+
+  void reset();
+
+  // Writes a JSON object of count, and per-stage p50 / p90 / p99 / max in microseconds, into out (null-terminated,
+  // truncated if needed), returning the length that would have been written
+  size_t exportJson(char* out, size_t outLen);
+
+protected:
+  static const uint8_t kSubBucketBits = 3;
+  static const size_t kSubBuckets = 1 << kSubBucketBits;
+  static const size_t kMaxShift = 24;  // values saturate above 2^28 us (about 4.5 minutes)
+  static const size_t kNumBuckets = kSubBuckets * (kMaxShift + 2);
+
+  static size_t bucketIndex(uint32_t value);
+  static uint32_t bucketValue(size_t index);  // midpoint of the bucket
+  uint32_t getPercentileLocked(Stage stage, uint8_t percentile);
+
+  LeptonPipeline::Mutex mutex_;
+  uint32_t counts_[kNumStages][kNumBuckets] = {{0}};
+  uint32_t max_[kNumStages] = {0};
+  uint32_t count_ = 0;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef __LEPTON_UPSCALE_H__
+#define __LEPTON_UPSCALE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+// Fixed-point integer upscaling of frames, one output row at a time, so upscaled output can be streamed into an
+// encoder (eg, a strip of JPEG MCU rows) without materializing the full upscaled image.
+// Frames are in the readVoSpi layout: row-major, with channels (1 for greyscale, 3 for RGB888) of bytesPerChannel
+// (1 for 8-bit, 2 for big-endian 16-bit) per pixel. Output rows have the same layout.
+// Stateless once configured, so one instance can be shared between tasks as long as each uses its own scratch.
+class Upscaler {
+public:
+  enum Mode {
+    kNearest,  // pixel replication
+    kBilinear,  // pixel-center aligned bilinear interpolation
+    kEdgeAware,  // bilinear, except nearest across steps larger than the edge threshold, keeping hot spots crisp
+  };
+
+  static const uint8_t kMaxScale = 4;
+
+  // scale is the integer upscale factor, 1, 2, or 4 (for which bilinear weights are exact in 4-bit fixed point).
+  // Other factors are rounded down to one of these (see clampScale), eg 3 upscales by 2.
+  Upscaler(uint16_t width, uint16_t height, uint8_t channels, uint8_t bytesPerChannel, uint8_t scale, Mode mode);
+
+  static constexpr uint8_t clampScale(uint8_t scale) {
+    return scale >= kMaxScale ? kMaxScale : scale >= 2 ? 2 : 1;
+  }
+
+  // Sets the step size, in input units, above which kEdgeAware does not interpolate
+  void setEdgeThreshold(uint16_t threshold) {
+    edgeThreshold_ = threshold;
+  }
+
+  uint8_t getScale() const { return scale_; }
+  uint16_t getOutWidth() const { return width_ * scale_; }
+  uint16_t getOutHeight() const { return height_ * scale_; }
+  // Returns the size of an output row, in bytes
+  size_t getOutRowLen() const { return (size_t)width_ * scale_ * channels_ * bytesPerChannel_; }
+  // Returns the size of the scratch needed by upscaleRow, in uint32_t
+  size_t getScratchLen() const { return (size_t)width_ * channels_; }
+
+  // Writes output row outY (0 to getOutHeight() - 1) of the upscaled frame into out (getOutRowLen() bytes),
+  // using scratch (getScratchLen() entries) for the intermediate vertically-interpolated row
+  void upscaleRow(const uint8_t* frame, uint16_t outY, uint8_t* out, uint32_t* scratch) const;
+
+protected:
+  template <size_t kBytes> void nearestRow(const uint8_t* frame, uint16_t outY, uint8_t* out) const;
+  template <size_t kBytes, bool kEdgeAware> void bilinearRow(const uint8_t* frame, uint16_t outY, uint8_t* out,
+      uint32_t* scratch) const;
+  template <size_t kBytes, bool kEdgeAware, size_t kChannels> void horizontalPass(const uint32_t* scratch,
+      uint8_t* out) const;
+
+  static const uint8_t kWeightBits = 4;  // interpolation weights in 1/16ths
+
+  uint16_t width_, height_;
+  uint8_t channels_, bytesPerChannel_;
+  uint8_t scale_;
+  Mode mode_;
+  uint16_t edgeThreshold_ = 32;
+
+  // per output phase (output coordinate mod scale): the first source sample offset (-1 or 0) relative to
+  // (output coordinate / scale), and the weight of the second sample, in 1/16ths
+  int8_t phaseOffset_[kMaxScale];
+  uint8_t phaseWeight_[kMaxScale];
+};
+
+#endif
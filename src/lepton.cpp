@@ -1,50 +1,19 @@
 #include "lepton.h"
+#include "lepton_log.h"
 
 
 // Class constants
-const SPISettings FlirLepton::kDefaultSpiSettings(20000000, MSBFIRST, SPI_MODE3);  // 20MHz max for VoSPI, CPOL=1, CPHA=1
-
-
-// Override these to use some other logging framework
-#ifdef ESP32
-  static const char* TAG = "lepton";
-  #ifndef LEP_LOGV
-    #define LEP_LOGV(...) ESP_LOGV(TAG, __VA_ARGS__)
-  #endif
-  #ifndef LEP_LOGD
-    #define LEP_LOGD(...) ESP_LOGD(TAG, __VA_ARGS__)
-  #endif
-  #ifndef LEP_LOGI
-    #define LEP_LOGI(...) ESP_LOGI(TAG, __VA_ARGS__)
-  #endif
-  #ifndef LEP_LOGW
-    #define LEP_LOGW(...) ESP_LOGW(TAG, __VA_ARGS__)
-  #endif
-  #ifndef LEP_LOGE
-    #define LEP_LOGE(...) ESP_LOGE(TAG, __VA_ARGS__)
-  #endif
-#else  // generic sprintf + Arduino Serial fallback for other platforms
-  static char logBuf[128];
-  #ifndef LEP_LOGV
-    #define LEP_LOGV(...)
-  #endif
-
-  #ifndef LEP_LOGD
-    #define LEP_LOGD(...)
-  #endif
-
-  #ifndef LEP_LOGI
-    #define LEP_LOGI(...) sprintf(logBuf, __VA_ARGS__); Serial.print("LEP I "); Serial.println(logBuf);
-  #endif
-
-  #ifndef LEP_LOGW
-    #define LEP_LOGW(...) sprintf(logBuf, __VA_ARGS__); Serial.print("LEP W "); Serial.println(logBuf);
-  #endif
-
-  #ifndef LEP_LOGE
-    #define LEP_LOGE(...) sprintf(logBuf, __VA_ARGS__); Serial.print("LEP E "); Serial.println(logBuf);
-  #endif
-#endif
+const uint32_t FlirLepton::kDefaultSpiCalibrationClocks[] = {20000000, 16000000, 13333333, 10000000, 8000000, 5000000};
+const size_t FlirLepton::kNumDefaultSpiCalibrationClocks =
+    sizeof(kDefaultSpiCalibrationClocks) / sizeof(kDefaultSpiCalibrationClocks[0]);
+const FlirLepton::BootPolicy FlirLepton::kDefaultBootPolicy = {
+  950,  // minimum wait before accessing I2C, Lepton Software IDD
+  5,
+  true,
+  true,
+  true,
+};
+
 
 // utility conversions
 // note, bits in a 16b word in big-endian order, words in little-endian order
@@ -68,6 +37,11 @@ inline int32_t bufferToI32(uint8_t* buffer) {
   return (int32_t)bufferToU32(buffer);
 }
 
+inline void U16ToBuffer(uint16_t data, uint8_t* bufferOut) {
+  bufferOut[0] = (data >> 8) & 0xff;
+  bufferOut[1] = (data >> 0) & 0xff;
+}
+
 inline void U32ToBuffer(uint32_t data, uint8_t* bufferOut) {
   bufferOut[0] = (data >> 8) & 0xff;
   bufferOut[1] = (data >> 0) & 0xff;
@@ -98,87 +72,160 @@ bool FlirLepton::begin() {
   digitalWrite(resetPin_, HIGH);
 
   resetMillis_ = millis();
-  i2cReady_ = false;
+  poweredDown_ = false;
+  lastBootPollMillis_ = resetMillis_;
+  bootPhase_ = kBootWaitI2c;
+  bootTimings_ = {0, 0, 0, 0};
+  if (!bootPolicy_.cacheMetadata) {
+    metadataRead_ = false;
+  }
   return true;
 }
 
-bool FlirLepton::isReady() {
-  if (!i2cReady_ && millis() - resetMillis_ < 950) {  // minimum wait before accessing I2C, Lepton Software IDD
+bool FlirLepton::powerDown() {
+  if (pwrdnPin_ == -1) {
     return false;
   }
+  digitalWrite(csPin_, HIGH);
+  digitalWrite(pwrdnPin_, LOW);  // assert PWR_DWN_L
+  digitalWrite(resetPin_, LOW);  // hold in reset, so power-up is a clean boot through begin()
+  poweredDown_ = true;
+  bootPhase_ = kBootWaitI2c;
+  return true;
+}
 
-  uint16_t statusData;
-  if (!readReg16(kRegStatus, &statusData)) {
-    LEP_LOGE("isReady() read status failed");
+bool FlirLepton::bootPollDue() {
+  uint32_t now = millis();
+  if (now - lastBootPollMillis_ < bootPolicy_.pollIntervalMillis) {
     return false;
   }
-  LEP_LOGD("isReady() status <- 0x%04x", statusData);
+  lastBootPollMillis_ = now;
+  return true;
+}
 
-  if (statusData & (1 << 2) && !(statusData & 1)) {
-    if (!(statusData & (1 << 1))) {
-      LEP_LOGE("isReady() unexpected boot mode bit");
-      return false;
-    }
-  } else {
-    return false;  // not yet ready
+bool FlirLepton::isReady() {
+  if (bootPhase_ == kBootReady) {
+    return true;
+  }
+  if (poweredDown_) {
+    return false;
+  }
+  if (millis() - resetMillis_ < bootPolicy_.minI2cMillis || !bootPollDue()) {
+    return false;
   }
 
   Result result;
-  uint8_t cmdBuffer[32];
+  uint8_t cmdBuffer[4];
 
-  if (!metadataRead_) {  // read out serial
-    result = commandGet(kSys, 0x08 >> 2, 8, cmdBuffer);
-    if (result != kLepOk) {
-      LEP_LOGE("isReady() SYS FLIR Serial commandGet failed %i", result);
-      return false;
-    }
-    flirSerial_ = bufferToU64(cmdBuffer);
-    LEP_LOGD("isReady() SYS FLIR serial = %llu, 0x%016llx", flirSerial_, flirSerial_);
-    if (flirSerial_ == 0) {  // a sanity check on comms correctness
-      LEP_LOGW("isReady() failed sanity check: zero FLIR serial");
-    }
+  switch (bootPhase_) {
+    case kBootWaitI2c:
+      if (!probeI2c()) {  // expected to fail while booting, if polling before the IDD minimum
+        return false;
+      }
+      bootTimings_.i2cMillis = millis() - resetMillis_;
+      bootPhase_ = kBootWaitBooted;
+      // fall through
+
+    case kBootWaitBooted: {
+      uint16_t statusData;
+      if (!readReg16(kRegStatus, &statusData)) {
+        LEP_LOGE("isReady() read status failed");
+        return false;
+      }
+      LEP_LOGD("isReady() status <- 0x%04x", statusData);
 
-    size_t kPartNumberLen = 16;  // 32 in the IDD, but only 16 registers to read out of
-    result = commandGet(kOem, 0x1c >> 2, kPartNumberLen, cmdBuffer, true);
-    if (result != kLepOk) {
-      LEP_LOGE("isReady() OEM FLIR Part Number commandGet failed %i", result);
-      return false;
-    }
-    // result seems in the wrong endianness
-    for (size_t i=0; i<kPartNumberLen/2; i++) {
-      flirPartNum_[i*2] = cmdBuffer[i*2 + 1];
-      flirPartNum_[i*2 + 1] = cmdBuffer[i*2];
+      if (statusData & (1 << 2) && !(statusData & 1)) {
+        if (!(statusData & (1 << 1))) {
+          LEP_LOGE("isReady() unexpected boot mode bit");
+          return false;
+        }
+      } else {
+        return false;  // not yet ready
+      }
+      bootTimings_.bootedMillis = millis() - resetMillis_;
+      bootPhase_ = kBootMetadata;
     }
-    LEP_LOGD("isReady() OEM FLIR Part Number = '%s'", flirPartNum_);
+      // fall through
 
-    result = commandGet(kOem, 0x20 >> 2, 8, flirSoftwareVersion_, true);
-    if (result != kLepOk) {
-      LEP_LOGE("isReady() OEM Camera Software Revision commandGet failed %i", result);
-      return false;
-    }
-    LEP_LOGD("isReady() OEM Camera Software Revision = 0x %02x %02x %02x %02x %02x %02x",
-        flirSoftwareVersion_[0], flirSoftwareVersion_[1], flirSoftwareVersion_[2], 
-        flirSoftwareVersion_[3], flirSoftwareVersion_[4], flirSoftwareVersion_[5]);
+    case kBootMetadata:
+      if (bootPolicy_.readMetadata && !metadataRead_) {
+        if (!readMetadata()) {
+          return false;
+        }
+      }
+      // guaranteed to have read out metadata (if enabled) by this point
+      bootTimings_.metadataMillis = millis() - resetMillis_;
+      bootPhase_ = kBootWaitFfc;
+      // fall through
+
+    case kBootWaitFfc:
+      if (bootPolicy_.waitForFfc) {
+        result = commandGet(kSys, 0x44 >> 2, 4, cmdBuffer);
+        if (result != kLepOk) {
+          LEP_LOGE("isReady() SYS FFC status commandGet failed %i", result);
+          return false;
+        }
+        int32_t ffcStatus = bufferToI32(cmdBuffer);
+        LEP_LOGD("isReady() SYS FFC <- %i", ffcStatus);
+        if (ffcStatus == 0) {  // ready, continue with init
+        } else if (ffcStatus < 0) {
+          LEP_LOGE("isReady() SYS FFC returned error %i", ffcStatus);
+          return false;
+        } else {
+          return false;
+        }
+      }
+      bootTimings_.readyMillis = millis() - resetMillis_;
+      bootPhase_ = kBootReady;
+      LEP_LOGI("isReady() booted, I2C %i ms, booted %i ms, metadata %i ms, ready %i ms",
+          (int)bootTimings_.i2cMillis, (int)bootTimings_.bootedMillis, (int)bootTimings_.metadataMillis,
+          (int)bootTimings_.readyMillis);
+      // fall through
 
-    metadataRead_ = true;
+    case kBootReady:
+    default:
+      return true;
   }
-  // guaranteed to have read out metadata by this point
+}
+
+bool FlirLepton::readMetadata() {
+  Result result;
+  uint8_t cmdBuffer[32];
 
-  result = commandGet(kSys, 0x44 >> 2, 4, cmdBuffer);
+  result = commandGet(kSys, 0x08 >> 2, 8, cmdBuffer);
   if (result != kLepOk) {
-    LEP_LOGE("isReady() SYS FFC status commandGet failed %i", result);
+    LEP_LOGE("isReady() SYS FLIR Serial commandGet failed %i", result);
     return false;
   }
-  int32_t ffcStatus = bufferToI32(cmdBuffer);
-  LEP_LOGD("isReady() SYS FFC <- %i", ffcStatus);
-  if (ffcStatus == 0) {  // ready, continue with init
-  } else if (ffcStatus < 0) {
-    LEP_LOGE("isReady() SYS FFC returned error %i", ffcStatus);
+  flirSerial_ = bufferToU64(cmdBuffer);
+  LEP_LOGD("isReady() SYS FLIR serial = %llu, 0x%016llx", (unsigned long long)flirSerial_, (unsigned long long)flirSerial_);
+  if (flirSerial_ == 0) {  // a sanity check on comms correctness
+    LEP_LOGW("isReady() failed sanity check: zero FLIR serial");
+  }
+
+  size_t kPartNumberLen = 16;  // 32 in the IDD, but only 16 registers to read out of
+  result = commandGet(kOem, 0x1c >> 2, kPartNumberLen, cmdBuffer, true);
+  if (result != kLepOk) {
+    LEP_LOGE("isReady() OEM FLIR Part Number commandGet failed %i", result);
     return false;
-  } else {
+  }
+  // result seems in the wrong endianness
+  for (size_t i=0; i<kPartNumberLen/2; i++) {
+    flirPartNum_[i*2] = cmdBuffer[i*2 + 1];
+    flirPartNum_[i*2 + 1] = cmdBuffer[i*2];
+  }
+  LEP_LOGD("isReady() OEM FLIR Part Number = '%s'", flirPartNum_);
+
+  result = commandGet(kOem, 0x20 >> 2, 8, flirSoftwareVersion_, true);
+  if (result != kLepOk) {
+    LEP_LOGE("isReady() OEM Camera Software Revision commandGet failed %i", result);
     return false;
   }
+  LEP_LOGD("isReady() OEM Camera Software Revision = 0x %02x %02x %02x %02x %02x %02x",
+      flirSoftwareVersion_[0], flirSoftwareVersion_[1], flirSoftwareVersion_[2],
+      flirSoftwareVersion_[3], flirSoftwareVersion_[4], flirSoftwareVersion_[5]);
 
+  metadataRead_ = true;
   return true;
 }
 
@@ -270,9 +317,150 @@ bool FlirLepton::setVideoFormat(VideoFormat format, PColorLut lut) {
   }
 
   resyncRequested_ = true;
+  return allocateFrameBuffers();
+}
+
+
+// RAD ROIs are ordered row-first, AGC ROIs column-first
+bool FlirLepton::setSpotmeterRoi(const CciRoi& roi) {
+  uint8_t buffer[8];
+  U16ToBuffer(roi.startRow, buffer + 0);
+  U16ToBuffer(roi.startCol, buffer + 2);
+  U16ToBuffer(roi.endRow, buffer + 4);
+  U16ToBuffer(roi.endCol, buffer + 6);
+  Result result = commandSet(kRad, 0xCC >> 2, 8, buffer, true);
+  if (result != kLepOk) {
+    LEP_LOGE("setSpotmeterRoi() RAD spotmeter ROI command returned %i", result);
+    return false;
+  }
+  return true;
+}
+
+bool FlirLepton::getSpotmeterRoi(CciRoi* roiOut) {
+  uint8_t buffer[8];
+  Result result = commandGet(kRad, 0xCC >> 2, 8, buffer, true);
+  if (result != kLepOk) {
+    LEP_LOGE("getSpotmeterRoi() RAD spotmeter ROI command returned %i", result);
+    return false;
+  }
+  roiOut->startRow = bufferToU16(buffer + 0);
+  roiOut->startCol = bufferToU16(buffer + 2);
+  roiOut->endRow = bufferToU16(buffer + 4);
+  roiOut->endCol = bufferToU16(buffer + 6);
+  return true;
+}
+
+bool FlirLepton::getSpotmeter(SpotmeterValue* valueOut) {
+  uint8_t buffer[8];
+  Result result = commandGet(kRad, 0xD0 >> 2, 8, buffer, true);
+  if (result != kLepOk) {
+    LEP_LOGE("getSpotmeter() RAD spotmeter value command returned %i", result);
+    return false;
+  }
+  valueOut->value = bufferToU16(buffer + 0);
+  valueOut->max = bufferToU16(buffer + 2);
+  valueOut->min = bufferToU16(buffer + 4);
+  valueOut->population = bufferToU16(buffer + 6);
+  return true;
+}
+
+bool FlirLepton::setAgcRoi(const CciRoi& roi) {
+  uint8_t buffer[8];
+  U16ToBuffer(roi.startCol, buffer + 0);
+  U16ToBuffer(roi.startRow, buffer + 2);
+  U16ToBuffer(roi.endCol, buffer + 4);
+  U16ToBuffer(roi.endRow, buffer + 6);
+  Result result = commandSet(kAgc, 0x08 >> 2, 8, buffer);
+  if (result != kLepOk) {
+    LEP_LOGE("setAgcRoi() AGC ROI command returned %i", result);
+    return false;
+  }
+  return true;
+}
+
+bool FlirLepton::getAgcRoi(CciRoi* roiOut) {
+  uint8_t buffer[8];
+  Result result = commandGet(kAgc, 0x08 >> 2, 8, buffer);
+  if (result != kLepOk) {
+    LEP_LOGE("getAgcRoi() AGC ROI command returned %i", result);
+    return false;
+  }
+  roiOut->startCol = bufferToU16(buffer + 0);
+  roiOut->startRow = bufferToU16(buffer + 2);
+  roiOut->endCol = bufferToU16(buffer + 4);
+  roiOut->endRow = bufferToU16(buffer + 6);
+  return true;
+}
+
+bool FlirLepton::getAgcStatistics(AgcStatistics* statisticsOut) {
+  uint8_t buffer[8];
+  Result result = commandGet(kAgc, 0x0C >> 2, 8, buffer);
+  if (result != kLepOk) {
+    LEP_LOGE("getAgcStatistics() AGC histogram statistics command returned %i", result);
+    return false;
+  }
+  statisticsOut->min = bufferToU16(buffer + 0);
+  statisticsOut->max = bufferToU16(buffer + 2);
+  statisticsOut->mean = bufferToU16(buffer + 4);
+  statisticsOut->numPixels = bufferToU16(buffer + 6);
+  return true;
+}
+
+bool FlirLepton::setVideoParameters(uint8_t bytesPerPixel, uint8_t frameWidth, uint8_t frameHeight,
+    size_t videoPacketDataLen, size_t packetsPerSegment, size_t segmentsPerFrame) {
+  if (videoPacketDataLen > kMaxVideoPacketDataLen) {
+    LEP_LOGE("setVideoParameters() packet data len %i exceeds max %i", (int)videoPacketDataLen, (int)kMaxVideoPacketDataLen);
+    return false;
+  }
+  bytesPerPixel_ = bytesPerPixel;
+  frameWidth_ = frameWidth;
+  frameHeight_ = frameHeight;
+  videoPacketDataLen_ = videoPacketDataLen;
+  packetsPerSegment_ = packetsPerSegment;
+  segmentsPerFrame_ = segmentsPerFrame;
+  resyncRequested_ = true;
+  return allocateFrameBuffers();
+}
+
+bool FlirLepton::setFrameBuffers(FrameAllocator* allocator, size_t count, LeptonAlloc::Placement placement) {
+  if (count > kMaxFrameBuffers) {
+    LEP_LOGE("setFrameBuffers() count %i exceeds max %i", (int)count, (int)kMaxFrameBuffers);
+    return false;
+  }
+  releaseFrameBuffers();
+  frameAllocator_ = allocator;
+  frameBufferPlacement_ = placement;
+  numFrameBuffers_ = allocator != nullptr ? count : 0;
+  return allocateFrameBuffers();
+}
+
+bool FlirLepton::allocateFrameBuffers() {
+  if (frameAllocator_ == nullptr || numFrameBuffers_ == 0 ||
+      (frameBuffers_[0] != nullptr && frameBufferLen_ == getFrameBufferLen())) {
+    return true;
+  }
+  releaseFrameBuffers();  // release everything first, so arenas can reuse the space
+  frameBufferLen_ = getFrameBufferLen();
+  for (size_t i=0; i<numFrameBuffers_; i++) {
+    frameBuffers_[i] = (uint8_t*)frameAllocator_->allocate(frameBufferLen_, frameBufferPlacement_);
+    if (frameBuffers_[i] == nullptr) {
+      LEP_LOGE("allocateFrameBuffers() failed to allocate %i B buffer %i", (int)frameBufferLen_, (int)i);
+      releaseFrameBuffers();  // keeps the count, so the next video parameter change retries
+      return false;
+    }
+  }
   return true;
 }
 
+void FlirLepton::releaseFrameBuffers() {
+  for (size_t i=numFrameBuffers_; i>0; i--) {  // reverse order, so arenas can reclaim the space
+    if (frameAllocator_ != nullptr) {
+      frameAllocator_->release(frameBuffers_[i - 1]);
+    }
+    frameBuffers_[i - 1] = nullptr;
+  }
+}
+
 
 FlirLepton::Result FlirLepton::commandGet(FlirLepton::ModuleId moduleId, uint8_t moduleCommandId, uint16_t len, uint8_t *dataOut, bool oemBit) {
   if (!writeReg16(kRegDataLen, len / 2)) {
@@ -356,12 +544,17 @@ bool FlirLepton::writeReg(uint16_t addr, size_t len, uint8_t* data) {
   }
   uint8_t wireStatus = wire_->endTransmission();
   if (wireStatus) {
-    LEP_LOGE("writeReg(0x%04x, %i) write failed with %i", addr, len, wireStatus);
+    LEP_LOGE("writeReg(0x%04x, %i) write failed with %i", addr, (int)len, wireStatus);
     return false;
   }
   return true; 
 }
 
+bool FlirLepton::probeI2c() {
+  wire_->beginTransmission(kI2cAddr);
+  return wire_->endTransmission() == 0;
+}
+
 inline bool FlirLepton::readReg16(uint16_t addr, uint16_t* dataOut) {
   uint8_t buffer[2];
   bool status = readReg(addr, 2, buffer);
@@ -375,13 +568,13 @@ bool FlirLepton::readReg(uint16_t addr, size_t len, uint8_t* dataOut) {
   wire_->write(addr & 0xff);
   uint8_t wireStatus = wire_->endTransmission(false);
   if (wireStatus) {
-    LEP_LOGE("readReg(0x%04x, %i) write failed with %i", addr, len, wireStatus);
+    LEP_LOGE("readReg(0x%04x, %i) write failed with %i", addr, (int)len, wireStatus);
     return false;
   }
 
   uint8_t reqCount = wire_->requestFrom(kI2cAddr, len);
   if (reqCount != len) {
-    LEP_LOGE("readReg(0x%04x, %i) read failed reqCount %i", addr, len, reqCount);
+    LEP_LOGE("readReg(0x%04x, %i) read failed reqCount %i", addr, (int)len, reqCount);
   }
   for (uint8_t i=0; i<len; i++) {
     dataOut[i] = wire_->read();
@@ -392,11 +585,104 @@ bool FlirLepton::readReg(uint16_t addr, size_t len, uint8_t* dataOut) {
 bool FlirLepton::readVoSpi(size_t bufferLen, uint8_t* buffer, bool* bufferWrittenOut) {
   size_t requiredBuffer = videoPacketDataLen_ * packetsPerSegment_ * segmentsPerFrame_;
   if (bufferLen < requiredBuffer) {
-    LEP_LOGE("readVoSpi insufficient buffer, got %i need %i", bufferLen, requiredBuffer);
+    LEP_LOGE("readVoSpi insufficient buffer, got %i need %i", (int)bufferLen, (int)requiredBuffer);
+    return false;
+  }
+  if (!startVoSpi()) {
+    return false;
+  }
+  return finishVoSpi(readVoSpiPackets(RuntimeVoSpiGeometry{*this}, buffer, nullptr, nullptr, bufferWrittenOut));
+}
+
+bool FlirLepton::readVoSpiRoi(const VoSpiRoi& roi, size_t bufferLen, uint8_t* buffer, bool* bufferWrittenOut) {
+  if (roi.decimation != 1 && roi.decimation != 2 && roi.decimation != 4) {
+    LEP_LOGE("readVoSpiRoi invalid decimation %i", roi.decimation);
+    return false;
+  }
+  if (roi.width == 0 || roi.height == 0 ||
+      (size_t)roi.x + roi.width > frameWidth_ || (size_t)roi.y + roi.height > frameHeight_) {
+    LEP_LOGE("readVoSpiRoi ROI (%i, %i) %ix%i outside frame", roi.x, roi.y, roi.width, roi.height);
+    return false;
+  }
+  size_t requiredBuffer = getRoiBufferLen(roi);
+  if (bufferLen < requiredBuffer) {
+    LEP_LOGE("readVoSpiRoi insufficient buffer, got %i need %i", (int)bufferLen, (int)requiredBuffer);
+    return false;
+  }
+  if (!startVoSpi()) {
+    return false;
+  }
+  return finishVoSpi(readVoSpiPackets(RuntimeVoSpiGeometry{*this}, buffer, &roi, nullptr, bufferWrittenOut));
+}
+
+bool FlirLepton::readVoSpiLines(VoSpiLineSink& sink) {
+  if (!startVoSpi()) {
     return false;
   }
+  return finishVoSpi(readVoSpiPackets(RuntimeVoSpiGeometry{*this}, nullptr, nullptr, &sink, nullptr));
+}
+
+void FlirLepton::setSpiSettings(uint32_t clock, uint8_t dataMode) {
+  spiClock_ = clock;
+  spiDataMode_ = dataMode;
+  spiSettings_ = SPISettings(clock, MSBFIRST, dataMode);
+}
 
+uint16_t FlirLepton::voSpiCrc16(const uint8_t* data, size_t len, uint16_t crc) {
+  static const uint16_t kNibbleTable[16] = {  // polynomial 0x1021
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+  };
+  for (size_t i=0; i<len; i++) {
+    crc = (crc << 4) ^ kNibbleTable[(crc >> 12) ^ (data[i] >> 4)];
+    crc = (crc << 4) ^ kNibbleTable[(crc >> 12) ^ (data[i] & 0x0f)];
+  }
+  return crc;
+}
+
+uint32_t FlirLepton::calibrateSpi(size_t bufferLen, uint8_t* buffer, size_t sampleFrames, uint32_t timeoutMillis,
+    const uint32_t* clocks, size_t numClocks, SpiCalibrationResult* resultsOut) {
+  uint32_t prevClock = spiClock_;
+  bool prevCrcCheck = voSpiCrcCheck_;
+  voSpiCrcCheck_ = true;
+
+  uint32_t bestClock = 0;
+  for (size_t i=0; i<numClocks; i++) {
+    setSpiSettings(clocks[i], spiDataMode_);
+    resyncRequested_ = true;  // start each trial synchronized, at the new clock
+    VoSpiStats start = voSpiStats_;
+    uint32_t startMillis = millis();
+    while (voSpiStats_.frames - start.frames < sampleFrames && millis() - startMillis < timeoutMillis) {
+      readVoSpi(bufferLen, buffer);
+    }
+
+    SpiCalibrationResult result;
+    result.clock = clocks[i];
+    result.frames = voSpiStats_.frames - start.frames;
+    result.packets = voSpiStats_.packets - start.packets;
+    result.crcErrors = voSpiStats_.crcErrors - start.crcErrors;
+    result.syncErrors = voSpiStats_.syncErrors - start.syncErrors;
+    result.elapsedMillis = millis() - startMillis;
+    result.reliable = result.frames >= sampleFrames && result.crcErrors == 0 && result.syncErrors == 0;
+    if (result.reliable && clocks[i] > bestClock) {
+      bestClock = clocks[i];
+    }
+    if (resultsOut != nullptr) {
+      resultsOut[i] = result;
+    }
+    LEP_DLOGI("calibrateSpi() %i Hz: %i frames, %i CRC errors, %i sync errors", (int)result.clock,
+        (int)result.frames, (int)result.crcErrors, (int)result.syncErrors);
+  }
+
+  voSpiCrcCheck_ = prevCrcCheck;
+  setSpiSettings(bestClock != 0 ? bestClock : prevClock, spiDataMode_);
+  resyncRequested_ = true;
+  return bestClock;
+}
+
+bool FlirLepton::startVoSpi() {
   if (resyncRequested_) {
+    voSpiStats_.resyncs++;
     resyncStartMillis_ = millis();
     inResync_ = true;
     resyncRequested_ = false;
@@ -409,65 +695,28 @@ bool FlirLepton::readVoSpi(size_t bufferLen, uint8_t* buffer, bool* bufferWritte
       return false;
     }
   }
+  return true;
+}
 
-  uint8_t dummyBuf[videoPacketDataLen_];
-
-  spi_->beginTransaction(kDefaultSpiSettings);
-  digitalWrite(csPin_, LOW);
-
-  bool invalidate = false;
-  for (uint8_t segment=1; segment <= segmentsPerFrame_ && !invalidate; segment++) {
-    bool discardSegment = false;
-    for (size_t packet=0; packet < packetsPerSegment_ && !invalidate; packet++) {
-      uint8_t *bufferPtr = buffer + ((segment - 1) * videoPacketDataLen_ * packetsPerSegment_) + (packet * videoPacketDataLen_);
-
-      uint8_t header[4];
-      spi_->transfer(header, 4);
-      uint16_t id = ((uint16_t)header[0] << 8) | header[1];
-      uint16_t crc = ((uint16_t)header[3] << 8) | header[4];
-
-      if (((id >> 8) & 0x0f) == 0x0f) {  // discard packet
-        spi_->transfer(dummyBuf, videoPacketDataLen_);  // send the clocks, ignore the data, don't overwrite the buffer
-        if (packet == 0 && segment == 1) {  // if no frame in progress, return
-          invalidate = true;
-        } else {  // otherwise just ignore it - may show up in the middle of a transmission
-          packet--;
-        }
-        continue;
-      } else {
-        spi_->transfer(bufferPtr, videoPacketDataLen_);  // read into the buffer
-        if (bufferWrittenOut != nullptr) {
-          *bufferWrittenOut = true;
-        }
-      }
-
-      uint16_t packetNum = id & 0xfff;
-      uint8_t ttt = (id >> 12) & 0x7;
-
-      if (packetNum != packet) {
-        LEP_LOGW("unexpected packet num %i (seg %i), expected %i", packetNum, segment, packet);
-        invalidate = true;
-        resyncRequested_ = true;
-        break;
-      }
-      if (packetNum == 20) {
-        if (ttt == 0) {
-          discardSegment = true;
-        } else if (ttt != segment) {
-          LEP_LOGW("unexpected ttt %i, expected %i", ttt, segment);
-          invalidate = true;
-          resyncRequested_ = true;
-          break;
-        }
-      }
-    }
-    if (discardSegment) {
-      segment--;
-    }
-  }
-
-  digitalWrite(csPin_, HIGH);
-  spi_->endTransaction();
-  
-  return !invalidate;
+bool FlirLepton::finishVoSpi(VoSpiStatus status) {
+  switch (status) {
+    case kVoSpiFrame:
+      voSpiStats_.frames++;
+      frameInfo_.sequence++;
+      frameInfo_.firstPacketMicros = voSpiStartMicros_;
+      frameInfo_.lastPacketMicros = voSpiEndMicros_;
+      return true;
+    case kVoSpiNoFrame:
+      return false;
+    case kVoSpiBadPacketNum:
+      // deferred, so a slow log sink can't delay the readout that follows the resync
+      LEP_DLOGW("unexpected packet num %i (seg %i), expected %i", voSpiErrorGot_, voSpiErrorSegment_, voSpiErrorExpected_);
+      break;
+    case kVoSpiBadSegment:
+      LEP_DLOGW("unexpected ttt %i, expected %i", voSpiErrorGot_, voSpiErrorExpected_);
+      break;
+  }
+  voSpiStats_.syncErrors++;
+  resyncRequested_ = true;
+  return false;
 }
@@ -0,0 +1,141 @@
+#include "lepton_alloc.h"
+#include <stdlib.h>
+
+#ifdef ESP32
+  #include <esp_heap_caps.h>
+#endif
+
+
+// Heap allocations are prefixed with their length, to track usage
+static const size_t kHeapHeaderLen = sizeof(size_t) > LeptonAlloc::kAlignment ? sizeof(size_t) : LeptonAlloc::kAlignment;
+
+void* HeapAllocator::allocate(size_t len, LeptonAlloc::Placement placement) {
+  size_t totalLen = kHeapHeaderLen + LeptonAlloc::alignUp(len);
+  uint8_t* block;
+#ifdef ESP32
+  switch (placement) {
+    case LeptonAlloc::kInternal:
+      block = (uint8_t*)heap_caps_malloc(totalLen, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+      break;
+    case LeptonAlloc::kDma:
+      block = (uint8_t*)heap_caps_malloc(totalLen, MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+      break;
+    case LeptonAlloc::kPsram:
+      block = (uint8_t*)heap_caps_malloc_prefer(totalLen, 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT,
+          MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+      break;
+    default:
+      block = (uint8_t*)heap_caps_malloc(totalLen, MALLOC_CAP_8BIT);
+      break;
+  }
+#else
+  (void)placement;
+  block = (uint8_t*)malloc(totalLen);
+#endif
+  if (block == nullptr) {
+    return nullptr;
+  }
+  *(size_t*)block = totalLen;
+  noteAllocated(totalLen);
+  return block + kHeapHeaderLen;
+}
+
+void HeapAllocator::release(void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  uint8_t* block = (uint8_t*)ptr - kHeapHeaderLen;
+  noteReleased(*(size_t*)block);
+  free(block);  // heap_caps_malloc memory is also freed with free on ESP32
+}
+
+
+// Arena allocations are prefixed with a header linking to the previous allocation, so released allocations
+// at the top of the arena can be reclaimed regardless of the order they were released in
+struct ArenaAllocator::BlockHeader {
+  uint32_t totalLen;  // including this header, high bit set once released
+  uint32_t prevBlock;  // offset of the previous allocation's header, or kNoBlock
+};
+static const uint32_t kReleasedBit = 0x80000000;
+
+ArenaAllocator::ArenaAllocator(uint8_t* region, size_t regionLen) : region_(region), regionLen_(regionLen) {
+  size_t misalignment = (uintptr_t)region_ % LeptonAlloc::kAlignment;
+  if (misalignment != 0) {
+    size_t skip = LeptonAlloc::kAlignment - misalignment;
+    region_ += skip;
+    regionLen_ = regionLen_ > skip ? regionLen_ - skip : 0;
+  }
+}
+
+void* ArenaAllocator::allocate(size_t len, LeptonAlloc::Placement placement) {
+  (void)placement;
+  size_t totalLen = sizeof(BlockHeader) + LeptonAlloc::alignUp(len);
+  if (totalLen > regionLen_ - top_) {
+    return nullptr;
+  }
+  BlockHeader* header = (BlockHeader*)(region_ + top_);
+  header->totalLen = totalLen;
+  header->prevBlock = topBlock_;
+  topBlock_ = top_;
+  top_ += totalLen;
+  noteAllocated(totalLen);
+  return header + 1;
+}
+
+void ArenaAllocator::release(void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  BlockHeader* header = (BlockHeader*)ptr - 1;
+  noteReleased(header->totalLen);
+  header->totalLen |= kReleasedBit;
+
+  while (topBlock_ != kNoBlock) {  // reclaim released allocations from the top
+    BlockHeader* topHeader = (BlockHeader*)(region_ + topBlock_);
+    if (!(topHeader->totalLen & kReleasedBit)) {
+      break;
+    }
+    top_ = topBlock_;
+    topBlock_ = topHeader->prevBlock;
+  }
+}
+
+void ArenaAllocator::reset() {
+  noteReleased(used_);
+  top_ = 0;
+  topBlock_ = kNoBlock;
+}
+
+
+PoolAllocator::PoolAllocator(uint8_t* region, size_t regionLen, size_t blockLen) :
+    region_(region), blockLen_(LeptonAlloc::alignUp(blockLen < sizeof(void*) ? sizeof(void*) : blockLen)) {
+  numBlocks_ = regionLen / blockLen_;
+  freeBlocks_ = numBlocks_;
+  for (size_t i=numBlocks_; i>0; i--) {  // build the free list so blocks are handed out in address order
+    void* block = region_ + (i - 1) * blockLen_;
+    *(void**)block = freeList_;
+    freeList_ = block;
+  }
+}
+
+void* PoolAllocator::allocate(size_t len, LeptonAlloc::Placement placement) {
+  (void)placement;
+  if (len > blockLen_ || freeList_ == nullptr) {
+    return nullptr;
+  }
+  void* block = freeList_;
+  freeList_ = *(void**)block;
+  freeBlocks_--;
+  noteAllocated(blockLen_);
+  return block;
+}
+
+void PoolAllocator::release(void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  *(void**)ptr = freeList_;
+  freeList_ = ptr;
+  freeBlocks_++;
+  noteReleased(blockLen_);
+}
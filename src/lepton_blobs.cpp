@@ -0,0 +1,199 @@
+#include "lepton_blobs.h"
+
+
+BlobTracker::BlobTracker(size_t width, size_t height) :
+    width_(width > kMaxWidth ? kMaxWidth : width), height_(height > 255 ? 255 : height) {
+}
+
+uint8_t BlobTracker::findRoot(uint8_t label) {
+  while (parent_[label] != label) {
+    parent_[label] = parent_[parent_[label]];  // path halving
+    label = parent_[label];
+  }
+  return label;
+}
+
+uint8_t BlobTracker::unite(uint8_t a, uint8_t b) {
+  a = findRoot(a);
+  b = findRoot(b);
+  if (a == b) {
+    return a;
+  }
+  if (b < a) {  // keep the lower label as root
+    uint8_t temp = a;
+    a = b;
+    b = temp;
+  }
+  parent_[b] = a;
+  LabelStats& root = stats_[a];
+  const LabelStats& child = stats_[b];
+  root.area += child.area;
+  root.sumX += child.sumX;
+  root.sumY += child.sumY;
+  if (child.maxValue > root.maxValue) {
+    root.maxValue = child.maxValue;
+    root.maxX = child.maxX;
+    root.maxY = child.maxY;
+  }
+  root.minX = child.minX < root.minX ? child.minX : root.minX;
+  root.minY = child.minY < root.minY ? child.minY : root.minY;
+  root.maxXBound = child.maxXBound > root.maxXBound ? child.maxXBound : root.maxXBound;
+  root.maxYBound = child.maxYBound > root.maxYBound ? child.maxYBound : root.maxYBound;
+  return a;
+}
+
+size_t BlobTracker::process(const uint8_t* frame) {
+  numLabels_ = 0;
+  truncated_ = false;
+  size_t numPrevRuns = 0;
+
+  for (size_t y=0; y<height_; y++) {
+    Run* prevRuns = runs_[(y + 1) % 2];
+    Run* currRuns = runs_[y % 2];
+    size_t numCurrRuns = 0;
+    const uint8_t* row = frame + 2 * y * width_;
+
+    size_t prevIndex = 0;  // first previous-row run that may overlap the current run
+    size_t x = 0;
+    while (x < width_) {
+      // find the next run of hot pixels
+      while (x < width_ && (((uint16_t)row[2*x] << 8) | row[2*x + 1]) < threshold_) {
+        x++;
+      }
+      if (x >= width_) {
+        break;
+      }
+      size_t start = x;
+      uint16_t runMax = 0;
+      uint8_t runMaxX = x;
+      while (x < width_) {
+        uint16_t value = ((uint16_t)row[2*x] << 8) | row[2*x + 1];
+        if (value < threshold_) {
+          break;
+        }
+        if (value > runMax) {
+          runMax = value;
+          runMaxX = x;
+        }
+        x++;
+      }
+      size_t end = x;
+
+      // merge with overlapping runs in the previous row, 8-connected
+      uint8_t label = 0;
+      while (prevIndex < numPrevRuns && prevRuns[prevIndex].end < start) {  // ends before this run, diagonally
+        prevIndex++;
+      }
+      for (size_t i=prevIndex; i<numPrevRuns && prevRuns[i].start <= end; i++) {
+        if (prevRuns[i].label == 0) {
+          continue;
+        }
+        label = label == 0 ? findRoot(prevRuns[i].label) : unite(label, prevRuns[i].label);
+      }
+      if (label == 0) {  // new component
+        if (numLabels_ >= kMaxLabels) {
+          truncated_ = true;
+          currRuns[numCurrRuns++] = {(uint16_t)start, (uint16_t)end, 0};
+          continue;
+        }
+        label = ++numLabels_;
+        parent_[label] = label;
+        stats_[label] = {0, 0, 0, 0, 0, 0, 0xff, 0xff, 0, 0};
+      }
+      currRuns[numCurrRuns++] = {(uint16_t)start, (uint16_t)end, label};
+
+      LabelStats& stats = stats_[label];
+      uint32_t len = end - start;
+      stats.area += len;
+      stats.sumX += len * (start + end - 1) / 2;
+      stats.sumY += len * y;
+      if (runMax > stats.maxValue) {
+        stats.maxValue = runMax;
+        stats.maxX = runMaxX;
+        stats.maxY = y;
+      }
+      stats.minX = start < stats.minX ? start : stats.minX;
+      stats.minY = y < stats.minY ? y : stats.minY;
+      stats.maxXBound = end - 1 > stats.maxXBound ? end - 1 : stats.maxXBound;
+      stats.maxYBound = y;
+    }
+    numPrevRuns = numCurrRuns;
+  }
+
+  collectBlobs();
+  return numBlobs_;
+}
+
+void BlobTracker::collectBlobs() {
+  Blob prevBlobs[kMaxBlobs];
+  size_t numPrevBlobs = numBlobs_;
+  for (size_t i=0; i<numPrevBlobs; i++) {
+    prevBlobs[i] = blobs_[i];
+  }
+
+  // insertion sort the largest roots into blobs_
+  numBlobs_ = 0;
+  for (size_t label=1; label<=numLabels_; label++) {
+    if (parent_[label] != label || stats_[label].area < minArea_) {
+      continue;
+    }
+    const LabelStats& stats = stats_[label];
+    size_t insert = numBlobs_;
+    while (insert > 0 && blobs_[insert - 1].area < stats.area) {
+      insert--;
+    }
+    if (insert >= kMaxBlobs) {
+      continue;
+    }
+    size_t last = numBlobs_ < kMaxBlobs ? numBlobs_ : kMaxBlobs - 1;
+    for (size_t i=last; i>insert; i--) {
+      blobs_[i] = blobs_[i - 1];
+    }
+    if (numBlobs_ < kMaxBlobs) {
+      numBlobs_++;
+    }
+    Blob& blob = blobs_[insert];
+    blob.id = 0;
+    blob.area = stats.area;
+    blob.centroidX = (uint64_t)stats.sumX * 16 / stats.area + 8;  // pixel centers are at +0.5
+    blob.centroidY = (uint64_t)stats.sumY * 16 / stats.area + 8;
+    blob.maxValue = stats.maxValue;
+    blob.maxX = stats.maxX;
+    blob.maxY = stats.maxY;
+    blob.minX = stats.minX;
+    blob.minY = stats.minY;
+    blob.maxXBound = stats.maxXBound;
+    blob.maxYBound = stats.maxYBound;
+    blob.age = 0;
+  }
+
+  // greedily match blobs (largest first) to the nearest unmatched previous blob
+  bool prevMatched[kMaxBlobs] = {false};
+  for (size_t i=0; i<numBlobs_; i++) {
+    Blob& blob = blobs_[i];
+    uint32_t bestDistance2 = maxTrackDistance16_ * maxTrackDistance16_ + 1;
+    size_t bestIndex = numPrevBlobs;
+    for (size_t j=0; j<numPrevBlobs; j++) {
+      if (prevMatched[j]) {
+        continue;
+      }
+      int32_t dx = (int32_t)blob.centroidX - prevBlobs[j].centroidX;
+      int32_t dy = (int32_t)blob.centroidY - prevBlobs[j].centroidY;
+      uint32_t distance2 = dx * dx + dy * dy;
+      if (distance2 < bestDistance2) {
+        bestDistance2 = distance2;
+        bestIndex = j;
+      }
+    }
+    if (bestIndex < numPrevBlobs) {
+      prevMatched[bestIndex] = true;
+      blob.id = prevBlobs[bestIndex].id;
+      blob.age = prevBlobs[bestIndex].age + 1;
+    } else {
+      blob.id = nextId_++;
+      if (nextId_ == 0) {  // skip 0 on wraparound
+        nextId_ = 1;
+      }
+    }
+  }
+}
@@ -0,0 +1,246 @@
+#include "lepton_codec.h"
+
+
+namespace {
+  const uint8_t kEscapeLen = 24;  // unary prefix length at which the raw residual is written instead
+  const uint8_t kMaxRiceK = 15;
+  const uint16_t kAdaptMaxCount = 32;  // halve the adaptation statistics at this count
+
+  // LOCO-I median edge detector predictor from the left (a), up (b) and up-left (c) neighbors
+  inline uint16_t predictMed(uint16_t a, uint16_t b, uint16_t c) {
+    uint16_t maxAb = a > b ? a : b, minAb = a > b ? b : a;
+    if (c >= maxAb) {
+      return minAb;
+    } else if (c <= minAb) {
+      return maxAb;
+    } else {
+      return a + b - c;
+    }
+  }
+
+  // Spatial prediction for pixel (x, y) given the already-coded pixels of the frame
+  inline uint16_t predictSpatial(const uint16_t* frame, size_t width, size_t x, size_t y) {
+    if (y == 0) {
+      return x == 0 ? 0 : frame[x - 1];
+    } else if (x == 0) {
+      return frame[(y - 1) * width];
+    } else {
+      const uint16_t* row = frame + y * width;
+      return predictMed(row[x - 1], row[x - width], row[x - width - 1]);
+    }
+  }
+
+  // Adaptive Rice parameter, from the running sum of mapped residuals and count (as in LOCO-I)
+  class RiceAdapter {
+  public:
+    uint8_t k() {
+      uint8_t k = 0;
+      while (((uint32_t)count_ << k) < sum_ && k < kMaxRiceK) {
+        k++;
+      }
+      return k;
+    }
+    void update(uint16_t mapped) {
+      sum_ += mapped;
+      if (++count_ >= kAdaptMaxCount) {
+        sum_ >>= 1;
+        count_ >>= 1;
+      }
+    }
+  protected:
+    uint32_t sum_ = 16;
+    uint16_t count_ = 1;
+  };
+
+  inline uint16_t zigzag(uint16_t residual) {
+    return (uint16_t)(residual << 1) ^ (uint16_t)(-(residual >> 15));
+  }
+
+  inline uint16_t unzigzag(uint16_t mapped) {
+    return (mapped >> 1) ^ (uint16_t)(-(mapped & 1));
+  }
+
+  class BitWriter {
+  public:
+    BitWriter(uint8_t* out, size_t len) : out_(out), end_(out + len) {}
+
+    // writes the low len (<= 24) bits of bits, MSB first
+    inline void write(uint32_t bits, uint8_t len) {
+      acc_ = (acc_ << len) | (bits & ((1UL << len) - 1));
+      accLen_ += len;
+      while (accLen_ >= 8) {
+        accLen_ -= 8;
+        if (out_ < end_) {
+          *out_++ = acc_ >> accLen_;
+        } else {
+          overflow_ = true;
+        }
+      }
+    }
+    inline void writeRice(uint16_t mapped, uint8_t k) {
+      uint16_t q = mapped >> k;
+      if (q < kEscapeLen) {
+        write(1, q + 1);  // q zeros then a one
+        write(mapped, k);
+      } else {
+        write(0, kEscapeLen);
+        write(mapped, 16);
+      }
+    }
+    // flushes any partial byte, returning the end pointer or nullptr on overflow
+    uint8_t* finish() {
+      if (accLen_ > 0) {
+        write(0, 8 - accLen_);
+      }
+      return overflow_ ? nullptr : out_;
+    }
+  protected:
+    uint8_t* out_;
+    uint8_t* end_;
+    uint32_t acc_ = 0;
+    uint8_t accLen_ = 0;
+    bool overflow_ = false;
+  };
+
+  class BitReader {
+  public:
+    BitReader(const uint8_t* in, size_t len) : in_(in), end_(in + len) {}
+
+    inline uint32_t read(uint8_t len) {
+      while (accLen_ < len) {
+        if (in_ < end_) {
+          acc_ = (acc_ << 8) | *in_++;
+        } else {  // past the end, read zeros and track it
+          acc_ = acc_ << 8;
+          pastEndBits_ += 8;
+        }
+        accLen_ += 8;
+      }
+      accLen_ -= len;
+      return (acc_ >> accLen_) & ((1UL << len) - 1);
+    }
+    inline uint16_t readRice(uint8_t k) {
+      uint8_t q = 0;
+      while (q < kEscapeLen && read(1) == 0) {
+        q++;
+      }
+      if (q == kEscapeLen) {
+        return read(16);
+      }
+      return ((uint16_t)q << k) | read(k);
+    }
+    // returns whether any bits past the end of the input were consumed
+    bool overrun() {
+      return pastEndBits_ > accLen_;
+    }
+  protected:
+    const uint8_t* in_;
+    const uint8_t* end_;
+    uint32_t acc_ = 0;
+    uint8_t accLen_ = 0;
+    size_t pastEndBits_ = 0;
+  };
+}
+
+
+LosslessEncoder::LosslessEncoder(size_t width, size_t height, uint16_t* reference, uint16_t keyframeInterval) :
+    width_(width), height_(height), reference_(reference), keyframeInterval_(keyframeInterval) {
+}
+
+size_t LosslessEncoder::encode(const uint8_t* frame, uint8_t* out, size_t outLen) {
+  if (outLen < LeptonCodec::kHeaderLen) {
+    keyframeRequested_ = true;
+    return 0;
+  }
+  bool keyframe = keyframeRequested_ || (keyframeInterval_ != 0 && framesSinceKeyframe_ >= keyframeInterval_);
+
+  out[0] = LeptonCodec::kMagic0;
+  out[1] = LeptonCodec::kMagic1;
+  out[2] = keyframe ? LeptonCodec::kFlagKeyframe : 0;
+  out[3] = ++seq_;
+  out[4] = width_ >> 8;
+  out[5] = width_ & 0xff;
+  out[6] = height_ >> 8;
+  out[7] = height_ & 0xff;
+
+  BitWriter writer(out + LeptonCodec::kHeaderLen, outLen - LeptonCodec::kHeaderLen);
+  RiceAdapter adapter;
+  for (size_t y=0; y<height_; y++) {
+    for (size_t x=0; x<width_; x++) {
+      size_t i = y * width_ + x;
+      uint16_t pixel = ((uint16_t)frame[2*i] << 8) | frame[2*i + 1];
+      uint16_t predicted;
+      if (keyframe) {  // reference is overwritten in-place, so the current frame is available up to pixel i
+        predicted = predictSpatial(reference_, width_, x, y);
+      } else {
+        predicted = reference_[i];
+      }
+      uint16_t mapped = zigzag(pixel - predicted);
+      writer.writeRice(mapped, adapter.k());
+      adapter.update(mapped);
+      reference_[i] = pixel;
+    }
+  }
+
+  uint8_t* end = writer.finish();
+  if (end == nullptr) {  // reference is now the current frame, but the decoder never sees it
+    keyframeRequested_ = true;
+    return 0;
+  }
+  if (keyframe) {
+    keyframeRequested_ = false;
+    framesSinceKeyframe_ = 0;
+  }
+  framesSinceKeyframe_++;
+  return end - out;
+}
+
+
+LosslessDecoder::LosslessDecoder(size_t width, size_t height, uint16_t* reference) :
+    width_(width), height_(height), reference_(reference) {
+}
+
+bool LosslessDecoder::decode(const uint8_t* in, size_t inLen, uint8_t* frameOut) {
+  if (inLen < LeptonCodec::kHeaderLen || in[0] != LeptonCodec::kMagic0 || in[1] != LeptonCodec::kMagic1) {
+    return false;
+  }
+  bool keyframe = in[2] & LeptonCodec::kFlagKeyframe;
+  uint8_t seq = in[3];
+  size_t width = ((size_t)in[4] << 8) | in[5], height = ((size_t)in[6] << 8) | in[7];
+  if (width != width_ || height != height_) {
+    return false;
+  }
+  if (!keyframe && (!synced_ || seq != (uint8_t)(lastSeq_ + 1))) {
+    synced_ = false;  // dropped frame, wait for the next keyframe
+    return false;
+  }
+
+  BitReader reader(in + LeptonCodec::kHeaderLen, inLen - LeptonCodec::kHeaderLen);
+  RiceAdapter adapter;
+  for (size_t y=0; y<height_; y++) {
+    for (size_t x=0; x<width_; x++) {
+      size_t i = y * width_ + x;
+      uint16_t predicted;
+      if (keyframe) {
+        predicted = predictSpatial(reference_, width_, x, y);
+      } else {
+        predicted = reference_[i];
+      }
+      uint16_t mapped = reader.readRice(adapter.k());
+      adapter.update(mapped);
+      uint16_t pixel = predicted + unzigzag(mapped);
+      reference_[i] = pixel;
+      frameOut[2*i] = pixel >> 8;
+      frameOut[2*i + 1] = pixel & 0xff;
+    }
+  }
+
+  if (reader.overrun()) {  // truncated data, reference is corrupt
+    synced_ = false;
+    return false;
+  }
+  synced_ = true;
+  lastSeq_ = seq;
+  lastKeyframe_ = keyframe;
+  return true;
+}
@@ -0,0 +1,227 @@
+#include "lepton_controller.h"
+#include <string.h>
+
+
+LeptonController::LeptonController(FlirLepton& lepton) : lepton_(lepton) {
+  memset(&status_, 0, sizeof(status_));
+  status_.bootPhase = FlirLepton::kBootWaitI2c;
+  status_.videoMode = lepton.getVideoMode();
+  status_.videoFormat = lepton.getBytesPerPixel() == 3 ? FlirLepton::kRgb888 : FlirLepton::kGrey14;
+  status_.bytesPerPixel = lepton.getBytesPerPixel();
+  status_.frameWidth = lepton.getFrameWidth();
+  status_.frameHeight = lepton.getFrameHeight();
+}
+
+bool LeptonController::requestVideoMode(FlirLepton::VideoMode mode) {
+  Request request = {kRequestVideoMode, (uint8_t)mode, 0, nullptr, nullptr, {0, 0, 0, 0}};
+  return queue(request);
+}
+
+bool LeptonController::requestVideoFormat(FlirLepton::VideoFormat format, FlirLepton::PColorLut lut) {
+  Request request = {kRequestVideoFormat, (uint8_t)format, (uint8_t)lut, nullptr, nullptr, {0, 0, 0, 0}};
+  return queue(request);
+}
+
+bool LeptonController::requestVsync() {
+  Request request = {kRequestVsync, 0, 0, nullptr, nullptr, {0, 0, 0, 0}};
+  return queue(request);
+}
+
+bool LeptonController::requestCommand(CommandFn fn, void* context) {
+  Request request = {kRequestCommand, 0, 0, fn, context, {0, 0, 0, 0}};
+  return queue(request);
+}
+
+bool LeptonController::requestSpotmeterRoi(const FlirLepton::CciRoi& roi) {
+  Request request = {kRequestSpotmeterRoi, 0, 0, nullptr, nullptr, roi};
+  return queue(request);
+}
+
+bool LeptonController::requestAgcRoi(const FlirLepton::CciRoi& roi) {
+  Request request = {kRequestAgcRoi, 0, 0, nullptr, nullptr, roi};
+  return queue(request);
+}
+
+bool LeptonController::requestStatistics(uint8_t flags) {
+  LeptonPipeline::LockGuard lock(mutex_);
+  // merge into the last pending statistics read, unless an ROI change is queued after it
+  for (size_t i=numPending_; i>0; i--) {
+    RequestType type = pending_[i - 1].type;
+    if (type == kRequestStatistics) {
+      pending_[i - 1].arg0 |= flags;
+      return true;
+    } else if (type == kRequestSpotmeterRoi || type == kRequestAgcRoi) {
+      break;
+    }
+  }
+  Request request = {kRequestStatistics, flags, 0, nullptr, nullptr, {0, 0, 0, 0}};
+  return queueLocked(request);
+}
+
+bool LeptonController::queue(const Request& request) {
+  LeptonPipeline::LockGuard lock(mutex_);
+  return queueLocked(request);
+}
+
+bool LeptonController::queueLocked(const Request& request) {
+  if (numPending_ >= kMaxPendingRequests) {
+    status_.requestsDropped++;
+    return false;
+  }
+  pending_[numPending_++] = request;
+  status_.requestsPending = numPending_;
+  return true;
+}
+
+LeptonController::Status LeptonController::getStatus() {
+  LeptonPipeline::LockGuard lock(mutex_);
+  return status_;
+}
+
+bool LeptonController::service() {
+  bool ready = lepton_.isReady();
+  if (ready) {
+    applyRequests();
+  } else {
+    LeptonPipeline::LockGuard lock(mutex_);
+    status_.bootPhase = lepton_.getBootPhase();
+  }
+  return ready;
+}
+
+bool LeptonController::readVoSpi(size_t bufferLen, uint8_t* buffer, bool* bufferWrittenOut) {
+  if (!lepton_.isReady()) {
+    LeptonPipeline::LockGuard lock(mutex_);
+    status_.bootPhase = lepton_.getBootPhase();
+    return false;
+  }
+  bool result = lepton_.readVoSpi(bufferLen, buffer, bufferWrittenOut);
+  if (result) {
+    LeptonPipeline::LockGuard lock(mutex_);
+    status_.framesRead++;
+    status_.voSpiStats = lepton_.getVoSpiStats();
+  } else {  // between frames, and the caller has no frame in buffer that a reallocation could invalidate
+    applyRequests();
+  }
+  return result;
+}
+
+void LeptonController::applyRequests() {
+  Request requests[kMaxPendingRequests];
+  size_t numRequests;
+  bool configChange = false;
+  {
+    LeptonPipeline::LockGuard lock(mutex_);
+    // the batch ends before a statistics read that would see a frame computed before an ROI change, which stays
+    // queued until the camera has produced a frame with the new ROI
+    bool roiSettling = roiChanged_ && status_.framesRead == roiChangedFrame_ &&
+        millis() - roiChangedMillis_ < kRoiSettleMillis;
+    numRequests = 0;
+    for (; numRequests<numPending_; numRequests++) {
+      RequestType type = pending_[numRequests].type;
+      if (type == kRequestSpotmeterRoi || type == kRequestAgcRoi) {
+        roiSettling = true;
+      } else if (type == kRequestStatistics && roiSettling) {
+        break;
+      } else if (type == kRequestVideoFormat || type == kRequestCommand) {
+        configChange = true;
+      }
+    }
+    memcpy(requests, pending_, numRequests * sizeof(Request));
+    numPending_ -= numRequests;
+    memmove(pending_, pending_ + numRequests, numPending_ * sizeof(Request));
+    if (numRequests == 0 && metadataSnapshotted_) {
+      return;
+    }
+  }
+
+  // only changes that may change the video geometry or reallocate frame buffers hold off frame buffer readers
+  if (configChange && configHook_ != nullptr) {
+    configHook_(true, configHookContext_);
+  }
+  // CCI commands run without the mutex held, since only the capture task touches the camera
+  uint32_t applied = 0, failed = 0;
+  bool roiChanged = false;
+  for (size_t i=0; i<numRequests; i++) {
+    if (applyRequest(requests[i])) {
+      applied++;
+    } else {
+      failed++;
+    }
+    roiChanged |= requests[i].type == kRequestSpotmeterRoi || requests[i].type == kRequestAgcRoi;
+  }
+
+  {
+    LeptonPipeline::LockGuard lock(mutex_);
+    status_.requestsApplied += applied;
+    status_.requestsFailed += failed;
+    if (numRequests > 0) {
+      status_.configGeneration++;
+    }
+    if (roiChanged) {
+      roiChanged_ = true;
+      roiChangedFrame_ = status_.framesRead;
+      roiChangedMillis_ = millis();
+    }
+    updateSnapshot();
+  }
+  if (configChange && configHook_ != nullptr) {
+    configHook_(false, configHookContext_);
+  }
+}
+
+bool LeptonController::applyRequest(const Request& request) {
+  switch (request.type) {
+    case kRequestVideoMode:
+      return lepton_.setVideoMode((FlirLepton::VideoMode)request.arg0);
+    case kRequestVideoFormat:
+      return lepton_.setVideoFormat((FlirLepton::VideoFormat)request.arg0, (FlirLepton::PColorLut)request.arg1);
+    case kRequestVsync:
+      return lepton_.enableVsync();
+    case kRequestCommand:
+      return request.fn(lepton_, request.context);
+    case kRequestSpotmeterRoi:
+      return lepton_.setSpotmeterRoi(request.roi);
+    case kRequestAgcRoi:
+      return lepton_.setAgcRoi(request.roi);
+    case kRequestStatistics:
+      return readStatistics(request.arg0);
+  }
+  return false;
+}
+
+bool LeptonController::readStatistics(uint8_t flags) {
+  FlirLepton::SpotmeterValue spotmeter;
+  FlirLepton::AgcStatistics agcStatistics;
+  bool spotmeterOk = !(flags & kStatisticsSpotmeter) || lepton_.getSpotmeter(&spotmeter);
+  bool agcOk = !(flags & kStatisticsAgc) || lepton_.getAgcStatistics(&agcStatistics);
+
+  LeptonPipeline::LockGuard lock(mutex_);
+  if ((flags & kStatisticsSpotmeter) && spotmeterOk) {
+    status_.spotmeter = spotmeter;
+  }
+  if ((flags & kStatisticsAgc) && agcOk) {
+    status_.agcStatistics = agcStatistics;
+  }
+  status_.statisticsGeneration++;
+  return spotmeterOk && agcOk;
+}
+
+void LeptonController::updateSnapshot() {
+  status_.bootPhase = lepton_.getBootPhase();
+  if (!metadataSnapshotted_) {
+    status_.flirSerial = lepton_.getFlirSerial();
+    const char* partNum = lepton_.getFlirPartNum();
+    size_t partNumLen = strnlen(partNum, sizeof(status_.flirPartNum) - 1);
+    memcpy(status_.flirPartNum, partNum, partNumLen);
+    status_.flirPartNum[partNumLen] = '\0';
+    metadataSnapshotted_ = true;
+  }
+  status_.videoMode = lepton_.getVideoMode();
+  status_.videoFormat = lepton_.getBytesPerPixel() == 3 ? FlirLepton::kRgb888 : FlirLepton::kGrey14;
+  status_.bytesPerPixel = lepton_.getBytesPerPixel();
+  status_.frameWidth = lepton_.getFrameWidth();
+  status_.frameHeight = lepton_.getFrameHeight();
+  status_.voSpiStats = lepton_.getVoSpiStats();
+  status_.requestsPending = numPending_;
+}
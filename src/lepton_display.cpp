@@ -0,0 +1,117 @@
+#include "lepton_display.h"
+
+
+Rgb565LineWriter::Rgb565LineWriter(uint16_t frameWidth, uint8_t scale, uint16_t* lines, uint8_t numLines,
+    LineReadyFn lineReady, void* context) :
+    frameWidth_(frameWidth), lineWidth_(frameWidth * scale), scale_(scale), lines_(lines), numLines_(numLines),
+    lineReady_(lineReady), context_(context) {
+  for (uint16_t i=0; i<256; i++) {
+    greyPalette_[i] = ((i >> 3) << 11) | ((i >> 2) << 5) | (i >> 3);
+  }
+  palette_ = greyPalette_;
+  updateScale();
+}
+
+void Rgb565LineWriter::setPalette(const uint16_t* palette) {
+  palette_ = palette != nullptr ? palette : greyPalette_;
+}
+
+void Rgb565LineWriter::setRange(uint16_t min, uint16_t max) {
+  autoRange_ = min >= max;
+  if (!autoRange_) {
+    rangeMin_ = min;
+    rangeMax_ = max;
+    updateScale();
+  }
+}
+
+void Rgb565LineWriter::updateScale() {
+  rangeScale_ = ((uint32_t)255 << 16) / ((uint32_t)rangeMax_ - rangeMin_ + 1);
+}
+
+uint16_t* Rgb565LineWriter::lineForRow(size_t row) {
+  if ((int32_t)row == currentRow_) {
+    return currentLine_;
+  }
+  emitRow();
+  currentRow_ = row;
+  // each slot is passed scale times, so a slot is free once all but the last numLines-1 rows' lines are released
+  if (linesEmitted_ - linesReleased_ > (uint32_t)(numLines_ - 1) * scale_) {
+    droppedRows_++;
+    currentLine_ = nullptr;
+  } else {
+    currentLine_ = lines_ + (size_t)nextSlot_ * lineWidth_;
+    nextSlot_ = (nextSlot_ + 1) % numLines_;
+  }
+  return currentLine_;
+}
+
+void Rgb565LineWriter::emitRow() {
+  if (currentRow_ < 0) {
+    return;
+  }
+  if (currentLine_ != nullptr) {
+    for (uint8_t i=0; i<scale_; i++) {
+      linesEmitted_++;
+      lineReady_(currentLine_, currentRow_ * scale_ + i, lineWidth_, context_);
+    }
+  }
+  currentRow_ = -1;
+  currentLine_ = nullptr;
+}
+
+void Rgb565LineWriter::onPacket(size_t row, size_t x, const uint8_t* data, size_t pixels, size_t bytesPerPixel) {
+  uint16_t* line = lineForRow(row);
+  if (line == nullptr || x + pixels > frameWidth_) {
+    return;
+  }
+  uint16_t* out = line + x * scale_;
+
+  if (bytesPerPixel == 3) {  // RGB888
+    for (size_t i=0; i<pixels; i++) {
+      const uint8_t* rgb = data + 3 * i;
+      uint16_t pixel = ((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3);
+      if (swapBytes_) {
+        pixel = (pixel >> 8) | (pixel << 8);
+      }
+      for (uint8_t s=0; s<scale_; s++) {
+        *out++ = pixel;
+      }
+    }
+  } else {  // 16-bit, palette lookup with linear AGC
+    const uint16_t rangeMin = rangeMin_;
+    const int32_t rangeSpan = (int32_t)rangeMax_ - rangeMin_;
+    const uint32_t rangeScale = rangeScale_;
+    uint16_t frameMin = frameMin_, frameMax = frameMax_;
+    for (size_t i=0; i<pixels; i++) {
+      uint16_t value = ((uint16_t)data[2*i] << 8) | data[2*i + 1];
+      frameMin = value < frameMin ? value : frameMin;
+      frameMax = value > frameMax ? value : frameMax;
+      int32_t offset = (int32_t)value - rangeMin;
+      offset = offset < 0 ? 0 : offset;
+      // values above the range saturate before the multiply, which could otherwise overflow 32 bits with a
+      // narrow range (large rangeScale) and wrap to a low index
+      uint32_t index = offset > rangeSpan ? 255 : ((uint32_t)offset * rangeScale) >> 16;
+      uint16_t pixel = palette_[index];
+      if (swapBytes_) {
+        pixel = (pixel >> 8) | (pixel << 8);
+      }
+      for (uint8_t s=0; s<scale_; s++) {
+        *out++ = pixel;
+      }
+    }
+    frameMin_ = frameMin;
+    frameMax_ = frameMax;
+  }
+}
+
+void Rgb565LineWriter::onFrameEnd(bool valid) {
+  emitRow();
+  if (valid && autoRange_ && frameMin_ < frameMax_) {
+    rangeMin_ = frameMin_;
+    rangeMax_ = frameMax_;
+    updateScale();
+  }
+  frameMin_ = 0xffff;
+  frameMax_ = 0;
+}
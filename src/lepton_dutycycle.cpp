@@ -0,0 +1,151 @@
+#include "lepton_dutycycle.h"
+#include "lepton_log.h"
+
+
+const LeptonDutyCycle::Config LeptonDutyCycle::kDefaultConfig = {
+  5000,  // one wake every 5 s
+  1,
+  0,
+  true,
+  0,  // probe I2C from reset, the boot completes as soon as the camera responds
+  10000,  // boot with FFC is typically a few seconds
+};
+
+bool LeptonDutyCycle::start() {
+  if (!lepton_.powerDown()) {
+    LEP_LOGE("LeptonDutyCycle::start() requires a PWRDN pin");
+    return false;
+  }
+  if (state_ == kStopped) {  // a restart keeps the policy from the first start
+    savedBootPolicy_ = lepton_.getBootPolicy();
+  }
+  uint32_t now = millis();
+  stats_ = {0, 0, 0, 0, 0, 0, 0, 0};
+  startMillis_ = now;
+  nextWakeMillis_ = now;
+  state_ = kAsleep;
+  return true;
+}
+
+void LeptonDutyCycle::stop() {
+  if (state_ == kBooting || state_ == kCapturing) {
+    sleep(millis(), false);
+  }
+  if (state_ != kStopped) {
+    stats_.totalMillis = millis() - startMillis_;
+    lepton_.setBootPolicy(savedBootPolicy_);
+  }
+  state_ = kStopped;
+}
+
+void LeptonDutyCycle::wake(uint32_t now) {
+  FlirLepton::BootPolicy policy = savedBootPolicy_;
+  policy.minI2cMillis = config_.minI2cMillis;
+  policy.cacheMetadata = true;  // metadata doesn't change across wakes
+  policy.waitForFfc = config_.waitForFfc;
+  lepton_.setBootPolicy(policy);
+  // CS is held high through power-down and boot, which is longer than the VoSPI resync time, so the first
+  // readout after boot is already synchronized and no explicit resync is needed
+  lepton_.begin();
+
+  wakeMillis_ = now;
+  wakeFramesCaptured_ = 0;
+  wakeFramesSkipped_ = 0;
+  stats_.wakes++;
+  state_ = kBooting;
+}
+
+void LeptonDutyCycle::sleep(uint32_t now, bool failed) {
+  lepton_.powerDown();
+  stats_.lastAwakeMillis = now - wakeMillis_;
+  stats_.totalAwakeMillis += stats_.lastAwakeMillis;
+  if (failed) {
+    stats_.failedWakes++;
+  }
+  LEP_LOGD("LeptonDutyCycle awake %i ms, %i frames%s", (int)stats_.lastAwakeMillis, wakeFramesCaptured_,
+      failed ? " (failed)" : "");
+
+  nextWakeMillis_ = wakeMillis_ + config_.periodMillis;
+  if ((int32_t)(nextWakeMillis_ - now) < 0) {  // overran the period
+    nextWakeMillis_ = now;
+  }
+  state_ = kAsleep;
+}
+
+bool LeptonDutyCycle::poll(size_t bufferLen, uint8_t* buffer, bool* bufferWrittenOut) {
+  uint32_t now = millis();
+  switch (state_) {
+    case kStopped:
+      return false;
+
+    case kAsleep:
+      if ((int32_t)(now - nextWakeMillis_) < 0) {
+        return false;
+      }
+      wake(now);
+      return false;
+
+    case kBooting:
+      if (now - wakeMillis_ >= config_.wakeTimeoutMillis) {
+        LEP_LOGW("LeptonDutyCycle boot timed out in phase %i", lepton_.getBootPhase());
+        sleep(now, true);
+        return false;
+      }
+      if (!lepton_.isReady()) {
+        return false;
+      }
+      if (wakeHook_ != nullptr && !wakeHook_(lepton_, wakeHookContext_)) {
+        LEP_LOGW("LeptonDutyCycle wake hook failed");
+        sleep(millis(), true);
+        return false;
+      }
+      stats_.lastBootMillis = millis() - wakeMillis_;
+      state_ = kCapturing;
+      return false;
+
+    case kCapturing:
+    default:
+      if (now - wakeMillis_ >= config_.wakeTimeoutMillis) {
+        LEP_LOGW("LeptonDutyCycle capture timed out, %i frames", wakeFramesCaptured_);
+        sleep(now, true);
+        return false;
+      }
+      if (!lepton_.readVoSpi(bufferLen, buffer, bufferWrittenOut)) {
+        return false;
+      }
+      if (wakeFramesSkipped_ < config_.skipFrames) {
+        wakeFramesSkipped_++;
+        stats_.framesSkipped++;
+        return false;
+      }
+      wakeFramesCaptured_++;
+      stats_.framesCaptured++;
+      if (wakeFramesCaptured_ >= config_.framesPerWake) {
+        sleep(millis(), false);
+      }
+      return true;
+  }
+}
+
+uint32_t LeptonDutyCycle::getSleepMillisRemaining() {
+  if (state_ != kAsleep) {
+    return 0;
+  }
+  int32_t remaining = nextWakeMillis_ - millis();
+  return remaining > 0 ? remaining : 0;
+}
+
+LeptonDutyCycle::Stats LeptonDutyCycle::getStats() {
+  Stats stats = stats_;
+  if (state_ != kStopped) {
+    stats.totalMillis = millis() - startMillis_;
+  }
+  return stats;
+}
+
+uint32_t LeptonDutyCycle::getAwakeMillisPerFrame() {
+  if (stats_.framesCaptured == 0) {
+    return 0;
+  }
+  return stats_.totalAwakeMillis / stats_.framesCaptured;
+}
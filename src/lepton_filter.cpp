@@ -0,0 +1,80 @@
+#include "lepton_filter.h"
+
+
+TemporalFilter::TemporalFilter(size_t width, size_t height, uint16_t* state, uint8_t fractionBits) :
+    numPixels_(width * height), state_(state), fractionBits_(fractionBits) {
+}
+
+void TemporalFilter::prime(const uint8_t* frame) {
+  for (size_t i=0; i<numPixels_; i++) {
+    state_[i] = (((uint16_t)frame[2*i] << 8) | frame[2*i + 1]) << fractionBits_;
+  }
+  primed_ = true;
+}
+
+void TemporalFilter::apply(uint8_t* frame) {
+  if (!primed_) {
+    prime(frame);
+    return;
+  }
+
+  uint16_t* __restrict state = state_;
+  uint8_t* __restrict pixels = frame;
+  const int32_t staticWeight = staticWeight_;
+  const int32_t fractionBits = fractionBits_, motionShift = motionShift_;
+  const int32_t outRound = (1 << fractionBits) >> 1;
+  for (size_t i=0; i<numPixels_; i++) {
+    int32_t in = (((int32_t)pixels[2*i] << 8) | pixels[2*i + 1]) << fractionBits;
+    int32_t avg = state[i];
+    int32_t diff = in - avg;
+    int32_t mag = diff < 0 ? -diff : diff;
+    int32_t steps = mag >> fractionBits;
+    steps = steps < 256 ? steps : 256;  // saturated before shifting, the weight saturates at 256 anyway
+    int32_t weight = staticWeight + (steps << motionShift);
+    weight = weight < 256 ? weight : 256;
+    avg += (diff * weight + 128) >> 8;
+    state[i] = avg;
+
+    int32_t out = (avg + outRound) >> fractionBits;
+    out = out < 0xffff ? out : 0xffff;
+    pixels[2*i] = out >> 8;
+    pixels[2*i + 1] = out & 0xff;
+  }
+}
+
+void TemporalFilter::applyReference(uint8_t* frame) {
+  if (!primed_) {
+    prime(frame);
+    return;
+  }
+
+  for (size_t i=0; i<numPixels_; i++) {
+    int32_t in = (((uint16_t)frame[2*i] << 8) | frame[2*i + 1]) << fractionBits_;
+    int32_t avg = state_[i];
+    int32_t diff = in - avg;
+
+    int32_t steps;
+    if (diff < 0) {
+      steps = -diff >> fractionBits_;
+    } else {
+      steps = diff >> fractionBits_;
+    }
+    if (steps > 256) {
+      steps = 256;
+    }
+    int32_t weight = staticWeight_ + (steps << motionShift_);
+    if (weight >= 256) {  // moving pixel, take the new sample
+      avg = in;
+    } else {  // static pixel, blend with rounding (arithmetic shift floors toward negative infinity)
+      avg += (diff * weight + 128) >> 8;
+    }
+    state_[i] = avg;
+
+    uint32_t out = ((uint32_t)avg + ((1 << fractionBits_) >> 1)) >> fractionBits_;
+    if (out > 0xffff) {
+      out = 0xffff;
+    }
+    frame[2*i] = out >> 8;
+    frame[2*i + 1] = out & 0xff;
+  }
+}
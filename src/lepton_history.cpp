@@ -0,0 +1,120 @@
+#include "lepton_history.h"
+#include <string.h>
+
+
+FrameHistory::FrameHistory(size_t width, size_t height, uint8_t* storage, size_t storageLen, uint16_t* reference,
+    size_t maxRecordLen, uint16_t keyframeInterval) :
+    encoder_(width, height, reference, keyframeInterval), storage_(storage), storageLen_(storageLen),
+    maxRecordLen_(maxRecordLen) {
+}
+
+size_t FrameHistory::contiguousFree() {
+  if (count_ == 0) {
+    return storageLen_;
+  } else if (head_ < tail_) {
+    return storageLen_ - tail_;
+  } else {
+    return head_ - tail_;
+  }
+}
+
+void FrameHistory::evictOldest() {
+  RecordHeader header;
+  memcpy(&header, storage_ + head_, sizeof(header));
+  head_ += sizeof(header) + header.len;
+  bytesUsed_ -= sizeof(header) + header.len;
+  count_--;
+  if (head_ < tail_) {  // not wrapped
+  } else if (head_ >= dataEnd_) {  // reached the end of the pre-wrap records
+    head_ = 0;
+  }
+  if (count_ == 0) {
+    head_ = tail_ = 0;
+  }
+}
+
+bool FrameHistory::ensureSpace(size_t len) {
+  if (len > storageLen_) {
+    return false;
+  }
+  while (contiguousFree() < len) {
+    if (count_ > 0 && head_ < tail_) {  // not wrapped, wrap around to the start
+      dataEnd_ = tail_;
+      tail_ = 0;
+    } else {
+      evictOldest();
+    }
+  }
+  return true;
+}
+
+uint32_t FrameHistory::oldestMillis() {
+  RecordHeader header;
+  memcpy(&header, storage_ + head_, sizeof(header));
+  return header.timestampMillis;
+}
+
+void FrameHistory::freeze() {
+  // sequentially consistent, so either write() sees frozen_ set or this sees its writing_ set
+  __atomic_store_n(&frozen_, 1, __ATOMIC_SEQ_CST);
+  while (__atomic_load_n(&writing_, __ATOMIC_SEQ_CST)) {
+  }
+}
+
+bool FrameHistory::write(const uint8_t* frame, uint32_t timestampMillis) {
+  __atomic_store_n(&writing_, 1, __ATOMIC_SEQ_CST);
+  bool written = !__atomic_load_n(&frozen_, __ATOMIC_SEQ_CST) &&
+      ensureSpace(sizeof(RecordHeader) + maxRecordLen_) && writeRecord(frame, timestampMillis);
+  if (!written) {
+    droppedFrames_++;
+  }
+  __atomic_store_n(&writing_, 0, __ATOMIC_RELEASE);  // publishes the record to a freeze() waiting on this
+  return written;
+}
+
+bool FrameHistory::writeRecord(const uint8_t* frame, uint32_t timestampMillis) {
+  uint8_t* recordPtr = storage_ + tail_;
+  size_t len = encoder_.encode(frame, recordPtr + sizeof(RecordHeader), contiguousFree() - sizeof(RecordHeader));
+  if (len == 0) {  // encoder forces a keyframe next
+    return false;
+  }
+
+  RecordHeader header = {(uint32_t)len, timestampMillis};
+  memcpy(recordPtr, &header, sizeof(header));
+  if (count_ == 0) {
+    head_ = tail_;
+  }
+  tail_ += sizeof(header) + len;
+  bytesUsed_ += sizeof(header) + len;
+  count_++;
+  newestMillis_ = timestampMillis;
+  return true;
+}
+
+size_t FrameHistory::exportRecords(uint32_t fromMillis, RecordFn recordFn, void* context) {
+  size_t passed = 0;
+  size_t offset = head_;
+  bool started = false;
+  for (size_t i=0; i<count_; i++) {
+    if (offset >= dataEnd_ && offset >= tail_) {  // past the pre-wrap records
+      offset = 0;
+    }
+    RecordHeader header;
+    memcpy(&header, storage_ + offset, sizeof(header));
+    const uint8_t* encoded = storage_ + offset + sizeof(header);
+    offset += sizeof(header) + header.len;
+
+    if (!started) {  // wait for a keyframe within the window
+      if ((int32_t)(header.timestampMillis - fromMillis) < 0 ||
+          header.len < LeptonCodec::kHeaderLen || !(encoded[2] & LeptonCodec::kFlagKeyframe)) {
+        continue;
+      }
+      started = true;
+    }
+    passed++;
+    if (!recordFn(encoded, header.len, header.timestampMillis, context)) {
+      break;
+    }
+  }
+  return passed;
+}
@@ -0,0 +1,53 @@
+#include "lepton_log.h"
+#include <stdio.h>
+#include <stdarg.h>
+
+#ifndef ESP32
+  #include <Arduino.h>
+#endif
+
+
+LeptonLog::DeferredLog LeptonLog::deferredLog;
+
+#ifndef ESP32
+void LeptonLog::print(char level, const char* format, ...) {
+  char buf[128] = {'L', 'E', 'P', ' ', level, ' '};  // on the stack so concurrent callers don't clobber each other
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buf + 6, sizeof(buf) - 6, format, args);
+  va_end(args);
+  Serial.println(buf);
+}
+#endif
+
+
+#if LEP_DEFERRED_LOG
+LeptonLog::DeferredLog::DeferredLog() : head_(0), drops_(0) {
+  for (size_t i=0; i<kCapacity; i++) {
+    slots_[i].seq.store(i, std::memory_order_relaxed);
+  }
+}
+
+bool LeptonLog::DeferredLog::pop(Record& recordOut) {
+  Slot& slot = slots_[tail_ % kCapacity];
+  if (slot.seq.load(std::memory_order_acquire) != tail_ + 1) {
+    return false;  // empty, or the producer is still writing
+  }
+  recordOut = slot.record;
+  slot.seq.store(tail_ + kCapacity, std::memory_order_release);  // free for the next lap
+  tail_++;
+  return true;
+}
+
+size_t LeptonLog::DeferredLog::drain(LineFn lineFn, void* context, size_t maxRecords) {
+  size_t count = 0;
+  Record record;
+  char buf[128];
+  while (count < maxRecords && pop(record)) {
+    snprintf(buf, sizeof(buf), record.format, record.args[0], record.args[1], record.args[2], record.args[3]);
+    lineFn(record.level, buf, context);
+    count++;
+  }
+  return count;
+}
+#endif
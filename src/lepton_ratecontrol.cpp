@@ -0,0 +1,119 @@
+#include "lepton_ratecontrol.h"
+
+
+RateControl::RateControl(uint32_t targetBitsPerSecond) : targetBitsPerSecond_(targetBitsPerSecond) {
+}
+
+uint32_t RateControl::getBudgetBitrate() {
+  if (drainBitsPerSecond_ != 0 && drainBitsPerSecond_ < targetBitsPerSecond_) {
+    return drainBitsPerSecond_;
+  }
+  return targetBitsPerSecond_;
+}
+
+uint32_t RateControl::predictBytes(uint8_t level) {
+  if (levelBytes_[level] != 0) {
+    return levelBytes_[level];
+  }
+  // extrapolate from the nearest measured level, assuming each level step is ~20% smaller
+  for (uint8_t distance=1; distance < kNumLevels; distance++) {
+    if (level >= distance && levelBytes_[level - distance] != 0) {
+      uint32_t bytes = levelBytes_[level - distance];
+      for (uint8_t i=0; i<distance; i++) {
+        bytes = bytes * 4 / 5;
+      }
+      return bytes;
+    }
+    if (level + distance < kNumLevels && levelBytes_[level + distance] != 0) {
+      uint32_t bytes = levelBytes_[level + distance];
+      for (uint8_t i=0; i<distance; i++) {
+        bytes = bytes * 5 / 4;
+      }
+      return bytes;
+    }
+  }
+  return 0;  // nothing measured yet
+}
+
+uint8_t RateControl::selectLevel() {
+  if (frameMicros_ == 0) {  // frame rate unknown, keep the current level
+    return level_;
+  }
+  uint32_t budgetBytes = (uint64_t)getBudgetBitrate() * frameMicros_ / 8 / 1000000 * kHeadroomPct / 100;
+
+  uint8_t fitLevel = kNumLevels - 1;
+  for (uint8_t level=0; level < kNumLevels; level++) {
+    if (predictBytes(level) <= budgetBytes) {
+      fitLevel = level;
+      break;
+    }
+  }
+
+  if (fitLevel > level_) {  // reduce quality immediately
+    level_ = fitLevel;
+    upgradeCount_ = 0;
+  } else if (fitLevel < level_) {  // only increase quality one step once it has fit for a while
+    if (++upgradeCount_ >= kUpgradeFrames) {
+      level_--;
+      upgradeCount_ = 0;
+    }
+  } else {
+    upgradeCount_ = 0;
+  }
+  return level_;
+}
+
+void RateControl::reportEncoded(uint8_t level, size_t bytes, uint32_t nowMicros) {
+  if (level < kNumLevels) {
+    if (levelBytes_[level] == 0) {
+      levelBytes_[level] = bytes;
+    } else {
+      levelBytes_[level] = levelBytes_[level] - (levelBytes_[level] >> kEmaShift) + (bytes >> kEmaShift);
+    }
+    if (overflowed_ && level > level_) {  // fallback was needed, start from there next frame
+      level_ = level;
+      upgradeCount_ = 0;
+    }
+  }
+  overflowed_ = false;
+
+  if (haveLastFrame_) {
+    uint32_t interval = nowMicros - lastFrameMicros_;
+    if (frameMicros_ == 0) {
+      frameMicros_ = interval;
+    } else {
+      frameMicros_ = frameMicros_ - (frameMicros_ >> kEmaShift) + (interval >> kEmaShift);
+    }
+    if (frameMicros_ > 0) {
+      uint32_t bitsPerSecond = (uint64_t)bytes * 8 * 1000000 / frameMicros_;
+      if (achievedBitsPerSecond_ == 0) {
+        achievedBitsPerSecond_ = bitsPerSecond;
+      } else {
+        achievedBitsPerSecond_ = achievedBitsPerSecond_ - (achievedBitsPerSecond_ >> kEmaShift) +
+            (bitsPerSecond >> kEmaShift);
+      }
+    }
+  }
+  lastFrameMicros_ = nowMicros;
+  haveLastFrame_ = true;
+
+  if (frameMinDrain_ != 0) {  // fold in the slowest client of the previous frame
+    if (drainBitsPerSecond_ == 0) {
+      drainBitsPerSecond_ = frameMinDrain_;
+    } else {
+      drainBitsPerSecond_ = drainBitsPerSecond_ - (drainBitsPerSecond_ >> kEmaShift) + (frameMinDrain_ >> kEmaShift);
+    }
+    frameMinDrain_ = 0;
+  }
+}
+
+void RateControl::reportClientDrain(size_t bytes, uint32_t elapsedMicros) {
+  if (elapsedMicros == 0) {
+    elapsedMicros = 1;
+  }
+  uint64_t bitsPerSecond = (uint64_t)bytes * 8 * 1000000 / elapsedMicros;
+  uint32_t clamped = bitsPerSecond > 0xffffffff ? 0xffffffff : bitsPerSecond;
+  if (frameMinDrain_ == 0 || clamped < frameMinDrain_) {
+    frameMinDrain_ = clamped;
+  }
+}
@@ -0,0 +1,62 @@
+#include "lepton_scenechange.h"
+#include <string.h>
+
+
+SceneChangeDetector::SceneChangeDetector(size_t width, size_t height, uint16_t* state, uint8_t blockShift) :
+    width_(width), blockShift_(clampBlockShift(blockShift)) {
+  gridWidth_ = width >> blockShift_;
+  gridHeight_ = height >> blockShift_;
+  if (gridWidth_ > kMaxGridWidth) {
+    gridWidth_ = kMaxGridWidth;
+  }
+  reference_ = state;
+  current_ = state + gridWidth_ * gridHeight_;
+}
+
+bool SceneChangeDetector::shouldSend(const uint8_t* frame, uint32_t nowMillis) {
+  framesSeen_++;
+  const size_t blockSize = (size_t)1 << blockShift_;
+  const uint8_t meanShift = 2 * (blockShift_ - 1);  // samples per block = (blockSize / 2)^2
+
+  // compute block means, one row of blocks at a time, and compare against the reference
+  uint16_t changedBlocks = 0;
+  uint32_t blockSums[kMaxGridWidth];
+  for (size_t gy=0; gy<gridHeight_; gy++) {
+    for (size_t gx=0; gx<gridWidth_; gx++) {
+      blockSums[gx] = 0;
+    }
+    for (size_t y=gy * blockSize; y < (gy + 1) * blockSize; y += 2) {
+      const uint8_t* row = frame + 2 * y * width_;
+      for (size_t gx=0; gx<gridWidth_; gx++) {
+        const uint8_t* block = row + 2 * (gx << blockShift_);
+        uint32_t sum = 0;
+        for (size_t x=0; x < blockSize; x += 2) {
+          sum += ((uint16_t)block[2*x] << 8) | block[2*x + 1];
+        }
+        blockSums[gx] += sum;
+      }
+    }
+
+    const uint16_t* referenceRow = reference_ + gy * gridWidth_;
+    uint16_t* currentRow = current_ + gy * gridWidth_;
+    for (size_t gx=0; gx<gridWidth_; gx++) {
+      uint16_t mean = blockSums[gx] >> meanShift;
+      int32_t diff = (int32_t)mean - referenceRow[gx];
+      uint32_t absDiff = diff < 0 ? -diff : diff;
+      uint32_t noiseFloor = baseNoise_ + (mean >> levelShift_);
+      changedBlocks += absDiff > noiseFloor;
+      currentRow[gx] = mean;
+    }
+  }
+  changedBlocks_ = changedBlocks;
+
+  bool send = !primed_ || changedBlocks >= minChangedBlocks_ ||
+      (keepaliveMillis_ != 0 && nowMillis - lastSentMillis_ >= keepaliveMillis_);
+  if (send) {
+    memcpy(reference_, current_, gridWidth_ * gridHeight_ * sizeof(uint16_t));
+    primed_ = true;
+    lastSentMillis_ = nowMillis;
+    framesSent_++;
+  }
+  return send;
+}
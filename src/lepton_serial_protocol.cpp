@@ -0,0 +1,161 @@
+#include "lepton_serial_protocol.h"
+#include <string.h>
+
+
+uint16_t LeptonSerialProtocol::crc16(const uint8_t* data, size_t len, uint16_t crc) {
+  static const uint16_t kNibbleTable[16] = {  // polynomial 0x1021
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+  };
+  for (size_t i=0; i<len; i++) {
+    crc = (crc << 4) ^ kNibbleTable[(crc >> 12) ^ (data[i] >> 4)];
+    crc = (crc << 4) ^ kNibbleTable[(crc >> 12) ^ (data[i] & 0x0f)];
+  }
+  return crc;
+}
+
+
+SerialFrameSender::SerialFrameSender(WriteFn write, void* context) : write_(write), context_(context) {
+}
+
+void SerialFrameSender::sendRawFrame(const uint8_t* frame, uint16_t width, uint16_t height) {
+  sendMessage(LeptonSerialProtocol::kTypeRawFrame, frame, (size_t)width * height * 2, width, height);
+}
+
+void SerialFrameSender::sendLosslessFrame(const uint8_t* encoded, size_t len, uint16_t width, uint16_t height) {
+  sendMessage(LeptonSerialProtocol::kTypeLosslessFrame, encoded, len, width, height);
+}
+
+void SerialFrameSender::sendMessage(uint8_t type, const uint8_t* payload, size_t len, uint16_t width, uint16_t height) {
+  uint8_t header[LeptonSerialProtocol::kHeaderLen] = {
+    LeptonSerialProtocol::kVersion, type,
+    (uint8_t)(seq_ >> 8), (uint8_t)(seq_ & 0xff),
+    (uint8_t)(width >> 8), (uint8_t)(width & 0xff),
+    (uint8_t)(height >> 8), (uint8_t)(height & 0xff),
+  };
+  seq_++;
+  uint16_t crc = LeptonSerialProtocol::crc16(header, sizeof(header));
+  crc = LeptonSerialProtocol::crc16(payload, len, crc);
+
+  blockLen_ = 0;
+  for (size_t i=0; i<sizeof(header); i++) {
+    cobsByte(header[i]);
+  }
+  for (size_t i=0; i<len; i++) {
+    cobsByte(payload[i]);
+  }
+  cobsByte(crc >> 8);
+  cobsByte(crc & 0xff);
+  cobsFinish();
+}
+
+inline void SerialFrameSender::cobsByte(uint8_t data) {
+  if (data == 0) {
+    cobsFlushBlock(blockLen_ + 1);
+  } else {
+    block_[++blockLen_] = data;
+    if (blockLen_ == 254) {
+      cobsFlushBlock(0xff);
+    }
+  }
+}
+
+void SerialFrameSender::cobsFlushBlock(uint8_t code) {
+  block_[0] = code;
+  write_(block_, blockLen_ + 1, context_);
+  blockLen_ = 0;
+}
+
+void SerialFrameSender::cobsFinish() {
+  cobsFlushBlock(blockLen_ + 1);
+  const uint8_t kDelimiter = 0;
+  write_(&kDelimiter, 1, context_);
+}
+
+
+SerialFrameReceiver::SerialFrameReceiver(uint8_t* messageBuf, size_t messageBufLen, FrameFn frameFn, void* context,
+    LosslessDecoder* decoder, uint8_t* frameBuf) :
+    messageBuf_(messageBuf), messageBufLen_(messageBufLen), frameFn_(frameFn), context_(context),
+    decoder_(decoder), frameBuf_(frameBuf) {
+}
+
+void SerialFrameReceiver::push(const uint8_t* data, size_t len) {
+  for (size_t i=0; i<len; i++) {
+    uint8_t byte = data[i];
+    if (byte == 0) {  // end of message
+      if (overflow_ || blockRemaining_ != 0) {
+        formatErrors_++;
+      } else if (len_ > 0) {
+        handleMessage();
+      }
+      len_ = 0;
+      blockRemaining_ = 0;
+      lastCode_ = 0xff;
+      overflow_ = false;
+    } else if (blockRemaining_ == 0) {  // code byte, the previous block's implied zero is only added now
+      if (lastCode_ != 0xff) {
+        if (len_ < messageBufLen_) {
+          messageBuf_[len_++] = 0;
+        } else {
+          overflow_ = true;
+        }
+      }
+      lastCode_ = byte;
+      blockRemaining_ = byte - 1;
+    } else {
+      if (len_ < messageBufLen_) {
+        messageBuf_[len_++] = byte;
+      } else {
+        overflow_ = true;
+      }
+      blockRemaining_--;
+    }
+  }
+}
+
+void SerialFrameReceiver::handleMessage() {
+  if (len_ < LeptonSerialProtocol::kHeaderLen + LeptonSerialProtocol::kCrcLen) {
+    formatErrors_++;
+    return;
+  }
+  size_t payloadLen = len_ - LeptonSerialProtocol::kHeaderLen - LeptonSerialProtocol::kCrcLen;
+  uint16_t crc = ((uint16_t)messageBuf_[len_ - 2] << 8) | messageBuf_[len_ - 1];
+  if (LeptonSerialProtocol::crc16(messageBuf_, len_ - LeptonSerialProtocol::kCrcLen) != crc) {
+    crcErrors_++;
+    return;
+  }
+  if (messageBuf_[0] != LeptonSerialProtocol::kVersion) {
+    formatErrors_++;
+    return;
+  }
+
+  uint8_t type = messageBuf_[1];
+  uint16_t seq = ((uint16_t)messageBuf_[2] << 8) | messageBuf_[3];
+  uint16_t width = ((uint16_t)messageBuf_[4] << 8) | messageBuf_[5];
+  uint16_t height = ((uint16_t)messageBuf_[6] << 8) | messageBuf_[7];
+  const uint8_t* payload = messageBuf_ + LeptonSerialProtocol::kHeaderLen;
+
+  if (haveSeq_ && seq != (uint16_t)(lastSeq_ + 1)) {
+    framesDropped_ += (uint16_t)(seq - lastSeq_ - 1);
+  }
+  haveSeq_ = true;
+  lastSeq_ = seq;
+
+  if (type == LeptonSerialProtocol::kTypeRawFrame) {
+    if (payloadLen != (size_t)width * height * 2) {
+      formatErrors_++;
+      return;
+    }
+    framesReceived_++;
+    frameFn_(payload, width, height, seq, context_);
+  } else if (type == LeptonSerialProtocol::kTypeLosslessFrame && decoder_ != nullptr && frameBuf_ != nullptr) {
+    if (!decoder_->decode(payload, payloadLen, frameBuf_)) {  // also fails on deltas after a drop, until a keyframe
+      formatErrors_++;
+      return;
+    }
+    framesReceived_++;
+    frameFn_(frameBuf_, width, height, seq, context_);
+  } else {
+    formatErrors_++;
+  }
+}
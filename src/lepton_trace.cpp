@@ -0,0 +1,101 @@
+#include "lepton_trace.h"
+#include <stdio.h>
+#include <string.h>
+
+
+const char* LatencyTracer::getStageName(Stage stage) {
+  static const char* const kNames[kNumStages] = {"readout", "publish", "encode", "send", "total"};
+  return stage < kNumStages ? kNames[stage] : "";
+}
+
+size_t LatencyTracer::bucketIndex(uint32_t value) {
+  if (value < kSubBuckets) {
+    return value;
+  }
+  size_t msb = 31 - __builtin_clz(value);
+  size_t shift = msb - kSubBucketBits;
+  if (shift > kMaxShift) {
+    return kNumBuckets - 1;
+  }
+  return (shift + 1) * kSubBuckets + ((value >> shift) & (kSubBuckets - 1));
+}
+
+uint32_t LatencyTracer::bucketValue(size_t index) {
+  if (index < kSubBuckets) {
+    return index;
+  }
+  size_t shift = index / kSubBuckets - 1;
+  uint32_t low = (uint32_t)(kSubBuckets + index % kSubBuckets) << shift;
+  return low + ((1 << shift) >> 1);
+}
+
+void LatencyTracer::record(const FrameTimestamps& timestamps) {
+  // unsigned differences are correct across micros() wraparound
+  uint32_t latencies[kNumStages] = {
+    timestamps.lastPacketMicros - timestamps.firstPacketMicros,
+    timestamps.publishMicros - timestamps.lastPacketMicros,
+    timestamps.encodeDoneMicros - timestamps.publishMicros,
+    timestamps.sendDoneMicros - timestamps.encodeDoneMicros,
+    timestamps.sendDoneMicros - timestamps.firstPacketMicros,
+  };
+  LeptonPipeline::LockGuard lock(mutex_);
+  for (size_t stage=0; stage<kNumStages; stage++) {
+    counts_[stage][bucketIndex(latencies[stage])]++;
+    if (latencies[stage] > max_[stage]) {
+      max_[stage] = latencies[stage];
+    }
+  }
+  count_++;
+}
+
+uint32_t LatencyTracer::getPercentileLocked(Stage stage, uint8_t percentile) {
+  if (count_ == 0) {
+    return 0;
+  }
+  uint32_t target = ((uint64_t)count_ * percentile + 99) / 100;  // rank of the percentile sample, rounded up
+  target = target < 1 ? 1 : target;
+  uint32_t cumulative = 0;
+  for (size_t i=0; i<kNumBuckets; i++) {
+    cumulative += counts_[stage][i];
+    if (cumulative >= target) {
+      uint32_t value = bucketValue(i);
+      return value < max_[stage] ? value : max_[stage];
+    }
+  }
+  return max_[stage];
+}
+
+uint32_t LatencyTracer::getPercentile(Stage stage, uint8_t percentile) {
+  LeptonPipeline::LockGuard lock(mutex_);
+  return getPercentileLocked(stage, percentile);
+}
+
+uint32_t LatencyTracer::getMax(Stage stage) {
+  LeptonPipeline::LockGuard lock(mutex_);
+  return max_[stage];
+}
+
+uint32_t LatencyTracer::getCount() {
+  LeptonPipeline::LockGuard lock(mutex_);
+  return count_;
+}
+
+void LatencyTracer::reset() {
+  LeptonPipeline::LockGuard lock(mutex_);
+  memset(counts_, 0, sizeof(counts_));
+  memset(max_, 0, sizeof(max_));
+  count_ = 0;
+}
+
+size_t LatencyTracer::exportJson(char* out, size_t outLen) {
+  LeptonPipeline::LockGuard lock(mutex_);
+  size_t len = snprintf(out, outLen, "{\"count\":%u", (unsigned int)count_);
+  for (size_t stage=0; stage<kNumStages; stage++) {
+    len += snprintf(out + (len < outLen ? len : outLen), len < outLen ? outLen - len : 0,
+        ",\"%s\":{\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u}", getStageName((Stage)stage),
+        (unsigned int)getPercentileLocked((Stage)stage, 50), (unsigned int)getPercentileLocked((Stage)stage, 90),
+        (unsigned int)getPercentileLocked((Stage)stage, 99), (unsigned int)max_[stage]);
+  }
+  len += snprintf(out + (len < outLen ? len : outLen), len < outLen ? outLen - len : 0, "}");
+  return len;
+}
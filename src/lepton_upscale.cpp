@@ -0,0 +1,154 @@
+#include "lepton_upscale.h"
+
+
+Upscaler::Upscaler(uint16_t width, uint16_t height, uint8_t channels, uint8_t bytesPerChannel, uint8_t scale,
+    Mode mode) :
+    width_(width), height_(height), channels_(channels), bytesPerChannel_(bytesPerChannel),
+    scale_(clampScale(scale)), mode_(mode) {
+  // output pixel center k (of scale) maps to source position (k + 0.5) / scale - 0.5 relative to the source pixel,
+  // in 1/(2 * scale) units: (2k + 1 - scale)
+  for (uint8_t k=0; k<scale_; k++) {
+    int32_t pos = 2 * k + 1 - scale_;
+    if (pos < 0) {  // between the previous and this source pixel
+      phaseOffset_[k] = -1;
+      pos += 2 * scale_;
+    } else {
+      phaseOffset_[k] = 0;
+    }
+    phaseWeight_[k] = (pos << kWeightBits) / (2 * scale_);
+  }
+}
+
+template <size_t kBytes>
+static inline uint32_t readSample(const uint8_t* data) {
+  if (kBytes == 1) {
+    return data[0];
+  } else {
+    return ((uint32_t)data[0] << 8) | data[1];
+  }
+}
+
+template <size_t kBytes>
+static inline void writeSample(uint8_t* data, uint32_t value) {
+  if (kBytes == 1) {
+    data[0] = value;
+  } else {
+    data[0] = value >> 8;
+    data[1] = value;
+  }
+}
+
+// Interpolates between a and b (in matching fixed-point units) with weight w (of 1 << kWeightBits) on b,
+// or takes the nearest if kEdgeAware and they differ by more than threshold
+template <bool kEdgeAware>
+static inline uint32_t lerp(uint32_t a, uint32_t b, uint32_t w, uint32_t threshold) {
+  uint32_t blended = a * (16 - w) + b * w;
+  if (kEdgeAware) {
+    uint32_t diff = a > b ? a - b : b - a;
+    uint32_t nearest = (w < 8 ? a : b) << 4;
+    blended = diff > threshold ? nearest : blended;
+  }
+  return blended;
+}
+
+void Upscaler::upscaleRow(const uint8_t* frame, uint16_t outY, uint8_t* out, uint32_t* scratch) const {
+  if (mode_ == kNearest || scale_ == 1) {
+    if (bytesPerChannel_ == 1) {
+      nearestRow<1>(frame, outY, out);
+    } else {
+      nearestRow<2>(frame, outY, out);
+    }
+  } else if (mode_ == kBilinear) {
+    if (bytesPerChannel_ == 1) {
+      bilinearRow<1, false>(frame, outY, out, scratch);
+    } else {
+      bilinearRow<2, false>(frame, outY, out, scratch);
+    }
+  } else {
+    if (bytesPerChannel_ == 1) {
+      bilinearRow<1, true>(frame, outY, out, scratch);
+    } else {
+      bilinearRow<2, true>(frame, outY, out, scratch);
+    }
+  }
+}
+
+template <size_t kBytes>
+void Upscaler::nearestRow(const uint8_t* frame, uint16_t outY, uint8_t* out) const {
+  const size_t pixelLen = (size_t)channels_ * kBytes;
+  const uint8_t* src = frame + (size_t)(outY / scale_) * width_ * pixelLen;
+  for (uint16_t x=0; x<width_; x++) {
+    for (uint8_t k=0; k<scale_; k++) {
+      for (size_t i=0; i<pixelLen; i++) {
+        *out++ = src[i];
+      }
+    }
+    src += pixelLen;
+  }
+}
+
+template <size_t kBytes, bool kEdgeAware>
+void Upscaler::bilinearRow(const uint8_t* frame, uint16_t outY, uint8_t* out, uint32_t* scratch) const {
+  const size_t rowSamples = (size_t)width_ * channels_;
+  const size_t rowLen = rowSamples * kBytes;
+
+  // vertical pass, into scratch in 1/16ths
+  uint8_t phase = outY % scale_;
+  int32_t y0 = (int32_t)(outY / scale_) + phaseOffset_[phase];
+  int32_t y1 = y0 + 1;
+  y0 = y0 < 0 ? 0 : y0;
+  y1 = y1 >= height_ ? height_ - 1 : y1;
+  const uint8_t* row0 = frame + (size_t)y0 * rowLen;
+  const uint8_t* row1 = frame + (size_t)y1 * rowLen;
+  const uint32_t wy = phaseWeight_[phase];
+  const uint32_t threshold = edgeThreshold_;
+  for (size_t i=0; i<rowSamples; i++) {
+    scratch[i] = lerp<kEdgeAware>(readSample<kBytes>(row0 + i * kBytes), readSample<kBytes>(row1 + i * kBytes),
+        wy, threshold);
+  }
+
+  // horizontal pass, from 1/16ths to 1/256ths, rounded back to input units
+  if (channels_ == 1) {
+    horizontalPass<kBytes, kEdgeAware, 1>(scratch, out);
+  } else {
+    horizontalPass<kBytes, kEdgeAware, 3>(scratch, out);
+  }
+}
+
+template <size_t kBytes, bool kEdgeAware, size_t kChannels>
+void Upscaler::horizontalPass(const uint32_t* scratch, uint8_t* out) const {
+  const uint32_t scaledThreshold = (uint32_t)edgeThreshold_ << kWeightBits;
+  const uint8_t scale = scale_;
+  const size_t outPixelLen = kChannels * kBytes;
+
+  // edge pixels clamp source coordinates, interior pixels never do
+  for (uint16_t x=0; x<width_; x += (width_ > 1 ? width_ - 1 : 1)) {
+    for (uint8_t k=0; k<scale; k++) {
+      int32_t x0 = (int32_t)x + phaseOffset_[k];
+      int32_t x1 = x0 + 1;
+      x0 = x0 < 0 ? 0 : x0;
+      x1 = x1 >= width_ ? width_ - 1 : x1;
+      uint8_t* outPixel = out + ((size_t)x * scale + k) * outPixelLen;
+      for (size_t c=0; c<kChannels; c++) {
+        uint32_t value = lerp<kEdgeAware>(scratch[x0 * kChannels + c], scratch[x1 * kChannels + c], phaseWeight_[k],
+            scaledThreshold);
+        writeSample<kBytes>(outPixel + c * kBytes, (value + 128) >> (2 * kWeightBits));
+      }
+    }
+  }
+
+  for (uint8_t k=0; k<scale; k++) {  // per phase, so the weight and offset are loop invariant
+    const uint32_t wx = phaseWeight_[k];
+    const uint32_t* a = scratch + (1 + phaseOffset_[k]) * kChannels;
+    uint8_t* outPixel = out + ((size_t)scale + k) * outPixelLen;
+    const size_t outStride = (size_t)scale * outPixelLen;
+    for (uint16_t x=1; x + 1<width_; x++) {
+      for (size_t c=0; c<kChannels; c++) {
+        uint32_t value = lerp<kEdgeAware>(a[c], a[kChannels + c], wx, scaledThreshold);
+        writeSample<kBytes>(outPixel + c * kBytes, (value + 128) >> (2 * kWeightBits));
+      }
+      a += kChannels;
+      outPixel += outStride;
+    }
+  }
+}
@@ -0,0 +1,29 @@
+#ifndef __LEPTON_TEST_H__
+#define __LEPTON_TEST_H__
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+// Checks a condition regardless of NDEBUG, failing the test with its location
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%i: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      exit(1); \
+    } \
+  } while (0)
+
+// Wall-clock stopwatch for benchmarks (the Arduino clock is simulated)
+class Stopwatch {
+public:
+  Stopwatch() : start_(std::chrono::steady_clock::now()) {}
+  double elapsedNanos() {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start_).count();
+  }
+
+protected:
+  std::chrono::steady_clock::time_point start_;
+};
+
+#endif
@@ -0,0 +1,4 @@
+#include "Arduino.h"
+
+
+HardwareSerial Serial;
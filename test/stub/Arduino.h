@@ -0,0 +1,52 @@
+#ifndef __ARDUINO_STUB_H__
+#define __ARDUINO_STUB_H__
+
+// Minimal Arduino core for host tests, with pins and the clock backed by the simulated camera
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "sim_camera.h"
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define MSBFIRST 1
+#define SPI_MODE0 0
+#define SPI_MODE3 3
+
+inline void pinMode(int, int) {}
+inline void digitalWrite(int pin, int value) {
+  sim.pin(pin, value);
+}
+inline int digitalRead(int) {
+  return LOW;
+}
+
+// reading the clock takes time, so polling loops progress
+inline unsigned long millis() {
+  sim.advance(1);
+  return sim.nowUs / 1000;
+}
+inline unsigned long micros() {
+  return sim.nowUs;
+}
+inline void delay(unsigned long ms) {
+  sim.advance(ms * 1000ull);
+}
+inline void delayMicroseconds(unsigned int us) {
+  sim.advance(us);
+}
+
+struct HardwareSerial {
+  void print(const char* str) {
+    fputs(str, stdout);
+  }
+  void println(const char* str) {
+    puts(str);
+  }
+};
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef __SPI_STUB_H__
+#define __SPI_STUB_H__
+
+#include <random>
+#include "Arduino.h"
+
+
+class SPISettings {
+public:
+  SPISettings() {}
+  SPISettings(uint32_t clock, uint8_t, uint8_t) : clock(clock) {}
+  uint32_t clock = 1000000;
+};
+
+// SPI bus to the simulated camera's VoSPI, taking time on the virtual clock at the transaction clock.
+// A gap of more than 5 ms between transfers loses the frame in progress (eg, during a resync).
+// errorRate optionally sets the probability of each byte having a bit flipped as a function of the clock,
+// to emulate a marginal link.
+class SPIClass {
+public:
+  typedef double (*ErrorRateFn)(uint32_t clock);
+  static constexpr uint64_t kFrameLossGapUs = 5000;
+
+  ErrorRateFn errorRate = nullptr;
+  long bytes = 0, bitFlips = 0;  // bus traffic, for test assertions
+
+  void beginTransaction(SPISettings settings) {
+    clock_ = settings.clock;
+  }
+  void endTransaction() {}
+
+  void transfer(void* buf, size_t len) {
+    uint8_t* data = (uint8_t*)buf;
+    if (sim.nowUs - lastTransferUs_ > kFrameLossGapUs) {
+      sim.dropFrame();
+      packetPos_ = packetLen_;
+    }
+    sim.advance((uint64_t)len * 8 * 1000000 / clock_);
+    lastTransferUs_ = sim.nowUs;
+
+    double rate = errorRate != nullptr ? errorRate(clock_) : 0;
+    size_t pos = 0;
+    while (pos < len) {
+      if (packetPos_ >= packetLen_) {
+        packetLen_ = sim.nextPacket(packet_);
+        packetPos_ = 0;
+      }
+      size_t chunk = len - pos < packetLen_ - packetPos_ ? len - pos : packetLen_ - packetPos_;
+      memcpy(data + pos, packet_ + packetPos_, chunk);
+      if (rate > 0) {
+        for (size_t i = pos; i < pos + chunk; i++) {
+          if (uniform_(rng_) < rate) {
+            data[i] ^= 1 << (rng_() % 8);
+            bitFlips++;
+          }
+        }
+      }
+      pos += chunk;
+      packetPos_ += chunk;
+    }
+    bytes += len;
+  }
+
+protected:
+  uint32_t clock_ = 1000000;
+  uint64_t lastTransferUs_ = 0;
+  uint8_t packet_[SimCamera::kPacketHeaderLen + SimCamera::kMaxPacketDataLen];
+  size_t packetLen_ = 0, packetPos_ = 0;
+  std::mt19937 rng_{1};
+  std::uniform_real_distribution<double> uniform_{0, 1};
+};
+
+#endif
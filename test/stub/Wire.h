@@ -0,0 +1,106 @@
+#ifndef __WIRE_STUB_H__
+#define __WIRE_STUB_H__
+
+#include <map>
+#include "Arduino.h"
+
+
+// I2C bus to the simulated camera's CCI, at 400 kHz (25 us per byte on the virtual clock). NACKs while the camera
+// is not booted. Commands complete immediately: SETs store the data registers as the attribute, GETs read back the
+// last set value (zero if never set, except identification), and the SYS FFC status GET reports the boot FFC.
+class TwoWire {
+public:
+  static constexpr uint16_t kRegStatus = 0x0002, kRegCommandId = 0x0004, kRegData0 = 0x0008;
+  static constexpr uint16_t kSysFlirSerial = 0x0208, kSysFfcStatusGet = 0x0244, kOemPartNumber = 0x481c;
+
+  // bus traffic, for test assertions
+  long bytes = 0, transactions = 0;
+
+  TwoWire() {
+    attributes_[kSysFlirSerial][0] = 0x1234;
+    attributes_[kSysFlirSerial][1] = 0x5678;
+    const char partNumber[] = "500-0771-01";
+    for (size_t i = 0; i < sizeof(partNumber); i++) {
+      attributes_[kOemPartNumber][i / 2] |= (uint8_t)partNumber[i] << ((i % 2) ? 8 : 0);  // first character in the LSB
+    }
+  }
+
+  void beginTransmission(uint8_t) {
+    txLen_ = 0;
+    transactions++;
+    transfer(1);
+  }
+  size_t write(uint8_t data) {
+    if (txLen_ < sizeof(tx_)) {
+      tx_[txLen_++] = data;
+    }
+    transfer(1);
+    return 1;
+  }
+  uint8_t endTransmission(bool = true) {
+    if (!sim.isBooted()) {
+      sim.i2cFails++;
+      return 2;  // address NACK
+    }
+    if (txLen_ >= 2) {
+      addr_ = (tx_[0] << 8) | tx_[1];
+      for (size_t i = 2; i + 1 < txLen_; i += 2) {
+        writeWord(addr_ + i - 2, (tx_[i] << 8) | tx_[i + 1]);
+      }
+    }
+    return 0;
+  }
+  uint8_t requestFrom(uint8_t, size_t len) {
+    transactions++;
+    transfer(1 + len);
+    readPos_ = 0;
+    return sim.isBooted() ? len : 0;
+  }
+  int read() {
+    uint16_t word = readWord(addr_ + (readPos_ & ~1));
+    int data = (readPos_ & 1) ? (word & 0xff) : (word >> 8);
+    readPos_++;
+    return data;
+  }
+
+protected:
+  void transfer(size_t len) {
+    bytes += len;
+    sim.advance(25 * len);
+  }
+
+  void writeWord(uint16_t addr, uint16_t data) {
+    if (addr >= kRegData0 && addr < kRegData0 + 32) {
+      data_[(addr - kRegData0) / 2] = data;
+    } else if (addr == kRegCommandId) {
+      uint16_t attribute = data & ~0x3;
+      if ((data & 0x3) == 0x2) {  // SET
+        memcpy(attributes_[attribute], data_, sizeof(data_));
+      } else if ((data & 0x3) == 0x0) {  // GET
+        memset(data_, 0, sizeof(data_));
+        if (data == kSysFfcStatusGet) {
+          data_[0] = sim.isFfcDone() ? 0 : 1;  // LSW of a 32-bit enum, ready or busy
+        } else if (attributes_.count(attribute)) {
+          memcpy(data_, attributes_[attribute], sizeof(data_));
+        }
+      }
+    }
+  }
+  uint16_t readWord(uint16_t addr) {
+    if (addr == kRegStatus) {
+      return 0x0006;  // booted, boot mode normal, not busy, result OK
+    } else if (addr >= kRegData0 && addr < kRegData0 + 32) {
+      return data_[(addr - kRegData0) / 2];
+    }
+    return 0;
+  }
+
+  uint8_t tx_[2 + 32];
+  size_t txLen_ = 0;
+  uint16_t addr_ = 0;
+  size_t readPos_ = 0;
+  uint16_t data_[16] = {0};
+  std::map<uint16_t, uint16_t[16]> attributes_;
+};
+
+#endif
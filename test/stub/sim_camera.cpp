@@ -0,0 +1,106 @@
+#include "sim_camera.h"
+#include <string.h>
+
+
+SimCamera sim;
+
+void SimCamera::pin(int pin, int value) {
+  bool wasPowered = pwrdn_;
+  if (pin == kResetPin) {
+    if (!reset_ && value && pwrdn_) {
+      booting_ = true;
+      bootStartUs_ = nowUs;
+      nextFrameUs_ = nowUs + bootMs * 1000ull;
+      wakes++;
+    }
+    reset_ = value;
+  } else if (pin == kPwrdnPin) {
+    pwrdn_ = value;
+  }
+
+  if (pwrdn_ && !wasPowered) {
+    poweredSinceUs_ = nowUs;
+  } else if (!pwrdn_ && wasPowered) {
+    awakeUs += nowUs - poweredSinceUs_;
+  }
+  if (!reset_ || !pwrdn_) {
+    booting_ = false;
+    packet_ = -1;
+  }
+}
+
+bool SimCamera::isBooted() {
+  return booting_ && nowUs - bootStartUs_ >= bootMs * 1000ull;
+}
+
+bool SimCamera::isFfcDone() {
+  return nowUs - bootStartUs_ >= ffcMs * 1000ull;
+}
+
+void SimCamera::generateFrame() {
+  uint32_t seed = 1;
+  for (int segment = 1; segment <= kSegmentsPerFrame; segment++) {
+    for (int packet = 0; packet < kPacketsPerSegment; packet++) {
+      uint8_t* data = frame_[segment - 1][packet];
+      uint16_t id = packet | (packet == 20 ? segment << 12 : 0);
+      data[0] = id >> 8;
+      data[1] = id & 0xff;
+      for (size_t i = kPacketHeaderLen; i < kPacketHeaderLen + packetDataLen; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed >> 16;
+      }
+      uint8_t header[4] = {(uint8_t)(data[0] & 0x0f), data[1], 0, 0};
+      uint16_t crc = crc16(data + kPacketHeaderLen, packetDataLen, crc16(header, 4, 0));
+      data[2] = crc >> 8;
+      data[3] = crc & 0xff;
+    }
+  }
+  generatedDataLen_ = packetDataLen;
+}
+
+size_t SimCamera::nextPacket(uint8_t* packet) {
+  size_t len = kPacketHeaderLen + packetDataLen;
+  if (packet_ < 0 && isBooted() && nowUs >= nextFrameUs_) {
+    packet_ = 0;
+    segment_ = 1;
+  }
+  if (packet_ < 0) {
+    memset(packet, 0, len);
+    packet[0] = 0x0f;  // discard packet
+    return len;
+  }
+
+  if (generatedDataLen_ != packetDataLen) {
+    generateFrame();
+  }
+  memcpy(packet, frame_[segment_ - 1][packet_], len);
+  if (++packet_ == kPacketsPerSegment) {
+    packet_ = 0;
+    if (++segment_ > kSegmentsPerFrame) {
+      packet_ = -1;
+      frames++;
+      nextFrameUs_ += framePeriodUs;
+      if (nextFrameUs_ < nowUs) {
+        nextFrameUs_ = nowUs + framePeriodUs;
+      }
+    }
+  }
+  return len;
+}
+
+void SimCamera::dropFrame() {
+  if (packet_ >= 0) {
+    packet_ = -1;
+    nextFrameUs_ = nowUs;
+  }
+}
+
+uint16_t SimCamera::crc16(const uint8_t* data, size_t len, uint16_t crc) {
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
@@ -0,0 +1,64 @@
+#ifndef __SIM_CAMERA_H__
+#define __SIM_CAMERA_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+
+// Simulated Lepton for host tests, on a virtual clock (us) that advances with bus traffic and delays.
+// Pin 2 is RESET_L and pin 3 is PWR_DWN_L (PWR_DWN_L floats high, so drivers without a PWRDN pin see a powered
+// camera). After release from reset, I2C responds after bootMs and the boot FFC completes after ffcMs. VoSPI emits
+// a Lepton 3 style frame (4 segments of 60 packets, with valid CRCs) every framePeriodUs once booted, and discard
+// packets otherwise. Every frame has the same pseudorandom contents, so readouts can be compared.
+struct SimCamera {
+  static constexpr int kResetPin = 2;
+  static constexpr int kPwrdnPin = 3;
+  static constexpr size_t kPacketHeaderLen = 4;
+  static constexpr size_t kMaxPacketDataLen = 240;
+  static constexpr int kPacketsPerSegment = 60, kSegmentsPerFrame = 4;
+
+  std::atomic<uint64_t> nowUs{0};
+
+  uint32_t bootMs = 900, ffcMs = 1100;
+  uint32_t framePeriodUs = 37037;  // 27 Hz
+  size_t packetDataLen = 160;  // 160 for Raw14, 240 for RGB888
+
+  // observed state, for test assertions
+  long wakes = 0;  // releases from reset while powered
+  long i2cFails = 0;  // I2C transactions NACKed while not booted
+  long frames = 0;  // complete frames emitted
+  uint64_t awakeUs = 0;  // total time powered
+
+  void advance(uint64_t us) {
+    nowUs += us;
+  }
+
+  void pin(int pin, int value);
+  bool isBooted();
+  bool isFfcDone();
+
+  // Fills the next VoSPI packet (kPacketHeaderLen + packetDataLen bytes), returns its length
+  size_t nextPacket(uint8_t* packet);
+  // Drops a partially sent frame, as the camera does when a readout falls behind
+  void dropFrame();
+
+  // VoSPI CRC, CCITT polynomial with zero seed
+  static uint16_t crc16(const uint8_t* data, size_t len, uint16_t crc);
+
+protected:
+  int reset_ = 0, pwrdn_ = 1;
+  bool booting_ = false;
+  uint64_t bootStartUs_ = 0, poweredSinceUs_ = 0;
+  uint64_t nextFrameUs_ = 0;
+  int packet_ = -1, segment_ = 0;
+
+  // frame contents, generated on first use and when packetDataLen changes, so readouts are cheap to simulate
+  void generateFrame();
+  size_t generatedDataLen_ = 0;
+  uint8_t frame_[kSegmentsPerFrame][kPacketsPerSegment][kPacketHeaderLen + kMaxPacketDataLen];
+};
+
+extern SimCamera sim;
+
+#endif
@@ -0,0 +1,103 @@
+// Frame allocators: arena and pool bookkeeping, managed frame buffer reallocation and its retry after a failure,
+// and the peak memory of each buffer configuration
+#include "lepton.h"
+#include "lepton_test.h"
+
+static uint8_t region[600000];
+
+const size_t kGrey14Len = 160 * 120 * 2, kRgb888Len = 160 * 120 * 3;
+
+void setGrey14(FlirLepton& lepton) {
+  CHECK(lepton.setVideoParameters(2, 160, 120, 160, 60, 4));
+}
+bool setRgb888(FlirLepton& lepton) {
+  return lepton.setVideoParameters(3, 160, 120, 240, 60, 4);
+}
+
+void testArena() {
+  ArenaAllocator arena(region + 1, 1000);  // unaligned region
+  void* a = arena.allocate(10);
+  void* b = arena.allocate(20);
+  void* c = arena.allocate(30);
+  CHECK(a != nullptr && b != nullptr && c != nullptr);
+  CHECK((uintptr_t)a % 4 == 0 && (uintptr_t)b % 4 == 0 && (uintptr_t)c % 4 == 0);
+  size_t usedAll = arena.getUsed();
+  arena.release(b);  // not on top, reclaimed once everything above it is released
+  CHECK(arena.getUsed() < usedAll);
+  size_t freeWithHole = arena.getFree();
+  arena.release(c);
+  CHECK(arena.getFree() > freeWithHole);
+  arena.release(a);
+  CHECK(arena.getUsed() == 0 && arena.getPeak() == usedAll);
+  CHECK(arena.allocate(2000) == nullptr);
+}
+
+void testPool() {
+  PoolAllocator pool(region, 1000, 100);
+  CHECK(pool.getNumBlocks() == 10);
+  void* blocks[10];
+  for (size_t i = 0; i < 10; i++) {
+    blocks[i] = pool.allocate(100);
+    CHECK(blocks[i] != nullptr);
+  }
+  CHECK(pool.allocate(1) == nullptr);
+  pool.release(blocks[3]);
+  CHECK(pool.allocate(101) == nullptr);  // larger than a block
+  CHECK(pool.allocate(50) == blocks[3]);
+}
+
+// an arena that fits two Grey14 buffers but not two RGB888 buffers: the format change fails with no buffers held,
+// and switching back retries the allocation with the same count
+void testRetry() {
+  TwoWire wire;
+  SPIClass spi;
+  FlirLepton lepton(wire, spi, 1, SimCamera::kResetPin);
+  ArenaAllocator arena(region, 2 * kGrey14Len + 1024);
+  CHECK(lepton.setFrameBuffers(&arena, 2));
+  CHECK(lepton.getFrameBuffer(0) != nullptr && lepton.getFrameBuffer(1) != nullptr);
+
+  CHECK(!setRgb888(lepton));
+  CHECK(lepton.getFrameBuffer(0) == nullptr && lepton.getFrameBuffer(1) == nullptr);
+  CHECK(arena.getUsed() == 0);
+
+  setGrey14(lepton);
+  CHECK(lepton.getFrameBuffer(0) != nullptr && lepton.getFrameBuffer(1) != nullptr);
+  CHECK(lepton.getFrameBuffer(2) == nullptr);
+  lepton.setFrameBuffers(nullptr, 0);
+  CHECK(arena.getUsed() == 0);
+}
+
+void reportPeaks() {
+  for (size_t count = 1; count <= 3; count++) {
+    for (bool rgb : {false, true}) {
+      TwoWire wire;
+      SPIClass spi;
+      FlirLepton lepton(wire, spi, 1, SimCamera::kResetPin);
+      ArenaAllocator arena(region, sizeof(region));
+      HeapAllocator heap;
+      for (FrameAllocator* allocator : {(FrameAllocator*)&arena, (FrameAllocator*)&heap}) {
+        CHECK(lepton.setFrameBuffers(allocator, count));
+        if (rgb) {
+          CHECK(setRgb888(lepton));
+        }
+        size_t used = allocator->getUsed(), peak = allocator->getPeak();
+        CHECK(used >= count * (rgb ? kRgb888Len : kGrey14Len));
+        setGrey14(lepton);
+        printf("%s x%zu %-5s: used %6zu B, peak %6zu B, after switching to Grey14 used %6zu B, peak %6zu B\n",
+            rgb ? "RGB888" : "Grey14", count, allocator == &heap ? "heap" : "arena", used, peak,
+            allocator->getUsed(), allocator->getPeak());
+        CHECK(allocator->getUsed() <= used);
+        lepton.setFrameBuffers(nullptr, 0);
+        CHECK(allocator->getUsed() == 0);
+      }
+    }
+  }
+}
+
+int main() {
+  testArena();
+  testPool();
+  testRetry();
+  reportPeaks();
+  return 0;
+}
@@ -0,0 +1,187 @@
+// Blob tracker on synthetic frames: 4-connected and diagonal-only (8-connected) pixels merge while a one-pixel gap
+// doesn't, runs that only join further down (a U) merge into one blob, IDs stay stable while blobs move and new
+// blobs get new ones, and both the reported blobs (largest kMaxBlobs) and the provisional labels are truncated at
+// their maximum. Benchmarks ns/frame for an empty frame, a few blobs, and a frame that overflows the labels.
+#include <string.h>
+#include "lepton_blobs.h"
+#include "lepton_test.h"
+
+const size_t kWidth = 160, kHeight = 120;
+const uint16_t kBackground = 29500, kHot = 31000;  // ~22 C and ~37 C in TLinear, around the default 30 C threshold
+
+static uint8_t frame[kWidth * kHeight * 2];
+
+void clear() {
+  for (size_t i = 0; i < kWidth * kHeight; i++) {
+    frame[2 * i] = kBackground >> 8;
+    frame[2 * i + 1] = kBackground & 0xff;
+  }
+}
+
+void set(size_t x, size_t y, uint16_t value = kHot) {
+  frame[2 * (y * kWidth + x)] = value >> 8;
+  frame[2 * (y * kWidth + x) + 1] = value & 0xff;
+}
+
+void fillRect(size_t x, size_t y, size_t width, size_t height) {
+  for (size_t j = y; j < y + height; j++) {
+    for (size_t i = x; i < x + width; i++) {
+      set(i, j);
+    }
+  }
+}
+
+void testConnectivity() {
+  BlobTracker tracker(kWidth, kHeight);
+  tracker.setMinArea(1);
+
+  // a plus, 4-connected
+  clear();
+  fillRect(20, 10, 1, 5);
+  fillRect(18, 12, 5, 1);
+  CHECK(tracker.process(frame) == 1 && tracker.getBlob(0).area == 9);
+
+  // a diagonal, connected only through corners
+  clear();
+  for (size_t i = 0; i < 6; i++) {
+    set(40 + i, 40 + i);
+  }
+  CHECK(tracker.process(frame) == 1 && tracker.getBlob(0).area == 6);
+  const BlobTracker::Blob& diagonal = tracker.getBlob(0);
+  CHECK(diagonal.minX == 40 && diagonal.minY == 40 && diagonal.maxXBound == 45 && diagonal.maxYBound == 45);
+  CHECK(diagonal.centroidX == 43 * 16 && diagonal.centroidY == 43 * 16);  // (40 + 45) / 2 + 0.5
+
+  // an anti-diagonal, whose runs end before the next row's start
+  clear();
+  for (size_t i = 0; i < 6; i++) {
+    set(70 - i, 40 + i);
+  }
+  CHECK(tracker.process(frame) == 1 && tracker.getBlob(0).area == 6);
+
+  // a U: the arms get separate labels, merged at the bottom, with the hottest pixel in the second arm
+  clear();
+  fillRect(100, 60, 2, 10);
+  fillRect(110, 60, 2, 10);
+  fillRect(100, 70, 12, 2);
+  set(111, 61, kHot + 100);
+  CHECK(tracker.process(frame) == 1);
+  const BlobTracker::Blob& u = tracker.getBlob(0);
+  CHECK(u.area == 2 * 20 + 24 && u.minX == 100 && u.maxXBound == 111 && u.minY == 60 && u.maxYBound == 71);
+  CHECK(u.maxValue == kHot + 100 && u.maxX == 111 && u.maxY == 61);
+
+  // a one pixel gap, in either direction, keeps blobs apart
+  clear();
+  fillRect(10, 100, 3, 3);
+  fillRect(14, 100, 3, 3);
+  fillRect(10, 104, 3, 3);
+  CHECK(tracker.process(frame) == 3 && !tracker.getTruncated());
+
+  // blobs under the minimum area aren't reported
+  tracker.setMinArea(10);
+  CHECK(tracker.process(frame) == 0);
+}
+
+void testTracking() {
+  BlobTracker tracker(kWidth, kHeight);
+  tracker.setMaxTrackDistance(8);
+  uint16_t bigId = 0, smallId = 0;
+  for (int n = 0; n < 50; n++) {
+    clear();
+    fillRect(10 + n, 20, 8, 8);  // moving right 1 px/frame
+    fillRect(120, 100 - n, 4, 4);  // moving up
+    CHECK(tracker.process(frame) == 2);
+    const BlobTracker::Blob& big = tracker.getBlob(0);
+    const BlobTracker::Blob& small = tracker.getBlob(1);
+    CHECK(big.area == 64 && small.area == 16);
+    if (n == 0) {
+      bigId = big.id;
+      smallId = small.id;
+      CHECK(bigId != 0 && smallId != 0 && bigId != smallId);
+    }
+    CHECK(big.id == bigId && small.id == smallId && big.age == n && small.age == n);
+  }
+
+  // a new blob gets a new ID, and one that jumps further than the track distance is a new blob
+  clear();
+  fillRect(60, 20, 8, 8);
+  fillRect(120, 51, 4, 4);
+  fillRect(30, 80, 5, 5);
+  CHECK(tracker.process(frame) == 3);
+  CHECK(tracker.getBlob(0).id == bigId && tracker.getBlob(2).id == smallId);
+  uint16_t newId = tracker.getBlob(1).id;
+  CHECK(newId != bigId && newId != smallId && tracker.getBlob(1).age == 0);
+  clear();
+  fillRect(60, 20, 8, 8);
+  fillRect(120, 51, 4, 4);
+  fillRect(50, 80, 5, 5);
+  CHECK(tracker.process(frame) == 3 && tracker.getBlob(1).id != newId && tracker.getBlob(1).age == 0);
+}
+
+void testTruncation() {
+  BlobTracker tracker(kWidth, kHeight);
+  tracker.setMinArea(1);
+
+  // more blobs than kMaxBlobs: the largest are reported, in order
+  const size_t kBlobs = BlobTracker::kMaxBlobs + 8;
+  clear();
+  for (size_t i = 0; i < kBlobs; i++) {
+    fillRect(2 + (i % 8) * 20, 2 + (i / 8) * 20, 1 + i % 8, 1 + i / 8 + i % 3);
+  }
+  CHECK(tracker.process(frame) == BlobTracker::kMaxBlobs && !tracker.getTruncated());
+  uint32_t smallestReported = tracker.getBlob(BlobTracker::kMaxBlobs - 1).area;
+  for (size_t i = 1; i < BlobTracker::kMaxBlobs; i++) {
+    CHECK(tracker.getBlob(i).area <= tracker.getBlob(i - 1).area);
+  }
+  size_t larger = 0;
+  for (size_t i = 0; i < kBlobs; i++) {
+    larger += (1 + i % 8) * (1 + i / 8 + i % 3) > smallestReported;
+  }
+  CHECK(larger < BlobTracker::kMaxBlobs);
+
+  // more components than provisional labels: the rest of the frame is skipped, and reported as truncated
+  clear();
+  for (size_t y = 0; y < kHeight; y += 2) {
+    for (size_t x = 0; x < kWidth; x += 2) {
+      set(x, y);
+    }
+  }
+  CHECK(tracker.process(frame) == BlobTracker::kMaxBlobs && tracker.getTruncated());
+  clear();
+  fillRect(10, 10, 4, 4);
+  CHECK(tracker.process(frame) == 1 && !tracker.getTruncated());
+}
+
+double benchmark(const char* name) {
+  const int kFrames = 500;
+  BlobTracker tracker(kWidth, kHeight);
+  tracker.process(frame);
+  Stopwatch time;
+  size_t blobs = 0;
+  for (int n = 0; n < kFrames; n++) {
+    blobs = tracker.process(frame);
+  }
+  double frameNanos = time.elapsedNanos() / kFrames;
+  printf("%-16s %2u blobs%s: %7.0f ns/frame (%.1f ns/pixel)\n", name, (unsigned)blobs,
+      tracker.getTruncated() ? " (truncated)" : "", frameNanos, frameNanos / (kWidth * kHeight));
+  return frameNanos;
+}
+
+int main() {
+  testConnectivity();
+  testTracking();
+  testTruncation();
+
+  clear();
+  benchmark("empty");
+  fillRect(20, 20, 30, 40);
+  fillRect(80, 50, 10, 10);
+  fillRect(120, 90, 20, 8);
+  benchmark("3 blobs");
+  for (size_t y = 0; y < kHeight; y += 2) {
+    for (size_t x = 0; x < kWidth; x += 2) {
+      set(x, y);
+    }
+  }
+  benchmark("label overflow");
+  return 0;
+}
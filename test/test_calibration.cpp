@@ -0,0 +1,89 @@
+// SPI clock calibration against a simulated bus whose bit error rate depends on the clock: the fastest reliable
+// clock is selected for a short trace and a long cable, an unreliable link keeps the previous clock, and streaming
+// at the calibrated clock against the fastest one
+#include "lepton.h"
+#include "lepton_test.h"
+
+static uint8_t frame[160 * 120 * 2];
+
+double shortTrace(uint32_t) {
+  return 0;
+}
+// marginal above 11 MHz, unusable above 14 MHz
+double longCable(uint32_t clock) {
+  return clock > 14000000 ? 2e-4 * (clock - 14000000) / 1e6 : clock > 11000000 ? 1e-7 : 0;
+}
+double unreliable(uint32_t) {
+  return 1e-3;
+}
+
+uint32_t calibrate(FlirLepton& lepton, const char* name) {
+  FlirLepton::SpiCalibrationResult results[8];
+  CHECK(FlirLepton::kNumDefaultSpiCalibrationClocks <= 8);
+  uint64_t startUs = sim.nowUs;
+  uint32_t clock = lepton.calibrateSpi(sizeof(frame), frame, 20, 5000, FlirLepton::kDefaultSpiCalibrationClocks,
+      FlirLepton::kNumDefaultSpiCalibrationClocks, results);
+  printf("%s: selected %u Hz in %.1f s\n", name, (unsigned)clock, (sim.nowUs - startUs) / 1e6);
+  for (size_t i = 0; i < FlirLepton::kNumDefaultSpiCalibrationClocks; i++) {
+    const FlirLepton::SpiCalibrationResult& result = results[i];
+    printf("  %8u Hz: %2u frames, %5u packets, %3u CRC errors, %2u sync errors, %4u ms %s\n", (unsigned)result.clock,
+        (unsigned)result.frames, (unsigned)result.packets, (unsigned)result.crcErrors, (unsigned)result.syncErrors,
+        (unsigned)result.elapsedMillis, result.reliable ? "reliable" : "");
+  }
+  return clock;
+}
+
+const FlirLepton::VoSpiStats& stream(FlirLepton& lepton, uint32_t millis) {
+  lepton.resetVoSpiStats();
+  uint64_t startUs = sim.nowUs;
+  while (sim.nowUs - startUs < millis * 1000ull) {
+    lepton.readVoSpi(sizeof(frame), frame);
+  }
+  return lepton.getVoSpiStats();
+}
+
+int main() {
+  TwoWire wire;
+  SPIClass spi;
+  FlirLepton lepton(wire, spi, 1, SimCamera::kResetPin);
+  FlirLepton::BootPolicy policy = FlirLepton::kDefaultBootPolicy;
+  policy.waitForFfc = false;
+  lepton.setBootPolicy(policy);
+  CHECK(lepton.begin());
+  while (!lepton.isReady()) {
+    sim.advance(1000);
+  }
+
+  spi.errorRate = shortTrace;
+  CHECK(calibrate(lepton, "short trace") == 20000000 && lepton.getSpiClock() == 20000000);
+  spi.errorRate = longCable;
+  uint32_t selected = calibrate(lepton, "long cable");
+  CHECK(selected >= 10000000 && selected <= 13333333 && lepton.getSpiClock() == selected);
+
+  // streaming with CRC checking over the long cable, at the fastest clock and the calibrated one
+  lepton.setVoSpiCrcCheck(true);
+  uint32_t crcErrors[2];
+  for (int i = 0; i < 2; i++) {
+    uint32_t clock = i == 0 ? 20000000 : selected;
+    lepton.setSpiSettings(clock);
+    const FlirLepton::VoSpiStats& stats = stream(lepton, 30000);
+    printf("long cable at %8u Hz, 30 s: %u frames, %u packets, %u CRC errors, %u sync errors, %u resyncs\n",
+        (unsigned)clock, (unsigned)stats.frames, (unsigned)stats.packets, (unsigned)stats.crcErrors,
+        (unsigned)stats.syncErrors, (unsigned)stats.resyncs);
+    crcErrors[i] = stats.crcErrors;
+  }
+  CHECK(crcErrors[0] > 0 && crcErrors[1] < crcErrors[0]);
+
+  // an unreliable link at every clock keeps the previous clock
+  spi.errorRate = unreliable;
+  lepton.setSpiSettings(16000000);
+  CHECK(lepton.calibrateSpi(sizeof(frame), frame) == 0 && lepton.getSpiClock() == 16000000);
+
+  // the CRC check passes everything on an error-free link
+  spi.errorRate = shortTrace;
+  const FlirLepton::VoSpiStats& stats = stream(lepton, 5000);
+  printf("error-free link at %u Hz, 5 s: %u frames, %u CRC errors\n", (unsigned)lepton.getSpiClock(),
+      (unsigned)stats.frames, (unsigned)stats.crcErrors);
+  CHECK(stats.crcErrors == 0 && stats.syncErrors == 0 && stats.frames > 100 && spi.bitFlips > 0);
+  return 0;
+}
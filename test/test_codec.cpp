@@ -0,0 +1,81 @@
+// Lossless codec round trip, compression ratio and encode/decode throughput on synthetic Raw14 scenes
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "lepton_codec.h"
+#include "lepton_test.h"
+
+const size_t kWidth = 160, kHeight = 120, kFrameLen = kWidth * kHeight * 2;
+
+// slowly panning smooth scene with sensor noise, and a saturated pixel on one frame
+void makeFrame(uint8_t* frame, int n, int noise) {
+  for (size_t y = 0; y < kHeight; y++) {
+    for (size_t x = 0; x < kWidth; x++) {
+      size_t i = y * kWidth + x;
+      int value = 29500 + (int)(300 * sin((x + n) * 0.05) * cos(y * 0.07)) + rand() % noise;
+      if (n == 5 && x == 3 && y == 7) {
+        value = 0x3fff;
+      }
+      frame[2 * i] = value >> 8;
+      frame[2 * i + 1] = value & 0xff;
+    }
+  }
+}
+
+void benchmark(const char* name, int noise, double minRatio) {
+  const int kFrames = 200;
+  static uint16_t encRef[kWidth * kHeight], decRef[kWidth * kHeight];
+  static uint8_t frame[kFrameLen], decoded[kFrameLen];
+  std::vector<uint8_t> out(LeptonCodec::maxEncodedLen(kWidth, kHeight));
+  LosslessEncoder encoder(kWidth, kHeight, encRef, 30);
+  LosslessDecoder decoder(kWidth, kHeight, decRef);
+
+  srand(3);
+  size_t encodedBytes = 0;
+  double encodeNanos = 0, decodeNanos = 0;
+  for (int n = 0; n < kFrames; n++) {
+    makeFrame(frame, n, noise);
+    Stopwatch encodeTime;
+    size_t len = encoder.encode(frame, out.data(), out.size());
+    encodeNanos += encodeTime.elapsedNanos();
+    CHECK(len > 0);
+    encodedBytes += len;
+
+    Stopwatch decodeTime;
+    CHECK(decoder.decode(out.data(), len, decoded));
+    decodeNanos += decodeTime.elapsedNanos();
+    CHECK(memcmp(frame, decoded, kFrameLen) == 0);
+  }
+
+  double ratio = (double)kFrames * kFrameLen / encodedBytes;
+  printf("%-12s ratio %.2f, encode %.2f ns/px, decode %.2f ns/px\n", name, ratio,
+      encodeNanos / kFrames / (kWidth * kHeight), decodeNanos / kFrames / (kWidth * kHeight));
+  CHECK(ratio >= minRatio);
+}
+
+int main() {
+  benchmark("low noise", 12, 2.0);
+  benchmark("high noise", 256, 1.0);
+
+  // an insufficient output buffer fails the encode and forces a keyframe, which the decoder resyncs on
+  static uint16_t encRef[kWidth * kHeight], decRef[kWidth * kHeight];
+  static uint8_t frame[kFrameLen], decoded[kFrameLen];
+  std::vector<uint8_t> out(LeptonCodec::maxEncodedLen(kWidth, kHeight));
+  LosslessEncoder encoder(kWidth, kHeight, encRef, 0);
+  LosslessDecoder decoder(kWidth, kHeight, decRef);
+  makeFrame(frame, 0, 12);
+  size_t len = encoder.encode(frame, out.data(), out.size());
+  CHECK(decoder.decode(out.data(), len, decoded));
+  makeFrame(frame, 1, 12);
+  CHECK(encoder.encode(frame, out.data(), 100) == 0);
+  len = encoder.encode(frame, out.data(), out.size());
+  CHECK(out[2] & LeptonCodec::kFlagKeyframe);  // header flags
+  CHECK(decoder.decode(out.data(), len, decoded) && decoder.lastWasKeyframe());
+  CHECK(memcmp(frame, decoded, kFrameLen) == 0);
+
+  // truncated frames are rejected
+  makeFrame(frame, 2, 12);
+  len = encoder.encode(frame, out.data(), out.size());
+  CHECK(!decoder.decode(out.data(), len - 50, decoded));
+  return 0;
+}
@@ -0,0 +1,156 @@
+// Controller under concurrent use: requester threads queue format, mode and command changes while status readers
+// poll and frame buffer readers hold buffers as the webserver example does. Every request is accounted for, status
+// snapshots are self-consistent, and buffers never change under a reader.
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "lepton_controller.h"
+#include "lepton_test.h"
+
+const int kRequesters = 3, kIterations = 500;
+
+// the example's bufferControlSemaphore and reader count: the config hook holds the lock from before to after, once
+// readers have drained
+std::mutex bufferControl;
+std::atomic<int> bufferReaders{0};
+std::atomic<long> hookCalls{0};
+
+void configHook(bool before, void*) {
+  if (before) {
+    bufferControl.lock();
+    while (bufferReaders > 0) {
+      std::this_thread::yield();
+    }
+    hookCalls++;
+  } else {
+    bufferControl.unlock();
+  }
+}
+
+bool countCommand(FlirLepton&, void* context) {
+  (*(std::atomic<int>*)context)++;
+  return true;
+}
+
+int main() {
+  TwoWire wire;
+  SPIClass spi;
+  FlirLepton lepton(wire, spi, 1, SimCamera::kResetPin);
+  LeptonController controller(lepton);
+  HeapAllocator heap;
+  FlirLepton::BootPolicy policy = FlirLepton::kDefaultBootPolicy;
+  policy.waitForFfc = false;
+  lepton.setBootPolicy(policy);
+  CHECK(lepton.setFrameBuffers(&heap, 2));
+  CHECK(lepton.begin());
+  controller.setConfigHook(configHook, nullptr);
+
+  std::atomic<bool> stop{false};
+  std::thread capture([&]() {
+    while (!stop) {  // writes buffer 1 only, the reader holds buffer 0 (the example flips between them)
+      controller.readVoSpi(lepton.getFrameBufferLen(), lepton.getFrameBuffer(1));
+    }
+  });
+
+  std::atomic<int> commandsRun{0};
+  std::atomic<long> requested{0};
+  std::thread requesters[kRequesters];
+  for (std::thread& requester : requesters) {
+    requester = std::thread([&]() {
+      for (int i = 0; i < kIterations; i++) {
+        if (i % 2) {
+          controller.requestVideoFormat(FlirLepton::kGrey14);
+          requested++;
+        } else {
+          controller.requestVideoMode(FlirLepton::kAgcHeq);
+          controller.requestVideoFormat(FlirLepton::kRgb888);
+          requested += 2;
+        }
+        controller.requestCommand(countCommand, &commandsRun);
+        requested++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    });
+  }
+
+  std::atomic<long> violations{0}, snapshots{0}, bufferReads{0};
+  std::thread statusReader([&]() {
+    while (!stop) {
+      LeptonController::Status status = controller.getStatus();
+      if ((status.bytesPerPixel != 2 && status.bytesPerPixel != 3) ||
+          (status.videoFormat == FlirLepton::kRgb888) != (status.bytesPerPixel == 3) ||
+          status.frameWidth != 160 || status.frameHeight != 120) {
+        violations++;
+      }
+      snapshots++;
+    }
+  });
+  std::thread bufferReader([&]() {
+    static uint8_t copy[160 * 120 * 3 * 2];
+    while (!stop) {
+      LeptonController::Status status;
+      uint8_t* frame;
+      size_t frameLen;
+      {
+        std::lock_guard<std::mutex> lock(bufferControl);
+        bufferReaders++;
+        status = controller.getStatus();
+        frame = lepton.getFrameBuffer(0);
+        frameLen = lepton.getFrameBufferLen();
+      }
+      // the snapshot matches the buffers held, and both stay valid until the reader is done
+      if (frame == nullptr || frameLen < (size_t)status.bytesPerPixel * status.frameWidth * status.frameHeight ||
+          frameLen > sizeof(copy)) {
+        violations++;
+      } else {
+        memcpy(copy, frame, frameLen);
+        if (lepton.getFrameBuffer(0) != frame) {
+          violations++;
+        }
+      }
+      bufferReaders--;
+      bufferReads++;
+      std::this_thread::sleep_for(std::chrono::microseconds(10));  // as if waiting for the next frame
+    }
+  });
+
+  for (std::thread& requester : requesters) {
+    requester.join();
+  }
+  // back to the format the simulated camera streams, then streaming resumes once the queue drains
+  for (bool queued = false; !queued; requested++) {
+    queued = controller.requestVideoFormat(FlirLepton::kGrey14);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  uint32_t framesBefore = controller.getStatus().framesRead;
+  LeptonController::Status status;
+  for (int i = 0; i < 10000; i++) {
+    status = controller.getStatus();
+    if (status.requestsPending == 0 &&
+        status.requestsApplied + status.requestsFailed + status.requestsDropped == requested &&
+        status.framesRead >= framesBefore + 10) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  stop = true;
+  capture.join();
+  statusReader.join();
+  bufferReader.join();
+
+  printf("%ld requested: %u applied, %u failed, %u dropped, %u pending; %u config generations, %ld hook calls, "
+      "%u frames, %d commands run\n", (long)requested, (unsigned)status.requestsApplied, (unsigned)status.requestsFailed,
+      (unsigned)status.requestsDropped, (unsigned)status.requestsPending, (unsigned)status.configGeneration,
+      (long)hookCalls, (unsigned)status.framesRead, (int)commandsRun);
+  printf("%ld status snapshots, %ld buffer reads, %ld violations\n", (long)snapshots, (long)bufferReads,
+      (long)violations);
+  CHECK(status.bootPhase == FlirLepton::kBootReady);
+  CHECK(status.requestsPending == 0);
+  CHECK(status.requestsApplied + status.requestsFailed + status.requestsDropped == requested);
+  CHECK(status.requestsFailed == 0);
+  CHECK(status.configGeneration == hookCalls && hookCalls > 0);
+  CHECK(status.framesRead >= framesBefore + 10 && status.bytesPerPixel == 2);
+  CHECK(violations == 0 && snapshots > 0 && bufferReads > 0);
+  return 0;
+}
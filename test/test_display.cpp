@@ -0,0 +1,158 @@
+// RGB565 line writer: pixel conversion (RGB888, and 16-bit through the palette with saturating AGC), a ring of two
+// lines keeping up with a display that finishes each line's DMA one line late, and a full simulated readout through
+// readVoSpiLines. Benchmarks ns per source row and output line, and the line-buffer memory against a full
+// RGB565 frame buffer, at scales 1-3.
+#include <string.h>
+#include <vector>
+#include "lepton.h"
+#include "lepton_display.h"
+#include "lepton_test.h"
+
+const size_t kWidth = 160, kHeight = 120, kPacketPixels = 80;
+
+// display driver model: each line's DMA completes once dmaLag more lines have been passed to it
+struct Display {
+  Rgb565LineWriter* writer;
+  size_t dmaLag;
+  size_t outstanding, peakOutstanding;
+  uint32_t lines;
+  uint16_t firstPixel;  // of the last line
+};
+
+void lineReady(const uint16_t* line, uint16_t y, uint16_t lineWidth, void* context) {
+  Display* display = (Display*)context;
+  display->firstPixel = line[0];
+  display->lines++;
+  if (++display->outstanding > display->peakOutstanding) {
+    display->peakOutstanding = display->outstanding;
+  }
+  if (display->outstanding > display->dmaLag) {
+    display->writer->lineDone();
+    display->outstanding--;
+  }
+}
+
+void finishDma(Display& display) {
+  for (; display.outstanding > 0; display.outstanding--) {
+    display.writer->lineDone();
+  }
+}
+
+void writeFrame(Rgb565LineWriter& writer, const uint8_t* frame, size_t bytesPerPixel) {
+  for (size_t row = 0; row < kHeight; row++) {
+    for (size_t x = 0; x < kWidth; x += kPacketPixels) {
+      writer.onPacket(row, x, frame + (row * kWidth + x) * bytesPerPixel, kPacketPixels, bytesPerPixel);
+    }
+  }
+  writer.onFrameEnd(true);
+}
+
+void testConversion() {
+  uint16_t lines[2 * kWidth];
+  Display display = {};
+  Rgb565LineWriter writer(kWidth, 1, lines, 2, lineReady, &display);
+  display.writer = &writer;
+
+  const uint8_t rgb[kPacketPixels * 3] = {0xff, 0x80, 0x08};
+  const uint16_t kPixel = (0x1f << 11) | (0x20 << 5) | 0x01;
+  writer.onPacket(0, 0, rgb, kPacketPixels, 3);
+  writer.onFrameEnd(true);
+  CHECK(display.firstPixel == kPixel);
+  writer.setSwapBytes(true);
+  writer.onPacket(0, 0, rgb, kPacketPixels, 3);
+  writer.onFrameEnd(true);
+  CHECK(display.firstPixel == (uint16_t)((kPixel >> 8) | (kPixel << 8)));
+  writer.setSwapBytes(false);
+
+  uint16_t palette[256];
+  for (int i = 0; i < 256; i++) {
+    palette[i] = i;
+  }
+  writer.setPalette(palette);
+  writer.setRange(1000, 1255);
+  const uint16_t kValues[] = {0, 999, 1000, 1128, 1255, 1256, 0xffff};
+  const uint16_t kIndices[] = {0, 0, 0, 127, 254, 255, 255};  // 256 values over 256 entries
+  for (size_t i = 0; i < sizeof(kValues) / sizeof(kValues[0]); i++) {
+    uint8_t packet[kPacketPixels * 2] = {(uint8_t)(kValues[i] >> 8), (uint8_t)(kValues[i] & 0xff)};
+    writer.onPacket(0, 0, packet, kPacketPixels, 2);
+    writer.onFrameEnd(true);
+    CHECK(display.firstPixel == kIndices[i]);
+  }
+  finishDma(display);
+  CHECK(writer.getDroppedRows() == 0);
+}
+
+// returns ns per source row
+double benchmark(const uint8_t* frame, size_t bytesPerPixel, uint8_t scale) {
+  const int kFrames = 200;
+  std::vector<uint16_t> lines(Rgb565LineWriter::getLinesLen(kWidth, scale, 2) / sizeof(uint16_t));
+  Display display = {};
+  display.dmaLag = scale;  // a source row's lines complete while the next row is being read
+  Rgb565LineWriter writer(kWidth, scale, lines.data(), 2, lineReady, &display);
+  display.writer = &writer;
+  writeFrame(writer, frame, bytesPerPixel);  // warm up, and sets the AGC range
+  Stopwatch time;
+  for (int n = 0; n < kFrames; n++) {
+    writeFrame(writer, frame, bytesPerPixel);
+  }
+  double rowNanos = time.elapsedNanos() / kFrames / kHeight;
+  finishDma(display);
+
+  size_t linesLen = Rgb565LineWriter::getLinesLen(kWidth, scale, 2), frameLen = kWidth * scale * kHeight * scale * 2;
+  size_t peakLen = (display.peakOutstanding + scale - 1) / scale * kWidth * scale * sizeof(uint16_t);
+  printf("%s x%u: %6.0f ns/row, %5.0f ns/output line; line buffers %5zu B (peak in use %5zu B), frame buffer %6zu B\n",
+      bytesPerPixel == 3 ? "RGB888" : "16-bit", scale, rowNanos, rowNanos / scale, linesLen, peakLen, frameLen);
+  CHECK(writer.getDroppedRows() == 0 && display.lines == (kFrames + 1) * kHeight * scale);
+  CHECK(peakLen <= linesLen);
+  return rowNanos;
+}
+
+// a full readout through readVoSpiLines, with the display one line behind
+void testReadout() {
+  sim.framePeriodUs = 0;  // frames back to back
+  TwoWire wire;
+  SPIClass spi;
+  FlirLepton lepton(wire, spi, 1, SimCamera::kResetPin);
+  FlirLepton::BootPolicy policy = FlirLepton::kDefaultBootPolicy;
+  policy.waitForFfc = false;
+  lepton.setBootPolicy(policy);
+  CHECK(lepton.begin());
+  while (!lepton.isReady()) {
+    sim.advance(1000);
+  }
+  uint16_t lines[2 * kWidth * 2];
+  Display display = {};
+  display.dmaLag = 2;
+  Rgb565LineWriter writer(kWidth, 2, lines, 2, lineReady, &display);
+  display.writer = &writer;
+  int frames = 0;
+  while (frames < 10) {
+    frames += lepton.readVoSpiLines(writer);
+  }
+  finishDma(display);
+  printf("readout: %d frames, %u lines, %u rows dropped\n", frames, (unsigned)display.lines,
+      (unsigned)writer.getDroppedRows());
+  CHECK(display.lines == 10 * kHeight * 2 && writer.getDroppedRows() == 0);
+}
+
+int main() {
+  testConversion();
+
+  static uint8_t grey[kWidth * kHeight * 2], rgb[kWidth * kHeight * 3];
+  srand(1);
+  for (size_t i = 0; i < kWidth * kHeight; i++) {
+    uint16_t value = 8000 + rand() % 2000;
+    grey[2 * i] = value >> 8;
+    grey[2 * i + 1] = value & 0xff;
+    rgb[3 * i] = rand();
+    rgb[3 * i + 1] = rand();
+    rgb[3 * i + 2] = rand();
+  }
+  for (uint8_t scale = 1; scale <= 3; scale++) {
+    benchmark(grey, 2, scale);
+    benchmark(rgb, 3, scale);
+  }
+
+  testReadout();
+  return 0;
+}
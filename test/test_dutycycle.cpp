@@ -0,0 +1,111 @@
+// Duty-cycled capture against the simulated camera's power and boot timing: frames captured per wake, skipped
+// frames, failing wake hooks and a camera that never boots, with the measured awake time per frame. Wakes derive their
+// boot policy from the camera's, which stop() restores
+#include "lepton_dutycycle.h"
+#include "lepton_test.h"
+
+static uint8_t frame[160 * 120 * 2];
+
+int hookCalls = 0;
+bool hookFails = false;
+FlirLepton::BootPolicy wakePolicy;
+
+bool wakeHook(FlirLepton& lepton, void*) {
+  hookCalls++;
+  wakePolicy = lepton.getBootPolicy();
+  return !hookFails && lepton.enableVsync();
+}
+
+int run(FlirLepton& lepton, LeptonDutyCycle& duty, uint32_t millis) {
+  int captured = 0;
+  uint64_t endUs = sim.nowUs + millis * 1000ull;
+  while (sim.nowUs < endUs) {
+    if (duty.poll(sizeof(frame), frame)) {
+      captured++;
+    }
+    CHECK(duty.getState() != LeptonDutyCycle::kAsleep || lepton.isPoweredDown());
+    uint32_t sleepMillis = duty.getSleepMillisRemaining();
+    sim.advance(sleepMillis > 0 ? sleepMillis * 1000ull : 200);  // the MCU sleeps while the camera is down
+  }
+  return captured;
+}
+
+void report(const char* name, LeptonDutyCycle& duty, int captured) {
+  LeptonDutyCycle::Stats stats = duty.getStats();
+  printf("%-30s %2u wakes, %2u failed, %2d captured, %2u skipped, boot %4u ms, awake %4u ms/wake, %4u ms/frame, "
+      "duty %4.1f%%\n", name, (unsigned)stats.wakes, (unsigned)stats.failedWakes, captured,
+      (unsigned)stats.framesSkipped, (unsigned)stats.lastBootMillis, (unsigned)stats.lastAwakeMillis,
+      (unsigned)duty.getAwakeMillisPerFrame(), stats.totalMillis ? 100.0 * stats.totalAwakeMillis / stats.totalMillis : 0);
+}
+
+int main() {
+  TwoWire wire;
+  SPIClass spi;
+  FlirLepton lepton(wire, spi, 1, SimCamera::kResetPin, SimCamera::kPwrdnPin);
+  LeptonDutyCycle duty(lepton);
+  CHECK(lepton.begin());
+  duty.setWakeHook(wakeHook, nullptr);
+  const FlirLepton::BootPolicy kPolicy = {950, 20, false, false, true};
+  lepton.setBootPolicy(kPolicy);
+
+  CHECK(duty.start());
+  CHECK(lepton.isPoweredDown() && !lepton.isReady());
+  int captured = run(lepton, duty, 60000);
+  report("default (FFC wait, 1 frame)", duty, captured);
+  CHECK(captured == 12 && duty.getStats().framesCaptured == 12 && duty.getStats().failedWakes == 0);
+  CHECK(hookCalls == 12);
+  // the Config overrides the I2C wait and FFC wait, and caches metadata, keeping the rest of the camera's policy
+  CHECK(wakePolicy.minI2cMillis == 0 && wakePolicy.pollIntervalMillis == 20 && !wakePolicy.readMetadata &&
+      wakePolicy.cacheMetadata && wakePolicy.waitForFfc);
+  duty.stop();
+  CHECK(duty.getState() == LeptonDutyCycle::kStopped && lepton.isPoweredDown());
+  const FlirLepton::BootPolicy& restored = lepton.getBootPolicy();
+  CHECK(restored.minI2cMillis == 950 && restored.pollIntervalMillis == 20 && !restored.readMetadata &&
+      !restored.cacheMetadata && restored.waitForFfc);
+
+  LeptonDutyCycle::Config config = LeptonDutyCycle::kDefaultConfig;
+  config.waitForFfc = false;
+  config.framesPerWake = 3;
+  config.skipFrames = 2;
+  duty.setConfig(config);
+  CHECK(duty.start());
+  captured = run(lepton, duty, 60000);
+  report("no FFC wait, skip 2, 3 frames", duty, captured);
+  CHECK(captured == 36 && duty.getStats().framesSkipped == 24 && duty.getStats().failedWakes == 0);
+  duty.stop();
+
+  // the IDD's conservative I2C wait lengthens each boot
+  uint32_t earlyPollBootMillis = duty.getStats().lastBootMillis;
+  config = LeptonDutyCycle::kDefaultConfig;
+  config.waitForFfc = false;
+  config.minI2cMillis = 950;
+  duty.setConfig(config);
+  CHECK(duty.start());
+  captured = run(lepton, duty, 60000);
+  report("no FFC wait, 950 ms I2C wait", duty, captured);
+  CHECK(captured == 12 && duty.getStats().lastBootMillis > earlyPollBootMillis);
+  duty.stop();
+
+  hookFails = true;
+  duty.setConfig(LeptonDutyCycle::kDefaultConfig);
+  CHECK(duty.start());
+  captured = run(lepton, duty, 20000);
+  report("failing wake hook", duty, captured);
+  CHECK(captured == 0 && duty.getStats().wakes > 0 && duty.getStats().failedWakes == duty.getStats().wakes);
+  CHECK(lepton.isPoweredDown());
+  duty.stop();
+  hookFails = false;
+
+  sim.bootMs = 20000;
+  config = LeptonDutyCycle::kDefaultConfig;
+  config.wakeTimeoutMillis = 3000;
+  duty.setConfig(config);
+  CHECK(duty.start());
+  captured = run(lepton, duty, 20000);
+  report("camera never boots", duty, captured);
+  CHECK(captured == 0 && duty.getStats().wakes > 1 && duty.getStats().failedWakes + 1 >= duty.getStats().wakes);
+  duty.stop();
+  printf("simulated camera: %ld wakes, %ld I2C probes NACKed, powered %.1f%% of the time\n", sim.wakes, sim.i2cFails,
+      100.0 * sim.awakeUs / sim.nowUs);
+  return 0;
+}
@@ -0,0 +1,114 @@
+// Temporal filter: apply() bit-exact with applyReference() across strengths and motion shifts (including ones past
+// the clamp, and full-range jumps), ns/pixel of each, and the lossless compression ratio with and without filtering
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "lepton_codec.h"
+#include "lepton_filter.h"
+#include "lepton_test.h"
+
+const size_t kWidth = 160, kHeight = 120, kPixels = kWidth * kHeight, kFrameLen = kPixels * 2;
+
+// static smooth Raw14 scene with sensor noise, and a warm object moving across it
+void makeFrame(uint8_t* frame, int n, int noise) {
+  for (size_t y = 0; y < kHeight; y++) {
+    for (size_t x = 0; x < kWidth; x++) {
+      size_t i = y * kWidth + x;
+      int value = 8000 + (int)(300 * sin(x * 0.05) * cos(y * 0.07)) + rand() % noise;
+      if ((int)x - 2 * n >= 0 && (int)x - 2 * n < 20 && y >= 50 && y < 70) {
+        value += 2000;
+      }
+      frame[2 * i] = value >> 8;
+      frame[2 * i + 1] = value & 0xff;
+    }
+  }
+}
+
+void testBitExact() {
+  static uint16_t state[kPixels], referenceState[kPixels];
+  static uint8_t frame[kFrameLen], reference[kFrameLen];
+  srand(1);
+  for (uint8_t fractionBits : {0, 2}) {
+    for (uint16_t strength : {0, 1, 32, 255, 256, 400}) {
+      for (uint8_t motionShift : {0, 3, 4, 8, 9, 31, 32, 40, 255}) {
+        TemporalFilter filter(kWidth, kHeight, state, fractionBits);
+        TemporalFilter referenceFilter(kWidth, kHeight, referenceState, fractionBits);
+        filter.setStrength(strength);
+        filter.setMotionShift(motionShift);
+        referenceFilter.setStrength(strength);
+        referenceFilter.setMotionShift(motionShift);
+        for (int n = 0; n < 8; n++) {
+          makeFrame(frame, n, 64);
+          if (n == 5) {  // full-range jumps in both directions
+            for (size_t i = 0; i < kPixels; i++) {
+              uint16_t value = (i % 2) ? (fractionBits ? 0x3fff : 0xffff) : 0;
+              frame[2 * i] = value >> 8;
+              frame[2 * i + 1] = value & 0xff;
+            }
+          }
+          memcpy(reference, frame, kFrameLen);
+          filter.apply(frame);
+          referenceFilter.applyReference(reference);
+          CHECK(memcmp(frame, reference, kFrameLen) == 0);
+          CHECK(memcmp(state, referenceState, sizeof(state)) == 0);
+        }
+      }
+    }
+  }
+}
+
+double benchmark(bool reference) {
+  const int kFrames = 500;
+  static uint16_t state[kPixels];
+  static uint8_t frames[4][kFrameLen], frame[kFrameLen];
+  srand(2);
+  for (int n = 0; n < 4; n++) {
+    makeFrame(frames[n], n, 64);
+  }
+  TemporalFilter filter(kWidth, kHeight, state);
+  filter.apply(frames[0]);
+  double nanos = 0;
+  for (int n = 0; n < kFrames; n++) {
+    memcpy(frame, frames[n % 4], kFrameLen);
+    Stopwatch time;
+    if (reference) {
+      filter.applyReference(frame);
+    } else {
+      filter.apply(frame);
+    }
+    nanos += time.elapsedNanos();
+  }
+  return nanos / kFrames / kPixels;
+}
+
+double compressionRatio(bool filtered) {
+  const int kFrames = 60;
+  static uint16_t state[kPixels], encoderReference[kPixels];
+  static uint8_t frame[kFrameLen];
+  std::vector<uint8_t> out(LeptonCodec::maxEncodedLen(kWidth, kHeight));
+  TemporalFilter filter(kWidth, kHeight, state);
+  LosslessEncoder encoder(kWidth, kHeight, encoderReference);
+  srand(3);
+  size_t encodedBytes = 0;
+  for (int n = 0; n < kFrames; n++) {
+    makeFrame(frame, n, 8);
+    if (filtered) {
+      filter.apply(frame);
+    }
+    size_t len = encoder.encode(frame, out.data(), out.size());
+    CHECK(len > 0);
+    encodedBytes += len;
+  }
+  return (double)kFrames * kFrameLen / encodedBytes;
+}
+
+int main() {
+  testBitExact();
+  benchmark(false);  // warm up
+  double applyNanos = benchmark(false), referenceNanos = benchmark(true);
+  printf("160x120: apply %.2f ns/px, applyReference %.2f ns/px\n", applyNanos, referenceNanos);
+  double unfilteredRatio = compressionRatio(false), filteredRatio = compressionRatio(true);
+  printf("lossless ratio: unfiltered %.2f, filtered %.2f\n", unfilteredRatio, filteredRatio);
+  CHECK(filteredRatio > unfilteredRatio * 1.2);
+  return 0;
+}
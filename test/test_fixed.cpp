@@ -0,0 +1,82 @@
+// Compile-time specialized readout (FlirLeptonFixed) against the runtime FlirLepton readout: identical frames,
+// runtime overloads still reachable, and per-frame driver time
+#include <string.h>
+#include "lepton_fixed.h"
+#include "lepton_test.h"
+
+typedef FlirLeptonFixed<LeptonModel::Lepton3, LeptonFormat::Raw14> LeptonFixed;
+const int kFrames = 2000;
+
+void boot(FlirLepton& lepton, bool crcCheck) {
+  FlirLepton::BootPolicy policy = FlirLepton::kDefaultBootPolicy;
+  policy.waitForFfc = false;
+  lepton.setBootPolicy(policy);
+  CHECK(lepton.begin());
+  while (!lepton.isReady()) {
+    sim.advance(1000);
+  }
+  lepton.setVoSpiCrcCheck(crcCheck);
+  lepton.resetVoSpiStats();
+}
+
+// frames read per round, rounds alternate between the two drivers and the fastest round of each is reported, so
+// timer and scheduling noise does not dominate the few percent being compared
+const int kRounds = 10;
+
+template <typename ReadFn>
+double timeRound(ReadFn read) {
+  int frames = 0;
+  Stopwatch time;
+  while (frames < kFrames / kRounds) {
+    if (read()) {
+      frames++;
+    }
+  }
+  return time.elapsedNanos() / (kFrames / kRounds);
+}
+
+void report(const char* name, FlirLepton& lepton, double nanosPerFrame) {
+  const FlirLepton::VoSpiStats& stats = lepton.getVoSpiStats();
+  printf("%-16s %6.1f us/frame (including simulated bus), %u frames, %u CRC errors, %u sync errors\n", name,
+      nanosPerFrame / 1000, (unsigned)stats.frames, (unsigned)stats.crcErrors, (unsigned)stats.syncErrors);
+  CHECK(stats.crcErrors == 0 && stats.syncErrors == 0);
+}
+
+int main() {
+  static uint8_t runtimeFrame[LeptonFixed::kFrameBufferLen], fixedFrame[LeptonFixed::kFrameBufferLen];
+  sim.framePeriodUs = 0;  // frames back to back, so the benchmark measures readouts
+
+  TwoWire wire;
+  SPIClass spi;
+  FlirLepton runtime(wire, spi, 1, SimCamera::kResetPin);
+  LeptonFixed fixed(wire, spi, 1, SimCamera::kResetPin);
+  CHECK(runtime.getFrameBufferLen() == LeptonFixed::kFrameBufferLen);
+  for (bool crcCheck : {false, true}) {
+    boot(runtime, crcCheck);
+    boot(fixed, crcCheck);
+    double runtimeNanos = 1e12, fixedNanos = 1e12;
+    for (int round = 0; round < kRounds; round++) {
+      double nanos = timeRound([&]() {
+        return runtime.readVoSpi(sizeof(runtimeFrame), runtimeFrame);
+      });
+      runtimeNanos = nanos < runtimeNanos ? nanos : runtimeNanos;
+      nanos = timeRound([&]() {
+        return fixed.readVoSpi(fixedFrame);
+      });
+      fixedNanos = nanos < fixedNanos ? nanos : fixedNanos;
+    }
+    report(crcCheck ? "runtime, CRC" : "runtime", runtime, runtimeNanos);
+    report(crcCheck ? "fixed, CRC" : "fixed", fixed, fixedNanos);
+    printf("fixed / runtime %.2f\n", fixedNanos / runtimeNanos);
+    CHECK(memcmp(runtimeFrame, fixedFrame, sizeof(fixedFrame)) == 0);
+  }
+
+  // the runtime overloads are not hidden by the fixed ones
+  CHECK(fixed.setVideoFormat());
+  CHECK(fixed.setVideoFormat(FlirLepton::kGrey14));
+  memset(fixedFrame, 0, sizeof(fixedFrame));
+  while (!fixed.readVoSpi(sizeof(fixedFrame), fixedFrame)) {
+  }
+  CHECK(memcmp(runtimeFrame, fixedFrame, sizeof(fixedFrame)) == 0);
+  return 0;
+}
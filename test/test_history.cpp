@@ -0,0 +1,83 @@
+// Frame history: exported records decode to the written frames, and freeze() from another thread waits out a
+// write in progress so the contents stay stable while frozen
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include "lepton_history.h"
+#include "lepton_test.h"
+
+const size_t kWidth = 160, kHeight = 120, kFrameLen = kWidth * kHeight * 2;
+const size_t kFrames = 64;
+
+static uint8_t frames[kFrames][kFrameLen];
+static uint8_t storage[256 * 1024];
+static uint16_t reference[kWidth * kHeight];
+
+struct ExportCheck {
+  LosslessDecoder* decoder;
+  uint8_t frame[kFrameLen];
+  size_t decoded, mismatched;
+};
+
+// timestamps are the index of the frame written
+bool checkRecord(const uint8_t* encoded, size_t len, uint32_t timestampMillis, void* context) {
+  ExportCheck* check = (ExportCheck*)context;
+  if (!check->decoder->decode(encoded, len, check->frame) ||
+      memcmp(check->frame, frames[timestampMillis % kFrames], kFrameLen) != 0) {
+    check->mismatched++;
+  }
+  check->decoded++;
+  return true;
+}
+
+int main() {
+  for (size_t n = 0; n < kFrames; n++) {
+    for (size_t i = 0; i < kWidth * kHeight; i++) {
+      int value = 29500 + (int)(i % kWidth) * 3 + (int)n + rand() % 16;
+      frames[n][2 * i] = value >> 8;
+      frames[n][2 * i + 1] = value & 0xff;
+    }
+  }
+  FrameHistory history(kWidth, kHeight, storage, sizeof(storage), reference, 40000, 10);
+
+  std::atomic<bool> stop{false};
+  std::atomic<uint32_t> written{0};
+  std::thread writer([&]() {
+    for (uint32_t n = 0; !stop; n++) {
+      if (history.write(frames[n % kFrames], n)) {
+        written++;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  static uint16_t decoderReference[kWidth * kHeight];
+  LosslessDecoder decoder(kWidth, kHeight, decoderReference);
+  static ExportCheck check;
+  check.decoder = &decoder;
+  size_t exports = 0;
+  while (exports < 200) {
+    uint32_t writtenBefore = written;
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+    if (written == writtenBefore) {
+      continue;  // let the history fill between exports
+    }
+    history.freeze();
+    size_t numFrames = history.getNumFrames(), bytesUsed = history.getBytesUsed();
+    uint32_t spanMillis = history.getSpanMillis();
+    check.decoded = check.mismatched = 0;
+    size_t passed = history.exportRecords(0, checkRecord, &check);
+    std::this_thread::sleep_for(std::chrono::microseconds(200));  // the writer only drops frames while frozen
+    CHECK(history.getNumFrames() == numFrames && history.getBytesUsed() == bytesUsed &&
+        history.getSpanMillis() == spanMillis);
+    CHECK(passed > 0 && check.decoded == passed && check.mismatched == 0);
+    history.unfreeze();
+    exports++;
+  }
+  stop = true;
+  writer.join();
+  printf("%zu exports, %u frames written, %u dropped, %zu frames / %zu B stored\n", exports, (unsigned)written,
+      (unsigned)history.getDroppedFrames(), history.getNumFrames(), history.getBytesUsed());
+  return 0;
+}
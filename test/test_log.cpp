@@ -0,0 +1,155 @@
+// Deferred log ring: records drain to the same text as printf, a full ring drops and counts, concurrent producers
+// lose nothing uncounted, and VoSPI desyncs land in the ring. Benchmarks a deferred record() against an immediate
+// LeptonLog::print (to /dev/null, plus the 115200 baud line time it would block on over a UART).
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lepton.h"
+#include "lepton_log.h"
+#include "lepton_test.h"
+
+const char kDesyncFormat[] = "unexpected packet num %i (seg %i), expected %i";
+
+std::vector<std::string> lines;
+
+void collectLine(char level, const char* message, void*) {
+  lines.push_back(std::string(1, level) + " " + message);
+}
+
+void countLine(char, const char*, void* context) {
+  (*(long*)context)++;
+}
+
+void testRing() {
+  LeptonLog::DeferredLog* log = new LeptonLog::DeferredLog();
+  log->record('W', kDesyncFormat, 12, 3, 7);
+  log->record('I', "no args");
+  log->record('E', "%u %x %i %i", 4000000000u, 0xbeef, -5, 0);
+  CHECK(log->drain(collectLine, nullptr) == 3);
+  CHECK(lines.size() == 3 && lines[0] == "W unexpected packet num 12 (seg 3), expected 7" && lines[1] == "I no args" &&
+      lines[2] == "E 4000000000 beef -5 0");
+
+  // a full ring drops newer records, keeping the oldest
+  for (size_t i = 0; i < LeptonLog::DeferredLog::kCapacity + 10; i++) {
+    log->record('W', "%i", (int)i);
+  }
+  CHECK(log->getDrops() == 10);
+  lines.clear();
+  CHECK(log->drain(collectLine, nullptr) == LeptonLog::DeferredLog::kCapacity);
+  CHECK(lines.front() == "W 0" && lines.back() == "W 63");
+  delete log;
+
+  // concurrent producers against a draining consumer: every record is either drained or counted as dropped
+  const int kProducers = 3, kRecords = 200000;
+  log = new LeptonLog::DeferredLog();
+  std::atomic<bool> done{false};
+  long drained = 0;
+  std::thread consumer([&]() {
+    while (!done) {
+      log->drain(countLine, &drained);
+    }
+    log->drain(countLine, &drained);
+  });
+  std::thread producers[kProducers];
+  for (std::thread& producer : producers) {
+    producer = std::thread([&]() {
+      for (int i = 0; i < kRecords; i++) {
+        log->record('W', kDesyncFormat, i, 1, i + 1);
+        if (i % 64 == 0) {
+          std::this_thread::yield();  // lets the consumer in on a single core
+        }
+      }
+    });
+  }
+  for (std::thread& producer : producers) {
+    producer.join();
+  }
+  done = true;
+  consumer.join();
+  printf("%d producers: %ld drained + %u dropped of %d\n", kProducers, drained, (unsigned)log->getDrops(),
+      kProducers * kRecords);
+  CHECK(drained + log->getDrops() == kProducers * kRecords);
+  delete log;
+}
+
+// VoSPI desyncs on a noisy link are deferred, one warning per sync error
+void testDesyncs() {
+  TwoWire wire;
+  SPIClass spi;
+  spi.errorRate = [](uint32_t) { return 1e-4; };
+  FlirLepton lepton(wire, spi, 1, SimCamera::kResetPin);
+  FlirLepton::BootPolicy policy = FlirLepton::kDefaultBootPolicy;
+  policy.waitForFfc = false;
+  lepton.setBootPolicy(policy);
+  CHECK(lepton.begin());
+  while (!lepton.isReady()) {
+    sim.advance(1000);
+  }
+  long warnings = 0;
+  LeptonLog::deferredLog.drain(countLine, &warnings);  // discards boot records, if any
+  warnings = 0;
+  static uint8_t frame[160 * 120 * 2];
+  const FlirLepton::VoSpiStats& stats = lepton.getVoSpiStats();
+  while (stats.frames < 500) {
+    if (!lepton.readVoSpi(sizeof(frame), frame)) {
+      sim.advance(100);  // through resyncs
+    }
+    LeptonLog::deferredLog.drain(countLine, &warnings);
+  }
+  printf("noisy link: %u frames, %u sync errors, %ld deferred warnings\n", (unsigned)stats.frames,
+      (unsigned)stats.syncErrors, warnings);
+  CHECK(stats.syncErrors > 0 && warnings == (long)stats.syncErrors && LeptonLog::deferredLog.getDrops() == 0);
+}
+
+void benchmark() {
+  const int kRecords = 1000000, kPrints = 100000;
+  LeptonLog::DeferredLog* log = new LeptonLog::DeferredLog();
+  LeptonLog::DeferredLog::Record record;
+  Stopwatch recordTime;
+  for (int i = 0; i < kRecords; i++) {
+    log->record('W', kDesyncFormat, i, 2, i + 1);
+    log->pop(record);  // keeps the ring from filling, without formatting
+  }
+  double recordNanos = recordTime.elapsedNanos() / kRecords;
+
+  long drained = 0;
+  Stopwatch drainTime;
+  for (int i = 0; i < kRecords; i++) {
+    log->record('W', kDesyncFormat, i, 2, i + 1);
+    if (i % 32 == 31) {
+      log->drain(countLine, &drained);
+    }
+  }
+  double drainNanos = drainTime.elapsedNanos() / kRecords;
+  CHECK(drained == kRecords - kRecords % 32 && log->getDrops() == 0);
+  delete log;
+
+  fflush(stdout);
+  int savedStdout = dup(fileno(stdout));
+  CHECK(freopen("/dev/null", "w", stdout) != nullptr);
+  Stopwatch printTime;
+  for (int i = 0; i < kPrints; i++) {
+    LeptonLog::print('W', kDesyncFormat, i, 2, i + 1);
+  }
+  fflush(stdout);
+  double printNanos = printTime.elapsedNanos() / kPrints;
+  dup2(savedStdout, fileno(stdout));
+  close(savedStdout);
+
+  char line[128];
+  size_t lineLen = strlen("LEP W ") + snprintf(line, sizeof(line), kDesyncFormat, 12345, 2, 12346) + 2;  // and CRLF
+  printf("desync warning: record %.1f ns, record + drain %.1f ns, immediate print %.1f ns (+%.0f us at 115200 baud)\n",
+      recordNanos, drainNanos, printNanos, lineLen * 10 * 1e6 / 115200);
+}
+
+int main() {
+  sim.framePeriodUs = 0;  // frames back to back
+  testRing();
+  testDesyncs();
+  benchmark();
+  return 0;
+}
@@ -0,0 +1,136 @@
+// Frame pipeline on std::threads, capturing from the simulated camera into slots paced at kCapturePeriodUs of wall
+// time: a checksum process stage, lossless encode, and a fan-out that decodes and checks every frame against the
+// camera's, so a slot recycled while still in use shows up as corruption. Reports per-stage latency, queue high-water
+// marks, drops and overruns, with an unthrottled fan-out and one slower than the camera.
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "lepton.h"
+#include "lepton_codec.h"
+#include "lepton_pipeline.h"
+#include "lepton_test.h"
+
+const size_t kWidth = 160, kHeight = 120, kFrameLen = kWidth * kHeight * 2;
+const size_t kSlots = 3;
+const uint32_t kCapturePeriodUs = 2000;
+const uint32_t kFramesOut = 500;
+
+typedef FramePipeline<kSlots> TestPipeline;
+
+FlirLepton* lepton;
+static uint8_t frames[kSlots][kFrameLen], discard[kFrameLen], expected[kFrameLen], decoded[kFrameLen];
+uint32_t checksums[kSlots];
+std::vector<uint8_t> encoded[kSlots];
+size_t encodedLen[kSlots];
+static uint16_t encoderReference[kWidth * kHeight], decoderReference[kWidth * kHeight];
+LosslessEncoder encoder(kWidth, kHeight, encoderReference);
+LosslessDecoder decoder(kWidth, kHeight, decoderReference);
+
+std::chrono::steady_clock::time_point nextCapture;
+uint32_t fanOutDelayUs = 0;
+std::atomic<uint32_t> framesOut{0}, corruptFrames{0};
+
+uint32_t checksum(const uint8_t* frame) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i < kFrameLen; i++) {
+    sum = sum * 31 + frame[i];
+  }
+  return sum;
+}
+
+// stands in for the camera's frame rate, since the simulated clock runs as fast as the bus is read
+bool capture(int slot, void*) {
+  std::this_thread::sleep_until(nextCapture);
+  if (!lepton->readVoSpi(kFrameLen, slot >= 0 ? frames[slot] : discard)) {
+    return false;
+  }
+  nextCapture += std::chrono::microseconds(kCapturePeriodUs);
+  return true;
+}
+
+bool process(int slot, void*) {
+  checksums[slot] = checksum(frames[slot]);
+  return true;
+}
+
+bool encode(int slot, void*) {
+  encodedLen[slot] = encoder.encode(frames[slot], encoded[slot].data(), encoded[slot].size());
+  return encodedLen[slot] > 0;
+}
+
+bool fanOut(int slot, void*) {
+  if (!decoder.decode(encoded[slot].data(), encodedLen[slot], decoded) || memcmp(decoded, expected, kFrameLen) != 0 ||
+      memcmp(frames[slot], expected, kFrameLen) != 0 || checksum(frames[slot]) != checksums[slot]) {
+    corruptFrames++;
+  }
+  if (fanOutDelayUs > 0) {
+    std::this_thread::sleep_for(std::chrono::microseconds(fanOutDelayUs));
+  }
+  framesOut++;
+  return true;
+}
+
+// returns the overruns
+uint32_t run(const char* name, uint32_t delayUs) {
+  const TestPipeline::Config config = {capture, process, encode, fanOut, nullptr, Pipeline::kAnyCore,
+      Pipeline::kAnyCore};
+  TestPipeline pipeline(config);
+  fanOutDelayUs = delayUs;
+  framesOut = 0;
+  encoder.requestKeyframe();
+  nextCapture = std::chrono::steady_clock::now();
+  Stopwatch time;
+  pipeline.start();
+  while (framesOut < kFramesOut && time.elapsedNanos() < 60e9) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  pipeline.stop();
+  double millis = time.elapsedNanos() / 1e6;
+
+  printf("%s: %u frames out in %.0f ms (%.0f fps), %u overruns, %u corrupt\n", name, (unsigned)framesOut, millis,
+      framesOut * 1000 / millis, (unsigned)pipeline.getOverruns(), (unsigned)corruptFrames);
+  Pipeline& stages = pipeline.getPipeline();
+  for (size_t i = 0; i < stages.getNumStages(); i++) {
+    const PipelineStageStats& stats = stages.getStageStats(i);
+    printf("  %-8s %5u items, mean %5u us, max %6u us\n", stages.getStageName(i), (unsigned)stats.count,
+        (unsigned)stats.getMeanMicros(), (unsigned)stats.maxMicros);
+  }
+  const char* queueNames[] = {"process", "encode", "fanOut"};
+  for (int id = TestPipeline::kToProcess; id <= TestPipeline::kToFanOut; id++) {
+    const TestPipeline::SlotQueue& queue = pipeline.getQueue((TestPipeline::QueueId)id);
+    printf("  queue to %-8s high-water %u/%u, %u drops\n", queueNames[id], (unsigned)queue.getHighWater(),
+        (unsigned)kSlots, (unsigned)queue.getDrops());
+    CHECK(queue.getDrops() == 0 && queue.getHighWater() <= kSlots);
+  }
+
+  CHECK(framesOut >= kFramesOut && corruptFrames == 0);
+  // every frame read was dropped on overrun, fanned out, or is still in a slot
+  uint32_t captured = stages.getStageStats(0).count;
+  CHECK(captured >= pipeline.getOverruns() + framesOut && captured <= pipeline.getOverruns() + framesOut + kSlots);
+  return pipeline.getOverruns();
+}
+
+int main() {
+  sim.framePeriodUs = 0;  // paced by capture() instead
+  TwoWire wire;
+  SPIClass spi;
+  FlirLepton camera(wire, spi, 1, SimCamera::kResetPin);
+  lepton = &camera;
+  FlirLepton::BootPolicy policy = FlirLepton::kDefaultBootPolicy;
+  policy.waitForFfc = false;
+  camera.setBootPolicy(policy);
+  CHECK(camera.begin());
+  while (!camera.isReady()) {
+    sim.advance(1000);
+  }
+  while (!camera.readVoSpi(kFrameLen, expected)) {  // every simulated frame is the same
+  }
+  for (std::vector<uint8_t>& out : encoded) {
+    out.resize(LeptonCodec::maxEncodedLen(kWidth, kHeight));
+  }
+
+  run("fan-out unthrottled", 0);
+  CHECK(run("fan-out 3 ms/frame", 3000) > 0);
+  return 0;
+}
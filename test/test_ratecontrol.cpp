@@ -0,0 +1,77 @@
+// Rate control against a fake encoder (each level ~20% smaller than the one above, with frame-to-frame noise) and a
+// simulated link of fixed capacity: the achieved bitrate is seeded from the first frame, the level converges under
+// the target and link budgets, backs off when link capacity drops, and recovers when it returns
+#include <stdlib.h>
+#include "lepton_ratecontrol.h"
+#include "lepton_test.h"
+
+const uint32_t kFrameMicros = 37037;  // 27 Hz
+const uint32_t kLevel0Bytes = 20000;
+
+uint32_t nowMicros = 0;
+
+size_t encodedBytes(uint8_t level) {
+  size_t bytes = kLevel0Bytes;
+  for (uint8_t i = 0; i < level; i++) {
+    bytes = bytes * 4 / 5;
+  }
+  return bytes * (95 + rand() % 11) / 100;  // +-5%
+}
+
+// streams frames to one client over a link of capacityBitsPerSecond, returning the frames until the level last changed
+int stream(RateControl& rateControl, uint32_t capacityBitsPerSecond, int frames, uint8_t* levelOut) {
+  int lastChange = 0;
+  uint8_t lastLevel = RateControl::kNoLevel;
+  for (int i = 0; i < frames; i++) {
+    uint8_t level = rateControl.selectLevel();
+    size_t bytes = encodedBytes(level);
+    rateControl.reportEncoded(level, bytes, nowMicros);
+    rateControl.reportClientDrain(bytes, (uint64_t)bytes * 8 * 1000000 / capacityBitsPerSecond);
+    nowMicros += kFrameMicros;
+    if (level != lastLevel) {
+      lastChange = i;
+      lastLevel = level;
+    }
+  }
+  *levelOut = lastLevel;
+  return lastChange;
+}
+
+void report(const char* name, RateControl& rateControl, uint32_t capacityBitsPerSecond, uint8_t level,
+    int settledFrame) {
+  printf("%-22s link %7u bps: level %u (last change at frame %3d), achieved %7u bps, budget %7u bps\n", name,
+      (unsigned)capacityBitsPerSecond, level, settledFrame, (unsigned)rateControl.getAchievedBitrate(),
+      (unsigned)rateControl.getBudgetBitrate());
+}
+
+int main() {
+  srand(1);
+  RateControl rateControl(4000000);
+
+  // the first interval seeds the achieved bitrate instead of averaging up from zero
+  uint8_t level;
+  stream(rateControl, 10000000, 2, &level);
+  uint32_t firstBitsPerSecond = (uint64_t)kLevel0Bytes * 8 * 1000000 / kFrameMicros;
+  printf("after 2 frames: achieved %u bps, sent %u bps\n", (unsigned)rateControl.getAchievedBitrate(),
+      (unsigned)firstBitsPerSecond);
+  CHECK(rateControl.getAchievedBitrate() > firstBitsPerSecond * 9 / 10 &&
+      rateControl.getAchievedBitrate() < firstBitsPerSecond * 11 / 10);
+
+  // a fast link, limited by the 4 Mbps target
+  int settled = stream(rateControl, 10000000, 200, &level);
+  report("target-limited", rateControl, 10000000, level, settled);
+  CHECK(settled < 150 && rateControl.getAchievedBitrate() <= 4000000 && rateControl.getAchievedBitrate() > 2400000);
+  uint8_t targetLevel = level;
+
+  // link capacity drops below the target: the level backs off within a few frames and stays under capacity
+  settled = stream(rateControl, 1500000, 200, &level);
+  report("link drops", rateControl, 1500000, level, settled);
+  CHECK(level > targetLevel && settled < 50);
+  CHECK(rateControl.getAchievedBitrate() <= 1500000 && rateControl.getAchievedBitrate() > 900000);
+
+  // and recovers, one level at a time, when it returns
+  settled = stream(rateControl, 10000000, 300, &level);
+  report("link recovers", rateControl, 10000000, level, settled);
+  CHECK(level == targetLevel && rateControl.getAchievedBitrate() <= 4000000);
+  return 0;
+}
@@ -0,0 +1,106 @@
+// ROI readout against a crop of the full frame, over the Lepton 3 four-segment layout (two packets per row, 30 rows
+// per segment): ROIs crossing packet and segment boundaries, frame edges, decimation 1, 2 and 4, in Grey14 and RGB888
+#include <string.h>
+#include "lepton.h"
+#include "lepton_test.h"
+
+const size_t kWidth = 160, kHeight = 120;
+static uint8_t full[kWidth * kHeight * 3], roiFrame[kWidth * kHeight * 3 + 1];  // with a guard byte
+
+void readFrame(FlirLepton& lepton, size_t len, uint8_t* buffer) {
+  while (!lepton.readVoSpi(len, buffer)) {
+  }
+}
+
+bool readRoi(FlirLepton& lepton, const FlirLepton::VoSpiRoi& roi) {
+  memset(roiFrame, 0xa5, sizeof(roiFrame));
+  for (int i = 0; i < 100; i++) {
+    if (lepton.readVoSpiRoi(roi, sizeof(roiFrame), roiFrame)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// returns the number of pixels compared
+size_t checkRoi(FlirLepton& lepton, const FlirLepton::VoSpiRoi& roi, size_t bytesPerPixel) {
+  CHECK(readRoi(lepton, roi));
+  size_t outWidth = (roi.width + roi.decimation - 1) / roi.decimation;
+  size_t outHeight = (roi.height + roi.decimation - 1) / roi.decimation;
+  CHECK(lepton.getRoiBufferLen(roi) == outWidth * outHeight * bytesPerPixel);
+  for (size_t y = 0; y < outHeight; y++) {
+    for (size_t x = 0; x < outWidth; x++) {
+      const uint8_t* expected = full + ((roi.y + y * roi.decimation) * kWidth + roi.x + x * roi.decimation) *
+          bytesPerPixel;
+      if (memcmp(roiFrame + (y * outWidth + x) * bytesPerPixel, expected, bytesPerPixel) != 0) {
+        fprintf(stderr, "ROI (%u, %u) %ux%u /%u: mismatch at output (%zu, %zu)\n", roi.x, roi.y, roi.width,
+            roi.height, roi.decimation, x, y);
+        CHECK(false);
+      }
+    }
+  }
+  CHECK(roiFrame[outWidth * outHeight * bytesPerPixel] == 0xa5);  // nothing written past the output
+  return outWidth * outHeight;
+}
+
+void testFormat(FlirLepton& lepton, size_t bytesPerPixel) {
+  sim.packetDataLen = 80 * bytesPerPixel;
+  CHECK(lepton.setVideoParameters(bytesPerPixel, kWidth, kHeight, 80 * bytesPerPixel, 60, 4));
+  readFrame(lepton, kWidth * kHeight * bytesPerPixel, full);
+
+  const FlirLepton::VoSpiRoi kRois[] = {
+    {0, 0, 160, 120, 1},  // full frame
+    {75, 25, 11, 10, 1},  // across the packet boundary within a row, and the segment 1/2 boundary
+    {79, 29, 2, 2, 1},  // the four pixels around both boundaries
+    {0, 59, 160, 2, 1},  // last row of segment 2, first of segment 3
+    {159, 119, 1, 1, 1},  // last pixel
+    {0, 0, 160, 120, 2},
+    {1, 1, 159, 119, 2},  // odd origin
+    {77, 27, 7, 7, 2},  // odd size across both boundaries
+    {0, 0, 160, 120, 4},
+    {3, 2, 157, 117, 4},
+    {78, 87, 5, 6, 4},  // across the packet boundary and the segment 3/4 boundary
+  };
+  size_t pixels = 0;
+  for (const FlirLepton::VoSpiRoi& roi : kRois) {
+    pixels += checkRoi(lepton, roi, bytesPerPixel);
+  }
+  srand(1);
+  for (int i = 0; i < 200; i++) {
+    FlirLepton::VoSpiRoi roi;
+    roi.x = rand() % kWidth;
+    roi.y = rand() % kHeight;
+    roi.width = 1 + rand() % (kWidth - roi.x);
+    roi.height = 1 + rand() % (kHeight - roi.y);
+    roi.decimation = 1 << (rand() % 3);
+    pixels += checkRoi(lepton, roi, bytesPerPixel);
+  }
+  printf("%s: %zu ROIs, %zu pixels match the full-frame crop\n", bytesPerPixel == 3 ? "RGB888" : "Grey14",
+      sizeof(kRois) / sizeof(kRois[0]) + 200, pixels);
+
+  // invalid ROIs are rejected without reading
+  const FlirLepton::VoSpiRoi kInvalid[] = {{0, 0, 160, 120, 3}, {0, 0, 0, 10, 1}, {100, 0, 61, 10, 1},
+      {0, 110, 10, 11, 2}};
+  for (const FlirLepton::VoSpiRoi& roi : kInvalid) {
+    CHECK(!lepton.readVoSpiRoi(roi, sizeof(roiFrame), roiFrame));
+  }
+  FlirLepton::VoSpiRoi roi = {0, 0, 160, 120, 1};
+  CHECK(!lepton.readVoSpiRoi(roi, lepton.getRoiBufferLen(roi) - 1, roiFrame));
+}
+
+int main() {
+  sim.framePeriodUs = 0;  // frames back to back
+  TwoWire wire;
+  SPIClass spi;
+  FlirLepton lepton(wire, spi, 1, SimCamera::kResetPin);
+  FlirLepton::BootPolicy policy = FlirLepton::kDefaultBootPolicy;
+  policy.waitForFfc = false;
+  lepton.setBootPolicy(policy);
+  CHECK(lepton.begin());
+  while (!lepton.isReady()) {
+    sim.advance(1000);
+  }
+  testFormat(lepton, 2);
+  testFormat(lepton, 3);
+  return 0;
+}
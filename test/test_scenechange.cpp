@@ -0,0 +1,87 @@
+// Scene-change gating on a synthetic 27 Hz sequence: a static noisy background, a hot object moving across it, and the
+// background again. Static frames are skipped down to the keepalive, moving ones all go through. Reports frames and
+// lossless-encoded bytes sent against ungated streaming per phase, and ns per shouldSend().
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "lepton_codec.h"
+#include "lepton_scenechange.h"
+#include "lepton_test.h"
+
+const size_t kWidth = 160, kHeight = 120, kFrameLen = kWidth * kHeight * 2;
+const uint32_t kFrameMillis = 37;  // 27 Hz
+const uint32_t kKeepaliveMillis = 1000;
+const uint16_t kBackground = 29500, kNoise = 8, kObject = 2000;  // ~22 C, +-0.08 K, +20 K in TLinear
+const size_t kObjectSize = 16, kObjectStep = 2;
+
+static uint8_t frame[kFrameLen];
+static uint16_t state[SceneChangeDetector::getStateLen(kWidth, kHeight)];
+static uint16_t gatedReference[kWidth * kHeight], ungatedReference[kWidth * kHeight];
+SceneChangeDetector detector(kWidth, kHeight, state);
+LosslessEncoder gatedEncoder(kWidth, kHeight, gatedReference), ungatedEncoder(kWidth, kHeight, ungatedReference);
+std::vector<uint8_t> encoded(LeptonCodec::maxEncodedLen(kWidth, kHeight));
+uint32_t nowMillis = 0;
+double detectNanos = 0;
+
+// objectX < 0 for no object
+void render(int objectX) {
+  for (size_t y = 0; y < kHeight; y++) {
+    for (size_t x = 0; x < kWidth; x++) {
+      uint16_t value = kBackground + rand() % (2 * kNoise + 1) - kNoise;
+      if (objectX >= 0 && x >= (size_t)objectX && x < objectX + kObjectSize && y >= 52 && y < 52 + kObjectSize) {
+        value += kObject;
+      }
+      frame[2 * (y * kWidth + x)] = value >> 8;
+      frame[2 * (y * kWidth + x) + 1] = value & 0xff;
+    }
+  }
+}
+
+struct Phase {
+  uint32_t seen, sent;
+  size_t bytesSent, bytesUngated;
+};
+
+Phase run(const char* name, int frames, bool moving) {
+  Phase phase = {};
+  for (int i = 0; i < frames; i++) {
+    render(moving ? (i * kObjectStep) % (kWidth - kObjectSize) : -1);
+    Stopwatch time;
+    bool send = detector.shouldSend(frame, nowMillis);
+    detectNanos += time.elapsedNanos();
+    phase.bytesUngated += ungatedEncoder.encode(frame, encoded.data(), encoded.size());
+    if (send) {
+      phase.bytesSent += gatedEncoder.encode(frame, encoded.data(), encoded.size());
+      phase.sent++;
+    }
+    phase.seen++;
+    nowMillis += kFrameMillis;
+  }
+  printf("%-8s %3u/%3u frames sent, %8zu/%8zu bytes (%.1f%% saved)\n", name, (unsigned)phase.sent,
+      (unsigned)phase.seen, phase.bytesSent, phase.bytesUngated, 100.0 - 100.0 * phase.bytesSent / phase.bytesUngated);
+  return phase;
+}
+
+int main() {
+  srand(1);
+  detector.setKeepaliveMillis(kKeepaliveMillis);
+
+  const int kStaticFrames = 270, kMovingFrames = 135;
+  Phase still = run("static", kStaticFrames, false);
+  Phase moving = run("moving", kMovingFrames, true);
+  Phase stillAgain = run("static", kStaticFrames, false);
+
+  // the first frame primes the detector, then one per keepalive
+  const uint32_t keepalives = kStaticFrames * kFrameMillis / kKeepaliveMillis;
+  CHECK(still.sent >= keepalives && still.sent <= keepalives + 1);
+  CHECK(moving.sent == moving.seen);
+  CHECK(stillAgain.sent >= keepalives && stillAgain.sent <= keepalives + 2);  // plus the object leaving
+
+  uint32_t seen = detector.getFramesSeen(), sent = detector.getFramesSent();
+  size_t bytesSent = still.bytesSent + moving.bytesSent + stillAgain.bytesSent;
+  size_t bytesUngated = still.bytesUngated + moving.bytesUngated + stillAgain.bytesUngated;
+  printf("total    %3u/%3u frames sent, %8zu/%8zu bytes (%.1f%% saved), %.0f ns/frame detection\n", (unsigned)sent,
+      (unsigned)seen, bytesSent, bytesUngated, 100.0 - 100.0 * bytesSent / bytesUngated, detectNanos / seen);
+  CHECK(seen == 2 * kStaticFrames + kMovingFrames && sent == still.sent + moving.sent + stillAgain.sent);
+  return 0;
+}
@@ -0,0 +1,142 @@
+// Serial frame protocol: resynchronization and error accounting on a corrupted stream, and end-to-end frame
+// throughput over a pseudo-terminal, raw and lossless compressed
+#include <pty.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+#include "lepton_serial_protocol.h"
+#include "lepton_test.h"
+
+const uint16_t kWidth = 160, kHeight = 120;
+const size_t kFrameLen = kWidth * kHeight * 2;
+const size_t kNumFrames = 4;
+static uint8_t frames[kNumFrames][kFrameLen];
+
+struct Received {
+  size_t frames, matched;
+};
+
+void onFrame(const uint8_t* frame, uint16_t width, uint16_t height, uint16_t seq, void* context) {
+  Received* received = (Received*)context;
+  received->frames++;
+  if (width == kWidth && height == kHeight && memcmp(frame, frames[seq % kNumFrames], kFrameLen) == 0) {
+    received->matched++;
+  }
+}
+
+// one message per vector, split on the delimiter
+void collectMessages(const uint8_t* data, size_t len, void* context) {
+  std::vector<std::vector<uint8_t>>* messages = (std::vector<std::vector<uint8_t>>*)context;
+  for (size_t i = 0; i < len; i++) {
+    messages->back().push_back(data[i]);
+    if (data[i] == 0) {
+      messages->emplace_back();
+    }
+  }
+}
+
+void testResync() {
+  std::vector<std::vector<uint8_t>> messages(1);
+  SerialFrameSender sender(collectMessages, &messages);
+  for (size_t n = 0; n < 6; n++) {
+    sender.sendRawFrame(frames[n % kNumFrames], kWidth, kHeight);
+  }
+
+  static uint8_t messageBuf[LeptonSerialProtocol::kHeaderLen + kFrameLen + LeptonSerialProtocol::kCrcLen];
+  Received received = {0, 0};
+  SerialFrameReceiver receiver(messageBuf, sizeof(messageBuf), onFrame, &received);
+  receiver.push((const uint8_t*)"\x12\x34garbage\x00", 10);  // line noise before the first message
+  receiver.push(messages[0].data(), messages[0].size());
+  messages[1][100] ^= 0x01;  // corrupted
+  receiver.push(messages[1].data(), messages[1].size());
+  receiver.push(messages[2].data(), messages[2].size() / 2);  // truncated, merges with the next message
+  receiver.push(messages[3].data(), messages[3].size());
+  receiver.push(messages[4].data(), messages[4].size());
+  receiver.push(messages[5].data(), messages[5].size());
+  printf("resync: %u received, %u dropped, %u CRC errors, %u format errors\n", (unsigned)receiver.getFramesReceived(),
+      (unsigned)receiver.getFramesDropped(), (unsigned)receiver.getCrcErrors(), (unsigned)receiver.getFormatErrors());
+  CHECK(received.frames == 3 && received.matched == 3);  // seq 0, 4, 5
+  CHECK(receiver.getFramesDropped() == 3);  // seq 1-3
+  CHECK(receiver.getCrcErrors() + receiver.getFormatErrors() >= 2);
+}
+
+int fdMaster, fdSlave;
+
+void writeSlave(const uint8_t* data, size_t len, void*) {
+  while (len > 0) {
+    ssize_t written = write(fdSlave, data, len);
+    if (written > 0) {
+      data += written;
+      len -= written;
+    }
+  }
+}
+
+void benchmarkPty(bool lossless) {
+  const size_t kFrames = 200;
+  CHECK(openpty(&fdMaster, &fdSlave, nullptr, nullptr, nullptr) == 0);
+  termios attrs;
+  tcgetattr(fdSlave, &attrs);
+  cfmakeraw(&attrs);
+  tcsetattr(fdSlave, TCSANOW, &attrs);
+
+  static uint8_t messageBuf[LeptonSerialProtocol::kHeaderLen + kFrameLen + LeptonSerialProtocol::kCrcLen];
+  static uint8_t frameBuf[kFrameLen];
+  static uint16_t encoderReference[kWidth * kHeight], decoderReference[kWidth * kHeight];
+  LosslessEncoder encoder(kWidth, kHeight, encoderReference);
+  LosslessDecoder decoder(kWidth, kHeight, decoderReference);
+  Received received = {0, 0};
+  SerialFrameReceiver receiver(messageBuf, sizeof(messageBuf), onFrame, &received, &decoder, frameBuf);
+  std::thread reader([&]() {
+    uint8_t buf[4096];
+    while (receiver.getFramesReceived() + receiver.getCrcErrors() + receiver.getFormatErrors() < kFrames) {
+      ssize_t len = read(fdMaster, buf, sizeof(buf));
+      if (len > 0) {
+        receiver.push(buf, len);
+      }
+    }
+  });
+
+  SerialFrameSender sender(writeSlave, nullptr);
+  std::vector<uint8_t> encoded(LeptonCodec::maxEncodedLen(kWidth, kHeight));
+  size_t payloadBytes = 0;
+  Stopwatch time;
+  for (size_t n = 0; n < kFrames; n++) {
+    if (lossless) {
+      size_t len = encoder.encode(frames[n % kNumFrames], encoded.data(), encoded.size());
+      sender.sendLosslessFrame(encoded.data(), len, kWidth, kHeight);
+      payloadBytes += len;
+    } else {
+      sender.sendRawFrame(frames[n % kNumFrames], kWidth, kHeight);
+      payloadBytes += kFrameLen;
+    }
+  }
+  reader.join();
+  double seconds = time.elapsedNanos() / 1e9;
+  close(fdSlave);
+  close(fdMaster);
+
+  printf("pty %-8s: %zu / %zu frames intact, %u dropped, %.1f frames/s, %.1f MB/s payload\n",
+      lossless ? "lossless" : "raw", received.matched, kFrames, (unsigned)receiver.getFramesDropped(),
+      kFrames / seconds, payloadBytes / seconds / 1e6);
+  CHECK(received.matched == kFrames && receiver.getFramesDropped() == 0);
+}
+
+int main() {
+  for (size_t n = 0; n < kNumFrames; n++) {
+    for (size_t i = 0; i < kWidth * kHeight; i++) {
+      int value = 29500 + (int)(i % kWidth) * 2 + rand() % 16;
+      if (i == 77) {
+        value = 0;  // zero bytes exercise the COBS encoding
+      }
+      frames[n][2 * i] = value >> 8;
+      frames[n][2 * i + 1] = value & 0xff;
+    }
+  }
+  testResync();
+  benchmarkPty(false);
+  benchmarkPty(true);
+  return 0;
+}
@@ -0,0 +1,117 @@
+// Controller statistics requests: concurrent pollers merge into one CCI read, reads queued after an ROI change are
+// not merged into earlier ones and wait for a frame with the new ROI, statistics and ROI batches skip the config
+// hook, and the CCI bus cost of each read
+#include <string.h>
+#include <thread>
+#include "lepton_controller.h"
+#include "lepton_test.h"
+
+const uint8_t kBoth = LeptonController::kStatisticsSpotmeter | LeptonController::kStatisticsAgc;
+
+int hookCalls = 0;
+
+void countHook(bool before, void*) {
+  hookCalls += before;
+}
+
+void printCost(const char* name, TwoWire& wire, long bytesBefore, long transactionsBefore) {
+  printf("%-28s %4ld B, %3ld transactions on the CCI bus\n", name, wire.bytes - bytesBefore,
+      wire.transactions - transactionsBefore);
+}
+
+int main() {
+  TwoWire wire;
+  SPIClass spi;
+  FlirLepton lepton(wire, spi, 1, SimCamera::kResetPin);
+  LeptonController controller(lepton);
+  FlirLepton::BootPolicy policy = FlirLepton::kDefaultBootPolicy;
+  policy.waitForFfc = false;
+  lepton.setBootPolicy(policy);
+  controller.setConfigHook(countHook, nullptr);
+
+  // pollers racing to request statistics before boot collapse into one pending read
+  std::thread pollers[4];
+  for (std::thread& poller : pollers) {
+    poller = std::thread([&]() {
+      for (int i = 0; i < 1000; i++) {
+        CHECK(controller.requestStatistics(LeptonController::kStatisticsSpotmeter));
+      }
+    });
+  }
+  for (std::thread& poller : pollers) {
+    poller.join();
+  }
+  CHECK(controller.requestStatistics(LeptonController::kStatisticsAgc));
+  CHECK(controller.getStatus().requestsPending == 1);
+
+  CHECK(lepton.begin());
+  while (!controller.service()) {
+  }
+  LeptonController::Status status = controller.getStatus();
+  CHECK(status.requestsPending == 0 && status.requestsApplied == 1 && status.statisticsGeneration == 1);
+  CHECK(strcmp(status.flirPartNum, "500-0771-01") == 0);
+  CHECK(hookCalls == 0);
+
+  long bytes = wire.bytes, transactions = wire.transactions;
+  for (int i = 0; i < 100; i++) {
+    CHECK(controller.requestStatistics(kBoth));
+  }
+  controller.service();
+  printCost("100 merged statistics polls", wire, bytes, transactions);
+  bytes = wire.bytes;
+  transactions = wire.transactions;
+  CHECK(controller.requestStatistics(kBoth));
+  controller.service();
+  printCost("1 statistics poll", wire, bytes, transactions);
+  FlirLepton::CciRoi roi = {50, 70, 69, 89};
+  bytes = wire.bytes;
+  transactions = wire.transactions;
+  CHECK(lepton.setSpotmeterRoi(roi));
+  printCost("setSpotmeterRoi", wire, bytes, transactions);
+  CHECK(controller.getStatus().statisticsGeneration == 3);
+
+  // a read queued after an ROI change is not merged into an earlier one, and waits for a frame with the new ROI
+  // (here the settle time, since service() reads no frames), holding back what is queued after it
+  CHECK(controller.requestStatistics(LeptonController::kStatisticsSpotmeter));
+  CHECK(controller.requestSpotmeterRoi(roi));
+  CHECK(controller.requestStatistics(LeptonController::kStatisticsSpotmeter));
+  CHECK(controller.requestStatistics(LeptonController::kStatisticsAgc));
+  CHECK(controller.requestVsync());
+  CHECK(controller.getStatus().requestsPending == 4);
+  controller.service();
+  status = controller.getStatus();
+  CHECK(status.statisticsGeneration == 4 && status.requestsPending == 2);
+  controller.service();
+  CHECK(controller.getStatus().requestsPending == 2);
+  sim.advance(LeptonController::kRoiSettleMillis * 1000);
+  controller.service();
+  status = controller.getStatus();
+  CHECK(status.statisticsGeneration == 5 && status.requestsPending == 0 && status.requestsFailed == 0);
+  CHECK(hookCalls == 0);
+
+  // while streaming, the read waits for a frame read after the ROI change
+  static uint8_t frame[160 * 120 * 2];
+  CHECK(controller.requestAgcRoi(roi));
+  CHECK(controller.requestStatistics(LeptonController::kStatisticsAgc));
+  uint32_t roiFrame = 0;
+  bool roiApplied = false;
+  for (int i = 0; i < 100000 && controller.getStatus().statisticsGeneration == 5; i++) {
+    controller.readVoSpi(sizeof(frame), frame);
+    status = controller.getStatus();
+    if (!roiApplied && status.requestsPending == 1) {
+      roiApplied = true;
+      roiFrame = status.framesRead;
+    }
+  }
+  status = controller.getStatus();
+  printf("ROI applied after frame %u, statistics read after frame %u\n", (unsigned)roiFrame,
+      (unsigned)status.framesRead);
+  CHECK(roiApplied && status.statisticsGeneration == 6 && status.framesRead > roiFrame);
+  CHECK(hookCalls == 0);
+
+  // format changes still run the hook
+  CHECK(controller.requestVideoFormat(FlirLepton::kGrey14));
+  controller.service();
+  CHECK(hookCalls == 1);
+  return 0;
+}
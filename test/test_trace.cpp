@@ -0,0 +1,74 @@
+// Latency tracer on the simulated clock, starting just before the 32-bit micros() wraparound: percentiles against
+// exact ones from the recorded samples, exact maxima, and JSON export with truncation
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "Arduino.h"
+#include "lepton_trace.h"
+#include "lepton_test.h"
+
+const int kFrames = 10000;
+
+// micros() is 32 bits on the camera's targets
+uint32_t advance(uint32_t us) {
+  sim.advance(us);
+  return (uint32_t)micros();
+}
+
+// the tracer's definition: the sample at rank ceil(count * percentile / 100)
+uint32_t exactPercentile(std::vector<uint32_t>& samples, uint8_t percentile) {
+  std::sort(samples.begin(), samples.end());
+  size_t rank = (samples.size() * percentile + 99) / 100;
+  return samples[rank < 1 ? 0 : rank - 1];
+}
+
+int main() {
+  sim.nowUs = 0xfffff000ull;
+  LatencyTracer tracer;
+  std::vector<uint32_t> samples[LatencyTracer::kNumStages];
+  srand(1);
+  for (int i = 0; i < kFrames; i++) {
+    FrameTimestamps timestamps;
+    timestamps.sequence = i + 1;
+    timestamps.firstPacketMicros = advance(111111);
+    timestamps.lastPacketMicros = advance(12000 + rand() % 500);
+    timestamps.publishMicros = advance(50 + rand() % 100);
+    timestamps.encodeDoneMicros = advance(8000 + rand() % (i % 100 == 0 ? 40000 : 4000));  // occasional slow encode
+    timestamps.sendDoneMicros = advance(2000 + rand() % 3000);
+    tracer.record(timestamps);
+
+    samples[LatencyTracer::kReadout].push_back(timestamps.lastPacketMicros - timestamps.firstPacketMicros);
+    samples[LatencyTracer::kPublish].push_back(timestamps.publishMicros - timestamps.lastPacketMicros);
+    samples[LatencyTracer::kEncode].push_back(timestamps.encodeDoneMicros - timestamps.publishMicros);
+    samples[LatencyTracer::kSend].push_back(timestamps.sendDoneMicros - timestamps.encodeDoneMicros);
+    samples[LatencyTracer::kTotal].push_back(timestamps.sendDoneMicros - timestamps.firstPacketMicros);
+  }
+  CHECK(sim.nowUs > 0x100000000ull);  // wrapped during the run
+  CHECK(tracer.getCount() == kFrames);
+
+  for (size_t stage = 0; stage < LatencyTracer::kNumStages; stage++) {
+    LatencyTracer::Stage s = (LatencyTracer::Stage)stage;
+    for (uint8_t percentile : {50, 90, 99}) {
+      uint32_t exact = exactPercentile(samples[stage], percentile), traced = tracer.getPercentile(s, percentile);
+      printf("%-8s p%u: traced %6u us, exact %6u us\n", LatencyTracer::getStageName(s), percentile, traced, exact);
+      CHECK(traced >= exact - exact / 8 - 1 && traced <= exact + exact / 8 + 1);  // within a bucket
+    }
+    CHECK(tracer.getMax(s) == *std::max_element(samples[stage].begin(), samples[stage].end()));
+    CHECK(tracer.getMax(s) < 100000);  // no wraparound artifacts
+  }
+
+  char json[512];
+  size_t len = tracer.exportJson(json, sizeof(json));
+  printf("%s\n", json);
+  CHECK(len == strlen(json) && len < sizeof(json));
+  const char prefix[] = "{\"count\":10000,\"readout\":{\"p50\":";
+  CHECK(strncmp(json, prefix, sizeof(prefix) - 1) == 0 && json[len - 1] == '}');
+  char truncated[20];
+  CHECK(tracer.exportJson(truncated, sizeof(truncated)) == len);
+  CHECK(strlen(truncated) == sizeof(truncated) - 1 && strncmp(truncated, json, sizeof(truncated) - 1) == 0);
+  CHECK(tracer.exportJson(nullptr, 0) == len);
+
+  tracer.reset();
+  CHECK(tracer.getCount() == 0 && tracer.getPercentile(LatencyTracer::kTotal, 50) == 0);
+  return 0;
+}
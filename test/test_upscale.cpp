@@ -0,0 +1,112 @@
+// Upscaler: scale rounding (3 upscales by 2), nearest replication, exact bilinear on a ramp at scales 2 and 4, and
+// edge-aware steps staying sharp. Benchmarks ns per output pixel for each mode, and the memory upscaling a row at a
+// time needs (scratch and one output row, or a 16 row JPEG strip) against a full upscaled frame.
+#include <vector>
+#include "lepton_upscale.h"
+#include "lepton_test.h"
+
+const uint16_t kWidth = 160, kHeight = 120;
+
+uint16_t sample16(const uint8_t* data, size_t index) {
+  return ((uint16_t)data[2 * index] << 8) | data[2 * index + 1];
+}
+
+void testScales() {
+  for (uint8_t scale = 0; scale <= 6; scale++) {
+    Upscaler upscaler(kWidth, kHeight, 1, 2, scale, Upscaler::kBilinear);
+    uint8_t expected = scale >= 4 ? 4 : scale >= 2 ? 2 : 1;
+    CHECK(upscaler.getScale() == expected && Upscaler::clampScale(scale) == expected);
+    CHECK(upscaler.getOutWidth() == kWidth * expected && upscaler.getOutHeight() == kHeight * expected);
+  }
+}
+
+void testRamp() {
+  // 16-bit horizontal ramp, constant down each column
+  static uint8_t frame[kWidth * kHeight * 2];
+  for (size_t y = 0; y < kHeight; y++) {
+    for (size_t x = 0; x < kWidth; x++) {
+      uint16_t value = 1000 + 64 * x;
+      frame[2 * (y * kWidth + x)] = value >> 8;
+      frame[2 * (y * kWidth + x) + 1] = value & 0xff;
+    }
+  }
+
+  for (uint8_t scale = 2; scale <= 4; scale += 2) {
+    Upscaler nearest(kWidth, kHeight, 1, 2, scale, Upscaler::kNearest);
+    Upscaler bilinear(kWidth, kHeight, 1, 2, scale, Upscaler::kBilinear);
+    std::vector<uint8_t> out(bilinear.getOutRowLen());
+    std::vector<uint32_t> scratch(bilinear.getScratchLen());
+    for (uint16_t outY = 0; outY < bilinear.getOutHeight(); outY += 7) {
+      nearest.upscaleRow(frame, outY, out.data(), nullptr);
+      for (size_t outX = 0; outX < nearest.getOutWidth(); outX++) {
+        CHECK(sample16(out.data(), outX) == 1000 + 64 * (outX / scale));
+      }
+      bilinear.upscaleRow(frame, outY, out.data(), scratch.data());
+      // output pixel centers at (outX + 0.5) / scale - 0.5 source pixels, clamped at the edges
+      for (size_t outX = scale; outX + scale < bilinear.getOutWidth(); outX++) {
+        int32_t expected = 1000 + 64 * (2 * (int32_t)outX + 1 - scale) / (2 * scale);
+        CHECK(sample16(out.data(), outX) == expected);
+      }
+      CHECK(sample16(out.data(), 0) == 1000 && sample16(out.data(), bilinear.getOutWidth() - 1) == 1000 + 64 * 159);
+    }
+  }
+}
+
+void testEdges() {
+  // an 8-bit step from 10 to 200 at x = 80: bilinear blends across it, edge-aware doesn't
+  static uint8_t frame[kWidth * kHeight];
+  for (size_t i = 0; i < kWidth * kHeight; i++) {
+    frame[i] = i % kWidth < 80 ? 10 : 200;
+  }
+  Upscaler bilinear(kWidth, kHeight, 1, 1, 2, Upscaler::kBilinear);
+  Upscaler edgeAware(kWidth, kHeight, 1, 1, 2, Upscaler::kEdgeAware);
+  std::vector<uint8_t> out(bilinear.getOutRowLen());
+  std::vector<uint32_t> scratch(bilinear.getScratchLen());
+  bilinear.upscaleRow(frame, 50, out.data(), scratch.data());
+  CHECK(out[159] > 10 && out[159] < 200 && out[160] > 10 && out[160] < 200);
+  edgeAware.upscaleRow(frame, 50, out.data(), scratch.data());
+  CHECK(out[159] == 10 && out[160] == 200);
+}
+
+void benchmark(const char* name, uint8_t channels, uint8_t bytesPerChannel, uint8_t scale, Upscaler::Mode mode) {
+  const int kFrames = 20;
+  std::vector<uint8_t> frame((size_t)kWidth * kHeight * channels * bytesPerChannel);
+  for (size_t i = 0; i < frame.size(); i++) {
+    frame[i] = rand();
+  }
+  Upscaler upscaler(kWidth, kHeight, channels, bytesPerChannel, scale, mode);
+  std::vector<uint8_t> out(upscaler.getOutRowLen());
+  std::vector<uint32_t> scratch(upscaler.getScratchLen());
+  Stopwatch time;
+  for (int n = 0; n < kFrames; n++) {
+    for (uint16_t outY = 0; outY < upscaler.getOutHeight(); outY++) {
+      upscaler.upscaleRow(frame.data(), outY, out.data(), scratch.data());
+    }
+  }
+  double pixelNanos = time.elapsedNanos() / kFrames / upscaler.getOutWidth() / upscaler.getOutHeight();
+
+  size_t scratchLen = mode == Upscaler::kNearest ? 0 : scratch.size() * sizeof(uint32_t);
+  size_t rowLen = scratchLen + out.size(), stripLen = scratchLen + 16 * out.size();
+  size_t frameLen = out.size() * upscaler.getOutHeight();
+  printf("%-20s x%u: %5.2f ns/output pixel; peak %6zu B per row, %6zu B per 16 row strip, %7zu B full frame\n", name,
+      scale, pixelNanos, rowLen, stripLen, frameLen);
+}
+
+int main() {
+  testScales();
+  testRamp();
+  testEdges();
+
+  srand(1);
+  const char* modeNames[] = {"nearest", "bilinear", "edge-aware"};
+  char name[32];
+  for (int mode = Upscaler::kNearest; mode <= Upscaler::kEdgeAware; mode++) {
+    for (uint8_t scale = 2; scale <= 4; scale += 2) {
+      snprintf(name, sizeof(name), "%s 16-bit", modeNames[mode]);
+      benchmark(name, 1, 2, scale, (Upscaler::Mode)mode);
+      snprintf(name, sizeof(name), "%s RGB", modeNames[mode]);
+      benchmark(name, 3, 1, scale, (Upscaler::Mode)mode);
+    }
+  }
+  return 0;
+}